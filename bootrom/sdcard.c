@@ -14,6 +14,8 @@
 #define SPI_XFER_CTRL_REG	0x2
 #define SPI_XFER_BUF_OFFS	8192
 #define SPI_BASE_ADDRESS	0x80004000
+/* The transfer length field is 13 bits wide. */
+#define SPI_XFER_MAX		8191
 
 #define XFER_START		(1 << 16)
 #define XFER_BUSY		(1 << 17)
@@ -21,13 +23,6 @@
 #define DATA_START_TOKEN	0xfe
 #define BLOCK_SIZE		512
 
-/*
- * Load into the middle of SDRAM, this should be flexible enough for ELF files
- * that want to run in the bottom or top of SDRAM.
- */
-static void *load_buffer = (void *)(0x20000000 + (16 * 1024 * 1024));
-#define LOAD_BUFFER_SIZE (16 * 1024 * 1024)
-
 typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned long uint32_t;
@@ -39,19 +34,6 @@ typedef signed long long int64_t;
 
 #include "elf.h"
 
-struct elf_info {
-	const void *elf;
-	const Elf32_Ehdr *ehdr;
-	const Elf32_Shdr *shdrs;
-	const Elf32_Phdr *phdrs;
-	const char *secstrings;
-};
-
-#define for_each_phdr(phdr, elf) \
-	for ((phdr) = (elf)->phdrs; \
-	     (phdr) < (elf)->phdrs + (elf)->ehdr->e_phnum; \
-	     (phdr)++)
-
 static volatile unsigned char *spi_cmd_buf =
 	(volatile unsigned char *)(SPI_BASE_ADDRESS + SPI_XFER_BUF_OFFS);
 
@@ -120,7 +102,7 @@ static void flush_fifo(void)
 	spi_wait_idle();
 }
 
-static void spi_do_command(const struct spi_cmd *cmd)
+static unsigned long spi_do_command(const struct spi_cmd *cmd)
 {
 	unsigned long m, cmdlen;
 
@@ -143,12 +125,13 @@ static void spi_do_command(const struct spi_cmd *cmd)
 	spi_write_reg(SPI_CS_ENABLE_REG, SD_CS);
 	spi_write_reg(SPI_XFER_CTRL_REG, XFER_START | cmdlen);
 	spi_wait_idle();
+
+	return cmdlen;
 }
 
-static const volatile unsigned char *find_r1_response(struct r1_response *r1)
+static const volatile unsigned char *
+find_r1_response_from(const volatile unsigned char *p, struct r1_response *r1)
 {
-	const volatile unsigned char *p = spi_cmd_buf + 7;
-
 	r1->v = 0;
 	while (p < (const volatile unsigned char *)0x80008000 && *p == 0xff)
 		++p;
@@ -161,6 +144,11 @@ static const volatile unsigned char *find_r1_response(struct r1_response *r1)
 	return p;
 }
 
+static const volatile unsigned char *find_r1_response(struct r1_response *r1)
+{
+	return find_r1_response_from(spi_cmd_buf + 7, r1);
+}
+
 static int send_reset(void)
 {
 	struct spi_cmd cmd = {
@@ -374,6 +362,170 @@ static int read_sector(unsigned long address, unsigned char *dst)
 	return 0;
 }
 
+/*
+ * A multiple block read streamed through the SPI transfer buffer.  The
+ * buffer is refilled with as many bytes as the remaining blocks need, up to
+ * the size of the buffer, so that most blocks don't need a separate
+ * transfer.
+ */
+struct sd_stream {
+	const volatile unsigned char *p;
+	const volatile unsigned char *end;
+	unsigned long nr_blocks;
+};
+
+static void stream_refill(struct sd_stream *s)
+{
+	/* Start token, data and CRC16 for each block. */
+	unsigned long m, len = s->nr_blocks * (1 + BLOCK_SIZE + 2);
+
+	if (len > SPI_XFER_MAX)
+		len = SPI_XFER_MAX;
+
+	for (m = 0; m < len; ++m)
+		spi_cmd_buf[m] = 0xff;
+
+	spi_write_reg(SPI_XFER_CTRL_REG, XFER_START | len);
+	spi_wait_idle();
+
+	s->p = spi_cmd_buf;
+	s->end = spi_cmd_buf + len;
+}
+
+static unsigned char stream_getc(struct sd_stream *s)
+{
+	if (s->p == s->end)
+		stream_refill(s);
+
+	return *s->p++;
+}
+
+/* Copy len bytes from the stream to dst, or discard them if dst is NULL. */
+static void stream_copy(struct sd_stream *s, unsigned char *dst,
+			unsigned long len)
+{
+	while (len) {
+		unsigned long m, n;
+
+		if (s->p == s->end)
+			stream_refill(s);
+
+		n = s->end - s->p;
+		if (n > len)
+			n = len;
+		if (dst) {
+			for (m = 0; m < n; ++m)
+				dst[m] = s->p[m];
+			dst += n;
+		}
+		s->p += n;
+		len -= n;
+	}
+}
+
+static int sd_stop_transmission(void)
+{
+	struct spi_cmd cmd = {
+		.cmd = 0x4c,
+		.crc = 0x61,
+		.rx_datalen = 1,
+	};
+	struct r1_response r1;
+
+	/*
+	 * The card keeps sending data while the command is shifted out and
+	 * the byte after it is a stuff byte, so look for r1 after that.
+	 */
+	spi_do_command(&cmd);
+	if (!find_r1_response_from(spi_cmd_buf + 8, &r1))
+		return -1;
+
+	/* Wait for the card to release busy. */
+	do {
+		spi_cmd_buf[0] = 0xff;
+		spi_write_reg(SPI_XFER_CTRL_REG, XFER_START | 1);
+		spi_wait_idle();
+	} while (spi_cmd_buf[0] != 0xff);
+
+	return r1.v & R1_ERROR_MASK;
+}
+
+/*
+ * Read len bytes starting skip bytes into the block at address with a single
+ * multiple block read, copying the data straight to dst.
+ */
+static int read_blocks(unsigned long address, unsigned long skip,
+		       unsigned char *dst, unsigned long len)
+{
+	struct sd_stream s = {
+		.nr_blocks = (skip + len + BLOCK_SIZE - 1) / BLOCK_SIZE,
+	};
+	struct spi_cmd cmd = {
+		.cmd = 0x52,
+		.arg = { (address >> 24) & 0xff,
+			 (address >> 16) & 0xff,
+			 (address >> 8)  & 0xff,
+			 (address >> 0)  & 0xff
+		},
+		.rx_datalen = 1 + s.nr_blocks * (1 + BLOCK_SIZE + 2),
+	};
+	struct r1_response r1;
+	const volatile unsigned char *r1ptr;
+	unsigned long cmdlen;
+
+	if (cmd.rx_datalen > SPI_XFER_MAX - 7 - SD_NCR)
+		cmd.rx_datalen = SPI_XFER_MAX - 7 - SD_NCR;
+
+	spi_write_reg(SPI_CTRL_REG, SD_FAST_DIVIDER);
+
+	cmdlen = spi_do_command(&cmd);
+	r1ptr = find_r1_response(&r1);
+	if (!r1ptr) {
+		putstr("failed to find r1 response\n");
+		return -1;
+	}
+	if (r1.v & R1_ERROR_MASK) {
+		putstr("read blocks failed\n");
+		return -1;
+	}
+
+	s.p = r1ptr + 1;
+	s.end = spi_cmd_buf + cmdlen;
+
+	while (s.nr_blocks) {
+		unsigned long m, n = BLOCK_SIZE - skip;
+
+		if (n > len)
+			n = len;
+
+		for (m = 0; stream_getc(&s) != DATA_START_TOKEN; ++m) {
+			if (m == MAX_DATA_START_OFFS) {
+				putstr("no data start token\n");
+				sd_stop_transmission();
+				return -1;
+			}
+		}
+
+		uart_putc('#');
+		stream_copy(&s, NULL, skip);
+		stream_copy(&s, dst, n);
+		/* The rest of a partial block and the CRC16. */
+		stream_copy(&s, NULL, BLOCK_SIZE - skip - n + 2);
+
+		dst += n;
+		len -= n;
+		skip = 0;
+		--s.nr_blocks;
+	}
+
+	if (sd_stop_transmission()) {
+		putstr("stop transmission failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 static void find_boot_partition(unsigned long *start, unsigned long *size)
 {
 	static unsigned char mbr[BLOCK_SIZE];
@@ -474,22 +626,43 @@ static inline unsigned long fat_read32(const unsigned char *p)
 	return *p | (*(p + 1) << 8) | (*(p + 2) << 16) | (*(p + 3) << 24);
 }
 
-static int sd_read(const struct fat_superblock *sb, void *dst, unsigned len,
+/*
+ * Read len bytes at offset into the partition.  Reads of a block or more are
+ * streamed straight to dst, smaller reads for directory entries and the FAT
+ * go through a single sector cache.
+ */
+static int sd_read(const struct fat_superblock *sb, void *dst, unsigned long len,
 		   unsigned long offset)
 {
+	/*
+	 * The bootrom has no .data section, only zeroed .bss, so the cache
+	 * is tracked with a valid flag rather than an initialized sentinel.
+	 */
 	static unsigned char sector_buf[512];
-	unsigned bytes_read = 0;
+	static unsigned long cached_sector;
+	static int cached_valid;
+	unsigned long bytes_read = 0;
+
+	if (len >= BLOCK_SIZE)
+		return read_blocks((offset & ~(BLOCK_SIZE - 1)) +
+				   sb->partition_lba * BLOCK_SIZE,
+				   offset % BLOCK_SIZE, dst, len);
 
 	while (bytes_read < len) {
-		unsigned sector_num = (offset / 512) + sb->partition_lba;
+		unsigned long sector_num = (offset / 512) + sb->partition_lba;
 		unsigned sector_offset = offset % 512;
 		unsigned bytes_to_sector_end = 512 - sector_offset;
 		unsigned long bytes_remaining = len - bytes_read;
 		unsigned read_len = bytes_to_sector_end < bytes_remaining ?
 			bytes_to_sector_end : bytes_remaining;
 
-		if (read_sector(sector_num * 512, sector_buf))
-			return -1;
+		if (!cached_valid || sector_num != cached_sector) {
+			cached_valid = 0;
+			if (read_sector(sector_num * 512, sector_buf))
+				return -1;
+			cached_sector = sector_num;
+			cached_valid = 1;
+		}
 
 		memcpy(dst + bytes_read, sector_buf + sector_offset, read_len);
 
@@ -695,10 +868,9 @@ static int fat_read_dirent(const struct fat_superblock *sb,
 	return 0;
 }
 
-static unsigned long fat_read_from_cluster(const struct fat_superblock *sb,
-				     void *dst, unsigned long cluster, unsigned long len)
+static unsigned long fat_cluster_offs(const struct fat_superblock *sb,
+				      unsigned long cluster)
 {
-	unsigned long cluster_addr = 0;
 	unsigned long data_sector_base;
 
 	data_sector_base =
@@ -711,72 +883,94 @@ static unsigned long fat_read_from_cluster(const struct fat_superblock *sb,
 	/*
 	 * Clusters 0&1 are reserved so we start from cluster 2, hence the -2.
 	 */
-	cluster_addr = data_sector_base * sb->bytes_per_sector + (cluster - 2) *
+	return data_sector_base * sb->bytes_per_sector + (cluster - 2) *
 		sb->sectors_per_cluster * sb->bytes_per_sector;
-	if (sd_read(sb, dst, len, cluster_addr)) {
-		putstr("failed to read from cluster\n");
-		return 0;
-	}
-
-	return len;
 }
 
-static unsigned long fat_read_buf(const struct fat_superblock *sb,
-			    const struct fat_dirent *dirent, void *dst,
-			    unsigned long len, unsigned offs)
+/*
+ * Read len bytes at offs into the file.  Runs of consecutive clusters are
+ * read with a single multiple block read.
+ */
+static int fat_read_file(const struct fat_superblock *sb,
+			 const struct fat_dirent *dirent, void *dst,
+			 unsigned long len, unsigned long offs)
 {
 	unsigned long cluster = dirent->first_cluster;
-	unsigned long pos = 0, copied = 0;
+	unsigned long pos = 0;
 	unsigned long bytes_per_cluster = sb->bytes_per_sector * sb->sectors_per_cluster;
 
 	while (len > 0) {
-		if (pos >= offs) {
-			unsigned long cluster_offs = offs % bytes_per_cluster;
-			unsigned long clen = bytes_per_cluster - cluster_offs;
+		unsigned long start = cluster, run_len = bytes_per_cluster;
+		unsigned long next;
+
+		for (;;) {
+			next = fat_read_entry(sb, cluster);
+			if (next != cluster + 1)
+				break;
+			cluster = next;
+			run_len += bytes_per_cluster;
+		}
 
-			if (clen > len)
-				clen = len;
-			if (clen > bytes_per_cluster)
-				clen = bytes_per_cluster;
+		if (offs < pos + run_len) {
+			unsigned long n = pos + run_len - offs;
 
-			fat_read_from_cluster(sb, dst + copied, cluster, clen);
+			if (n > len)
+				n = len;
+			if (sd_read(sb, dst, n, fat_cluster_offs(sb, start) +
+				    offs - pos)) {
+				putstr("failed to read from cluster\n");
+				return -1;
+			}
 
-			offs += cluster_offs;
-			copied += clen;
-			len -= clen;
+			dst += n;
+			offs += n;
+			len -= n;
 		}
 
-		cluster = fat_read_entry(sb, cluster);
-		if (cluster == sb->eoc_marker)
+		if (next == sb->eoc_marker || next < 2)
 			break;
 
-		pos += bytes_per_cluster;
+		cluster = next;
+		pos += run_len;
 	}
 
-	return 0;
+	return len ? -1 : 0;
 }
 
-static void load_elf(const void *buf)
+/*
+ * Parse the ELF headers straight from the card and stream each loadable
+ * segment to its load address.
+ */
+static void load_elf(const struct fat_superblock *sb,
+		     const struct fat_dirent *dirent)
 {
-	struct elf_info info = {
-		.elf = buf,
-	};
-	const Elf32_Phdr *phdr;
+	Elf32_Ehdr ehdr;
+	Elf32_Phdr phdr;
+	unsigned m;
+
+	if (fat_read_file(sb, dirent, &ehdr, sizeof(ehdr), 0)) {
+		putstr("failed to read ELF header\n");
+		return;
+	}
 
-	info.ehdr = info.elf;
-	info.shdrs = (const void *)info.ehdr + info.ehdr->e_shoff;
-	info.phdrs = (const void *)info.ehdr + info.ehdr->e_phoff;
-	info.secstrings = (const void *)info.ehdr +
-		info.shdrs[info.ehdr->e_shstrndx].sh_offset;
+	for (m = 0; m < ehdr.e_phnum; ++m) {
+		if (fat_read_file(sb, dirent, &phdr, sizeof(phdr),
+				  ehdr.e_phoff + m * ehdr.e_phentsize)) {
+			putstr("failed to read program header\n");
+			return;
+		}
 
-	for_each_phdr(phdr, &info) {
-		if (phdr->p_type != PT_LOAD)
+		if (phdr.p_type != PT_LOAD)
 			continue;
 
-		memcpy((void *)phdr->p_vaddr, info.elf + phdr->p_offset, phdr->p_filesz);
+		if (fat_read_file(sb, dirent, (void *)phdr.p_vaddr,
+				  phdr.p_filesz, phdr.p_offset)) {
+			putstr("failed to load segment\n");
+			return;
+		}
 	}
 
-	asm volatile("b		%0" :: "r"(info.ehdr->e_entry));
+	asm volatile("b		%0" :: "r"(ehdr.e_entry));
 }
 
 static void find_and_exec_boot_elf(const struct fat_superblock *sb)
@@ -794,10 +988,8 @@ static void find_and_exec_boot_elf(const struct fat_superblock *sb)
 		}
 
 		if (!wstrcmp(dirent.name, u"BOOT.ELF")) {
-			if (!fat_dirent_is_dir(&dirent)) {
-				fat_read_buf(sb, &dirent, load_buffer, LOAD_BUFFER_SIZE, 0);
-				load_elf(load_buffer);
-			}
+			if (!fat_dirent_is_dir(&dirent))
+				load_elf(sb, &dirent);
 		}
 	}
 }
@@ -59,6 +59,9 @@ struct target {
 	/* Populated when stopped. */
 	uint32_t pc;
 
+	/* The simulator can run to the testpoints without single stepping. */
+	bool has_stop_pcs;
+
 	struct regcache *regcache;
 };
 
@@ -152,6 +155,11 @@ static int dbg_start_trace(struct target *t)
 	return dbg_write(t, REG_CMD, CMD_START_TRACE);
 }
 
+static int dbg_stop_trace(struct target *t)
+{
+	return dbg_write(t, REG_CMD, CMD_STOP_TRACE);
+}
+
 int dbg_stop(struct target *t)
 {
 	int rc = dbg_write(t, REG_CMD, CMD_STOP);
@@ -202,6 +210,46 @@ int dbg_step(struct target *t)
 	return rc;
 }
 
+int dbg_run_n(struct target *t, uint32_t nr_instructions)
+{
+	int rc = regcache_sync(t->regcache);
+
+	if (!rc)
+		rc = dbg_cache_sync(t);
+	if (!rc)
+		rc = dbg_write(t, REG_ADDRESS, nr_instructions);
+	if (!rc)
+		rc = dbg_write(t, REG_CMD, CMD_RUN_N);
+	if (!rc)
+		rc = dbg_read(t, REG_RDATA, &t->pc);
+
+	return rc;
+}
+
+static int dbg_reverse(struct target *t, enum dbg_cmd cmd)
+{
+	int rc = regcache_sync(t->regcache);
+
+	if (!rc)
+		rc = dbg_cache_sync(t);
+	if (!rc)
+		rc = dbg_write(t, REG_CMD, cmd);
+	if (!rc)
+		rc = dbg_read(t, REG_RDATA, &t->pc);
+
+	return rc;
+}
+
+int dbg_reverse_step(struct target *t)
+{
+	return dbg_reverse(t, CMD_REVERSE_STEP);
+}
+
+int dbg_reverse_continue(struct target *t)
+{
+	return dbg_reverse(t, CMD_REVERSE_CONTINUE);
+}
+
 static int dbg_reset(struct target *t)
 {
 	int rc = regcache_sync(t->regcache);
@@ -235,6 +283,64 @@ static int dbg_reload_pc(struct target *t)
 	return dbg_read(t, REG_RDATA, &t->pc);
 }
 
+static bool dbg_probe_sim(struct target *t)
+{
+	static const uint32_t challenges[] = { 0, ~0U };
+	unsigned int n;
+	uint32_t v;
+
+	for (n = 0; n < sizeof(challenges) / sizeof(challenges[0]); ++n) {
+		if (dbg_write(t, REG_WDATA, challenges[n]) ||
+		    dbg_write(t, REG_CMD, CMD_SIM_PROBE) ||
+		    dbg_read(t, REG_RDATA, &v) || v != ~challenges[n])
+			return false;
+	}
+
+	return true;
+}
+
+static int dbg_set_stop_pcs(struct target *t,
+			    const struct testpoint *testpoints,
+			    size_t nr_testpoints)
+{
+	int rc = dbg_write(t, REG_CMD, CMD_CLEAR_STOP_PCS);
+	size_t n;
+
+	for (n = 0; !rc && n < nr_testpoints; ++n) {
+		rc = dbg_write(t, REG_ADDRESS, testpoints[n].addr);
+		if (!rc)
+			rc = dbg_write(t, REG_CMD, CMD_ADD_STOP_PC);
+	}
+
+	return rc;
+}
+
+/*
+ * Returns -ETIMEDOUT if no stop PC was reached in max_cycles, nr_cycles is
+ * valid either way.
+ */
+static int dbg_run_to_stop_pc(struct target *t, uint32_t max_cycles,
+			      uint32_t *nr_cycles)
+{
+	int rc = regcache_sync(t->regcache), run_rc;
+
+	if (!rc)
+		rc = dbg_cache_sync(t);
+	if (!rc)
+		rc = dbg_write(t, REG_ADDRESS, max_cycles);
+	if (rc)
+		return rc;
+
+	run_rc = dbg_write(t, REG_CMD, CMD_RUN_TO_STOP_PC);
+	if (run_rc && run_rc != -ETIMEDOUT)
+		return run_rc;
+	rc = dbg_read(t, REG_RDATA, nr_cycles);
+	if (!rc)
+		rc = dbg_reload_pc(t);
+
+	return rc ? : run_rc;
+}
+
 int dbg_read_reg(struct target *t, unsigned reg, uint32_t *val)
 {
 	int rc;
@@ -506,6 +612,44 @@ static void do_exec(struct target *target,
 		printf("breakpoint %d hit at %08x\n", bkp->id, bkp->addr);
 }
 
+/*
+ * Reverse execution is only supported by the simulator.  Unlike do_exec() we
+ * must not step over a breakpoint at the current PC first - the simulator
+ * restores memory to match the breakpoint set when it lands.
+ */
+static void do_reverse(struct target *target,
+		       int (*fn)(struct target *))
+{
+	struct breakpoint *bkp;
+
+	restore_mmu(target);
+	if (fn(target))
+		warnx("failed to reverse target (not a simulator?)");
+	disable_mmu(target);
+
+	bkp = breakpoint_at_addr(target->pc);
+	if (bkp)
+		printf("breakpoint %d hit at %08x\n", bkp->id, bkp->addr);
+}
+
+static int lua_reverse_step(lua_State *L)
+{
+	assert_target(L);
+
+	do_reverse(target, dbg_reverse_step);
+
+	return 0;
+}
+
+static int lua_reverse_continue(lua_State *L)
+{
+	assert_target(L);
+
+	do_reverse(target, dbg_reverse_continue);
+
+	return 0;
+}
+
 static int lua_step(lua_State *L)
 {
 	assert_target(L);
@@ -515,6 +659,80 @@ static int lua_step(lua_State *L)
 	return 0;
 }
 
+/*
+ * Run until a testpoint, returning the number of cycles executed and whether
+ * a testpoint or breakpoint was reached, or nil if the target can't do that
+ * and the caller needs to single step.
+ */
+static int lua_run_to_testpoint(lua_State *L)
+{
+	struct breakpoint *bkp;
+	uint32_t nr_cycles = 0;
+	lua_Integer max_cycles = 0;
+	int rc;
+
+	assert_target(L);
+
+	if (!target->has_stop_pcs) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	if (lua_gettop(L) >= 1)
+		max_cycles = lua_tointeger(L, 1);
+
+	bkp = breakpoint_at_addr(target->pc);
+	if (bkp)
+		breakpoint_exec_orig(bkp);
+
+	restore_mmu(target);
+	rc = dbg_run_to_stop_pc(target, max_cycles, &nr_cycles);
+	if (rc && rc != -ETIMEDOUT)
+		warnx("failed to run target");
+	disable_mmu(target);
+
+	lua_pushinteger(L, nr_cycles);
+	lua_pushboolean(L, !rc);
+	/* Let the caller tell a failed run from running out of cycles. */
+	if (rc && rc != -ETIMEDOUT)
+		lua_pushstring(L, "failed to run target");
+	else
+		lua_pushnil(L);
+
+	return 3;
+}
+
+static int lua_run_n(lua_State *L)
+{
+	struct breakpoint *bkp;
+	lua_Integer nr_instructions;
+
+	assert_target(L);
+
+	if (lua_gettop(L) != 1) {
+		lua_pushstring(L, "no instruction count");
+		lua_error(L);
+	}
+
+	nr_instructions = lua_tointeger(L, 1);
+	lua_pop(L, 1);
+
+	bkp = breakpoint_at_addr(target->pc);
+	if (bkp)
+		breakpoint_exec_orig(bkp);
+
+	restore_mmu(target);
+	if (dbg_run_n(target, nr_instructions))
+		warnx("failed to run target");
+	disable_mmu(target);
+
+	bkp = breakpoint_at_addr(target->pc);
+	if (bkp)
+		printf("breakpoint %d hit at %08x\n", bkp->id, bkp->addr);
+
+	return 0;
+}
+
 static int lua_term(lua_State *L)
 {
 	assert_target(L);
@@ -533,6 +751,15 @@ static int lua_start_trace(lua_State *L)
 	return 0;
 }
 
+static int lua_stop_trace(lua_State *L)
+{
+	assert_target(L);
+
+	(void)dbg_stop_trace(target);
+
+	return 0;
+}
+
 static int lua_stop(lua_State *L)
 {
 	assert_target(L);
@@ -750,6 +977,10 @@ static int lua_loadelf(lua_State *L)
 		warnx("failed to load device with %s", path);
 	lua_pop(L, 1);
 
+	if (target->has_stop_pcs &&
+	    dbg_set_stop_pcs(target, testpoints, nr_testpoints))
+		warnx("failed to set testpoints");
+
 	set_symbols(L, path);
 
 	lua_newtable(L);
@@ -789,6 +1020,8 @@ static int lua_connect(lua_State *L)
 		lua_error(L);
 	}
 
+	target->has_stop_pcs = dbg_probe_sim(target);
+
 	if (interactive) {
 		lua_getglobal(L, "report_cpu");
 		if (lua_pcall(L, 0, 0, 0))
@@ -800,7 +1033,11 @@ static int lua_connect(lua_State *L)
 
 static const struct luaL_Reg dbg_funcs[] = {
 	{ "step", lua_step },
+	{ "run_n", lua_run_n },
+	{ "run_to_testpoint", lua_run_to_testpoint },
 	{ "run", lua_run },
+	{ "reverse_step", lua_reverse_step },
+	{ "reverse_continue", lua_reverse_continue },
 	{ "stop", lua_stop },
 	{ "read_reg", lua_read_reg },
 	{ "write_reg", lua_write_reg },
@@ -815,6 +1052,7 @@ static const struct luaL_Reg dbg_funcs[] = {
 	{ "connect", lua_connect },
 	{ "term", lua_term },
 	{ "start_trace", lua_start_trace },
+	{ "stop_trace", lua_stop_trace },
 	{ "reset", lua_reset },
 	{ "read_cpuid", lua_read_cpuid },
 	{ "set_bkp", lua_set_bkp },
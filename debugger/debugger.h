@@ -43,6 +43,9 @@ struct regcache;
 int dbg_stop(struct target *t);
 int dbg_run(struct target *t);
 int dbg_step(struct target *t);
+int dbg_run_n(struct target *t, uint32_t nr_instructions);
+int dbg_reverse_step(struct target *t);
+int dbg_reverse_continue(struct target *t);
 int dbg_read_reg(struct target *t, unsigned reg, uint32_t *val);
 int dbg_write_reg(struct target *t, unsigned reg, uint32_t val);
 int dbg_read32(struct target *t, unsigned addr, uint32_t *val);
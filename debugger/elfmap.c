@@ -71,3 +71,71 @@ void unmap_elf(const struct elf_info *info)
 	munmap((void *)info->elf, info->maplen);
 	close(info->fd);
 }
+
+static int load_segment(elf_write_fn write, void *priv, uint32_t addr,
+			const uint8_t *data, size_t len)
+{
+	/*
+	 * Align the destination to a 32 bit boundary so we can do word
+	 * accesses for performance.
+	 */
+	while (addr & 0x3 && len) {
+		if (write(priv, addr, *data, 8))
+			goto fail;
+		++addr;
+		++data;
+		--len;
+	}
+
+	/* Now do as many word writes as possible. */
+	while (len >= 4) {
+		uint32_t v;
+
+		memcpy(&v, data, 4);
+		if (write(priv, addr, v, 32))
+			goto fail;
+
+		addr += 4;
+		data += 4;
+		len -= 4;
+	}
+
+	/* Finally do any remaining bytes. */
+	while (len) {
+		if (write(priv, addr, *data, 8))
+			goto fail;
+		++addr;
+		++data;
+		--len;
+	}
+
+	return 0;
+
+fail:
+	warnx("failed to write to %08x", addr);
+
+	return -EIO;
+}
+
+int load_elf_segments(const struct elf_info *info, elf_write_fn write,
+		      void *priv)
+{
+	const Elf32_Phdr *phdr;
+	int ret;
+
+	for_each_phdr(phdr, info) {
+		if (phdr->p_type != PT_LOAD)
+			continue;
+
+		ret = load_segment(write, priv, (uint32_t)phdr->p_vaddr,
+				   (const uint8_t *)info->elf + phdr->p_offset,
+				   phdr->p_filesz);
+		if (ret) {
+			warnx("failed to load segment to %08x",
+			      (uint32_t)phdr->p_vaddr);
+			return ret;
+		}
+	}
+
+	return 0;
+}
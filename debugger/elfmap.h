@@ -2,6 +2,7 @@
 #define __ELFMAP_H__
 
 #include <stddef.h>
+#include <stdint.h>
 
 struct elf_info {
 	int fd;
@@ -24,7 +25,16 @@ struct elf_info {
 	     (phdr) < (elf)->phdrs + (elf)->ehdr->e_phnum; \
 	     (phdr)++)
 
+/*
+ * Write a value of width 8 or 32 bits to the target, returning non-zero on
+ * failure.
+ */
+typedef int (*elf_write_fn)(void *priv, uint32_t addr, uint32_t v,
+			    unsigned int width);
+
 int init_elf(const char *path, struct elf_info *info);
 void unmap_elf(const struct elf_info *info);
+int load_elf_segments(const struct elf_info *info, elf_write_fn write,
+		      void *priv);
 
 #endif /* __ELFMAP_H__ */
@@ -19,55 +19,13 @@
 #include "debugger.h"
 #include "elfmap.h"
 
-static int load_segment(struct target *target, uint32_t addr,
-			const uint8_t *data, size_t len)
+static int target_write(void *priv, uint32_t addr, uint32_t v,
+			unsigned int width)
 {
-	int ret;
-
-	/*
-	 * Align the destination to a 32 bit boundary so we can do word
-	 * accesses for performance.
-	 */
-	while (addr & 0x3 && len--) {
-		uint32_t v = *(data++);
-
-		ret = dbg_write8(target, addr++, v);
-		if (ret) {
-			warnx("failed to write to %08x", addr);
-			goto out;
-		}
-	}
-
-	/* Now do as many word writes as possible. */
-	while (len >= 4) {
-		uint32_t v;
-
-		memcpy(&v, data, 4);
-
-		ret = dbg_write32(target, addr, v);
-		if (ret) {
-			warnx("faield to write to %08x", addr);
-			goto out;
-		}
-
-		addr += 4;
-		data += 4;
-		len -= 4;
-	}
+	struct target *target = priv;
 
-	/* Finally do any remaining bytes. */
-	while (len--) {
-		uint32_t v = *(data++);
-
-		ret = dbg_write8(target, addr++, v);
-		if (ret) {
-			warnx("failed to write to %08x", addr);
-			goto out;
-		}
-	}
-
-out:
-	return ret;
+	return width == 32 ? dbg_write32(target, addr, v) :
+		dbg_write8(target, addr, v);
 }
 
 static const Elf32_Shdr *find_section(const struct elf_info *elf,
@@ -119,24 +77,14 @@ int load_elf(struct target *target, const char *path,
 {
 	struct elf_info elf = {};
 	int ret;
-	const Elf32_Phdr *phdr;
 
 	ret = init_elf(path, &elf);
 	if (ret)
 		return ret;
 
-	for_each_phdr(phdr, &elf) {
-		if (phdr->p_type != PT_LOAD)
-			continue;
-
-		ret = load_segment(target, (uint32_t)phdr->p_vaddr,
-				   elf.elf + phdr->p_offset, phdr->p_filesz);
-		if (ret) {
-			warnx("failed to load segment to %08x",
-			      (uint32_t)phdr->p_vaddr);
-			goto out;
-		}
-	}
+	ret = load_elf_segments(&elf, target_write, target);
+	if (ret)
+		goto out;
 
 	init_regs(target);
 	if (dbg_write_reg(target, PC, (uint32_t)elf.ehdr->e_entry))
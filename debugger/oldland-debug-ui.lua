@@ -5,6 +5,11 @@ require "io"
 step = target.step
 stop = target.stop
 run = target.run
+run_n = target.run_n
+reverse_step = target.reverse_step
+reverse_continue = target.reverse_continue
+start_trace = target.start_trace
+stop_trace = target.stop_trace
 write_reg = target.write_reg
 write32 = target.write32
 write16 = target.write16
@@ -19,9 +19,32 @@ enum dbg_cmd {
 	CMD_CACHE_SYNC,
 	CMD_CPUID,
 	CMD_GET_EXEC_STATUS,
+	CMD_RUN_N,
 
+	/*
+	 * Simulator only.  The low nibble of each new command is 0xf, which
+	 * is a no-op on bitstreams that decode 4 bit commands, and anything
+	 * outside of 0-15 is a no-op on current ones.
+	 */
 	CMD_START_TRACE = -2,
 	CMD_SIM_TERM = -1,
+
+	/*
+	 * Run until the PC reaches one of a set of addresses.  CMD_SIM_PROBE
+	 * returns the inverse of the write data so that the debugger can tell
+	 * whether it is talking to the simulator.
+	 */
+	CMD_SIM_PROBE = -17,
+	CMD_CLEAR_STOP_PCS = -33,
+	CMD_ADD_STOP_PC = -49,
+	CMD_RUN_TO_STOP_PC = -65,
+
+	/* Reverse execution. */
+	CMD_REVERSE_CONTINUE = -81,
+	CMD_REVERSE_STEP = -97,
+
+	/* End a waveform trace started by CMD_START_TRACE. */
+	CMD_STOP_TRACE = -113,
 };
 
 enum dbg_reg {
@@ -0,0 +1,1071 @@
+/*
+ * GDB remote serial protocol server.
+ *
+ * The server translates RSP packets into debug protocol commands for a
+ * target, so a register dump ('g') or a bulk load ('X') is a single round
+ * trip for the debugger rather than one request per word.  A thread accepts
+ * connections and flags pending data, the owner of the target calls
+ * gdb_server_poll() to process packets and to check whether a running target
+ * has stopped.  The thread owns the client socket: the poller asks it to
+ * close the connection through an eventfd.  Only one client is supported at a
+ * time.
+ *
+ * Software breakpoints (Z0/Z1) are implemented in the server with bkp
+ * instructions, and memory reads show the original instructions.
+ */
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "gdbstub.h"
+#include "oldland-types.h"
+
+#define GDB_PACKET_SIZE		0x4000
+#define GDB_NR_REGS		17	/* r0-r12, fp, sp, lr, pc */
+#define GDB_PC_REGNUM		16
+#define MAX_BREAKPOINTS		64
+
+/* GDB signal numbers for stop replies. */
+#define GDB_SIGINT		2
+#define GDB_SIGTRAP		5
+
+static const uint32_t bkp_insn = (3 << 30 | OPCODE_BKP << 26);
+
+struct gdb_breakpoint {
+	uint32_t addr;
+	uint32_t orig_instr;
+};
+
+struct gdb_server {
+	const struct gdb_target *target;
+	int sock_fd;
+	int epoll_fd;
+	int close_fd;
+	int client_fd;
+	int pending;
+
+	bool running;
+	bool no_ack;
+	bool mem_written;
+
+	struct gdb_breakpoint bkps[MAX_BREAKPOINTS];
+	unsigned int nr_bkps;
+
+	char *memory_map;
+	char *target_xml;
+
+	char in[GDB_PACKET_SIZE * 2];
+	size_t in_len;
+	char out[GDB_PACKET_SIZE + 8];
+	size_t out_len;
+};
+
+static const char *reg_names[GDB_NR_REGS] = {
+	"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10",
+	"r11", "r12", "fp", "sp", "lr", "pc",
+};
+
+static const char hexchars[] = "0123456789abcdef";
+
+static int cmd(struct gdb_server *s, enum dbg_cmd c, uint32_t addr,
+	       uint32_t wdata, uint32_t *rdata)
+{
+	uint32_t dummy;
+
+	return s->target->command(s->target->priv, c, addr, wdata,
+				  rdata ? rdata : &dummy);
+}
+
+static int fromhex(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static void out_reset(struct gdb_server *s)
+{
+	s->out_len = 0;
+}
+
+static void out_str(struct gdb_server *s, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (s->out_len + len > GDB_PACKET_SIZE)
+		len = GDB_PACKET_SIZE - s->out_len;
+	memcpy(s->out + s->out_len, str, len);
+	s->out_len += len;
+}
+
+static void out_hex8(struct gdb_server *s, uint8_t v)
+{
+	if (s->out_len + 2 > GDB_PACKET_SIZE)
+		return;
+	s->out[s->out_len++] = hexchars[v >> 4];
+	s->out[s->out_len++] = hexchars[v & 0xf];
+}
+
+/* Registers and memory are sent in target (little endian) byte order. */
+static void out_hex32(struct gdb_server *s, uint32_t v)
+{
+	unsigned int i;
+
+	for (i = 0; i < 4; ++i)
+		out_hex8(s, v >> (i * 8));
+}
+
+static void out_binary(struct gdb_server *s, const char *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && s->out_len + 2 <= GDB_PACKET_SIZE; ++i) {
+		char c = data[i];
+
+		if (c == '#' || c == '$' || c == '}' || c == '*') {
+			s->out[s->out_len++] = '}';
+			c ^= 0x20;
+		}
+		s->out[s->out_len++] = c;
+	}
+}
+
+static int parse_hex32(const char *p, size_t len, uint32_t *v)
+{
+	unsigned int i;
+
+	if (len < 8)
+		return -EINVAL;
+
+	*v = 0;
+	for (i = 0; i < 4; ++i) {
+		int hi = fromhex(p[i * 2]), lo = fromhex(p[i * 2 + 1]);
+
+		if (hi < 0 || lo < 0)
+			return -EINVAL;
+		*v |= (uint32_t)(hi << 4 | lo) << (i * 8);
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t bw = write(fd, buf, len);
+
+		if (bw < 0 && errno == EAGAIN) {
+			struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+			poll(&pfd, 1, -1);
+			continue;
+		}
+		if (bw <= 0)
+			return -EIO;
+
+		buf += bw;
+		len -= bw;
+	}
+
+	return 0;
+}
+
+static void send_packet(struct gdb_server *s, const char *data, size_t len)
+{
+	char frame[GDB_PACKET_SIZE + 8];
+	uint8_t csum = 0;
+	size_t i;
+
+	frame[0] = '$';
+	for (i = 0; i < len; ++i)
+		csum += (uint8_t)data[i];
+	memcpy(frame + 1, data, len);
+	frame[len + 1] = '#';
+	frame[len + 2] = hexchars[csum >> 4];
+	frame[len + 3] = hexchars[csum & 0xf];
+
+	if (write_all(s->client_fd, frame, len + 4))
+		warnx("gdb: failed to send packet");
+}
+
+static void reply(struct gdb_server *s, const char *str)
+{
+	send_packet(s, str, strlen(str));
+}
+
+static void reply_out(struct gdb_server *s)
+{
+	send_packet(s, s->out, s->out_len);
+}
+
+static struct gdb_breakpoint *breakpoint_at(struct gdb_server *s,
+					    uint32_t addr)
+{
+	unsigned int n;
+
+	for (n = 0; n < s->nr_bkps; ++n)
+		if (s->bkps[n].addr == addr)
+			return &s->bkps[n];
+
+	return NULL;
+}
+
+static int cache_sync(struct gdb_server *s)
+{
+	int rc = 0;
+
+	if (s->mem_written)
+		rc = cmd(s, CMD_CACHE_SYNC, 0, 0, NULL);
+	if (!rc)
+		s->mem_written = false;
+
+	return rc;
+}
+
+static int insert_breakpoint(struct gdb_server *s, uint32_t addr)
+{
+	struct gdb_breakpoint *bkp;
+
+	if (addr & 0x3)
+		return -EINVAL;
+	if (breakpoint_at(s, addr))
+		return 0;
+	if (s->nr_bkps == MAX_BREAKPOINTS)
+		return -ENOSPC;
+
+	bkp = &s->bkps[s->nr_bkps];
+	if (cmd(s, CMD_RMEM32, addr, 0, &bkp->orig_instr) ||
+	    cmd(s, CMD_WMEM32, addr, bkp_insn, NULL))
+		return -EIO;
+	bkp->addr = addr;
+	s->nr_bkps++;
+	s->mem_written = true;
+
+	return 0;
+}
+
+static int remove_breakpoint(struct gdb_server *s, uint32_t addr)
+{
+	struct gdb_breakpoint *bkp = breakpoint_at(s, addr);
+
+	if (!bkp)
+		return 0;
+
+	if (cmd(s, CMD_WMEM32, addr, bkp->orig_instr, NULL))
+		return -EIO;
+	*bkp = s->bkps[--s->nr_bkps];
+	s->mem_written = true;
+
+	return 0;
+}
+
+static void remove_all_breakpoints(struct gdb_server *s)
+{
+	unsigned int n;
+
+	for (n = 0; n < s->nr_bkps; ++n)
+		cmd(s, CMD_WMEM32, s->bkps[n].addr, s->bkps[n].orig_instr,
+		    NULL);
+	s->nr_bkps = 0;
+	s->mem_written = true;
+	cache_sync(s);
+}
+
+static int read_mem(struct gdb_server *s, uint32_t addr, uint8_t *buf,
+		    size_t len)
+{
+	size_t pos = 0;
+	unsigned int n, i;
+
+	while (pos < len) {
+		uint32_t a = addr + pos, v;
+		size_t width;
+		enum dbg_cmd c;
+
+		if (!(a & 0x3) && len - pos >= 4) {
+			width = 4;
+			c = CMD_RMEM32;
+		} else if (!(a & 0x1) && len - pos >= 2) {
+			width = 2;
+			c = CMD_RMEM16;
+		} else {
+			width = 1;
+			c = CMD_RMEM8;
+		}
+
+		if (cmd(s, c, a, 0, &v))
+			return -EIO;
+		for (i = 0; i < width; ++i)
+			buf[pos++] = v >> (i * 8);
+	}
+
+	/* Show the original instructions rather than our breakpoints. */
+	for (n = 0; n < s->nr_bkps; ++n) {
+		for (i = 0; i < 4; ++i) {
+			uint32_t a = s->bkps[n].addr + i;
+
+			if (a - addr < len)
+				buf[a - addr] = s->bkps[n].orig_instr >> (i * 8);
+		}
+	}
+
+	return 0;
+}
+
+static int write_mem(struct gdb_server *s, uint32_t addr, const uint8_t *buf,
+		     size_t len)
+{
+	size_t pos = 0;
+	unsigned int n;
+
+	while (pos < len) {
+		uint32_t a = addr + pos, v = 0;
+		size_t width, i;
+		enum dbg_cmd c;
+
+		if (!(a & 0x3) && len - pos >= 4) {
+			width = 4;
+			c = CMD_WMEM32;
+		} else if (!(a & 0x1) && len - pos >= 2) {
+			width = 2;
+			c = CMD_WMEM16;
+		} else {
+			width = 1;
+			c = CMD_WMEM8;
+		}
+
+		for (i = 0; i < width; ++i)
+			v |= (uint32_t)buf[pos++] << (i * 8);
+		if (cmd(s, c, a, v, NULL))
+			return -EIO;
+	}
+	s->mem_written = true;
+
+	/* Writes over a breakpoint update the instruction it replaced. */
+	for (n = 0; n < s->nr_bkps; ++n) {
+		struct gdb_breakpoint *bkp = &s->bkps[n];
+
+		if (bkp->addr + 4 <= addr || bkp->addr >= addr + len)
+			continue;
+		if (cmd(s, CMD_RMEM32, bkp->addr, 0, &bkp->orig_instr) ||
+		    cmd(s, CMD_WMEM32, bkp->addr, bkp_insn, NULL))
+			return -EIO;
+	}
+
+	return 0;
+}
+
+static void handle_read_regs(struct gdb_server *s)
+{
+	unsigned int n;
+
+	out_reset(s);
+	for (n = 0; n < GDB_NR_REGS; ++n) {
+		uint32_t v;
+
+		if (cmd(s, CMD_READ_REG, n, 0, &v)) {
+			reply(s, "E01");
+			return;
+		}
+		out_hex32(s, v);
+	}
+	reply_out(s);
+}
+
+static void handle_write_regs(struct gdb_server *s, const char *p,
+			      size_t len)
+{
+	unsigned int n;
+
+	for (n = 0; n < GDB_NR_REGS && len >= 8; ++n, p += 8, len -= 8) {
+		uint32_t v;
+
+		if (parse_hex32(p, len, &v) ||
+		    cmd(s, CMD_WRITE_REG, n, v, NULL)) {
+			reply(s, "E01");
+			return;
+		}
+	}
+
+	reply(s, "OK");
+}
+
+static void handle_read_reg(struct gdb_server *s, const char *p)
+{
+	unsigned long regnum = strtoul(p, NULL, 16);
+	uint32_t v;
+
+	if (regnum >= GDB_NR_REGS || cmd(s, CMD_READ_REG, regnum, 0, &v)) {
+		reply(s, "E01");
+		return;
+	}
+
+	out_reset(s);
+	out_hex32(s, v);
+	reply_out(s);
+}
+
+static void handle_write_reg(struct gdb_server *s, const char *p, size_t len)
+{
+	char *end;
+	unsigned long regnum = strtoul(p, &end, 16);
+	uint32_t v;
+
+	if (*end != '=' || regnum >= GDB_NR_REGS ||
+	    parse_hex32(end + 1, len - (end + 1 - p), &v) ||
+	    cmd(s, CMD_WRITE_REG, regnum, v, NULL))
+		reply(s, "E01");
+	else
+		reply(s, "OK");
+}
+
+static void handle_read_mem(struct gdb_server *s, const char *p)
+{
+	uint8_t buf[GDB_PACKET_SIZE / 2];
+	unsigned int addr, len, i;
+
+	if (sscanf(p, "%x,%x", &addr, &len) != 2) {
+		reply(s, "E01");
+		return;
+	}
+	if (len > sizeof(buf))
+		len = sizeof(buf);
+
+	if (read_mem(s, addr, buf, len)) {
+		reply(s, "E01");
+		return;
+	}
+
+	out_reset(s);
+	for (i = 0; i < len; ++i)
+		out_hex8(s, buf[i]);
+	reply_out(s);
+}
+
+/* 'M' has hex encoded data and 'X' has escaped binary data. */
+static void handle_write_mem(struct gdb_server *s, const char *p, size_t len,
+			     bool binary)
+{
+	uint8_t buf[GDB_PACKET_SIZE];
+	const char *data = memchr(p, ':', len), *end = p + len;
+	unsigned int addr, count;
+	size_t n = 0;
+
+	if (!data || sscanf(p, "%x,%x", &addr, &count) != 2) {
+		reply(s, "E01");
+		return;
+	}
+
+	for (++data; data < end && n < sizeof(buf); ++n) {
+		if (binary) {
+			if (*data == '}' && data + 1 < end) {
+				buf[n] = data[1] ^ 0x20;
+				data += 2;
+			} else {
+				buf[n] = *data++;
+			}
+		} else {
+			int hi, lo;
+
+			if (data + 1 >= end)
+				break;
+			hi = fromhex(data[0]);
+			lo = fromhex(data[1]);
+			if (hi < 0 || lo < 0) {
+				reply(s, "E01");
+				return;
+			}
+			buf[n] = hi << 4 | lo;
+			data += 2;
+		}
+	}
+
+	if (n != count || write_mem(s, addr, buf, n))
+		reply(s, "E01");
+	else
+		reply(s, "OK");
+}
+
+static void handle_breakpoint(struct gdb_server *s, const char *p,
+			      bool insert)
+{
+	unsigned int type, addr;
+	int rc;
+
+	if (sscanf(p, "%x,%x", &type, &addr) != 2) {
+		reply(s, "E01");
+		return;
+	}
+
+	/* Hardware breakpoints are implemented with bkp instructions too. */
+	if (type > 1) {
+		reply(s, "");
+		return;
+	}
+
+	rc = insert ? insert_breakpoint(s, addr) : remove_breakpoint(s, addr);
+	reply(s, rc ? "E01" : "OK");
+}
+
+static void send_stop(struct gdb_server *s, int signal)
+{
+	char buf[4];
+
+	snprintf(buf, sizeof(buf), "S%02x", signal);
+	reply(s, buf);
+}
+
+/*
+ * Resuming from a breakpoint executes the original instruction first,
+ * exactly as oldland-debug does.
+ */
+static void resume(struct gdb_server *s, bool step)
+{
+	struct gdb_breakpoint *bkp;
+	uint32_t pc;
+
+	if (cache_sync(s) || cmd(s, CMD_READ_REG, GDB_PC_REGNUM, 0, &pc)) {
+		reply(s, "E01");
+		return;
+	}
+
+	bkp = breakpoint_at(s, pc);
+	if (bkp) {
+		if (cmd(s, CMD_WMEM32, bkp->addr, bkp->orig_instr, NULL) ||
+		    cmd(s, CMD_CACHE_SYNC, 0, 0, NULL) ||
+		    cmd(s, CMD_STEP, 0, 0, NULL) ||
+		    cmd(s, CMD_WMEM32, bkp->addr, bkp_insn, NULL) ||
+		    cmd(s, CMD_CACHE_SYNC, 0, 0, NULL)) {
+			reply(s, "E01");
+			return;
+		}
+		if (step) {
+			send_stop(s, GDB_SIGTRAP);
+			return;
+		}
+	} else if (step) {
+		if (cmd(s, CMD_STEP, 0, 0, NULL))
+			reply(s, "E01");
+		else
+			send_stop(s, GDB_SIGTRAP);
+		return;
+	}
+
+	if (cmd(s, CMD_RUN, 0, 0, NULL))
+		reply(s, "E01");
+	else
+		s->running = true;
+}
+
+static void reverse(struct gdb_server *s, enum dbg_cmd c)
+{
+	if (!s->target->reversible) {
+		reply(s, "");
+		return;
+	}
+
+	if (cache_sync(s) || cmd(s, c, 0, 0, NULL))
+		reply(s, "E01");
+	else
+		send_stop(s, GDB_SIGTRAP);
+}
+
+static void handle_vcont(struct gdb_server *s, const char *p)
+{
+	if (!strcmp(p, "?")) {
+		reply(s, "vCont;c;C;s;S;t");
+		return;
+	}
+
+	/*
+	 * There is a single thread so only the first action matters, the
+	 * signal of a C/S action is ignored.
+	 */
+	if (*p++ != ';') {
+		reply(s, "");
+		return;
+	}
+
+	switch (*p) {
+	case 'c':
+	case 'C':
+		resume(s, false);
+		break;
+	case 's':
+	case 'S':
+		resume(s, true);
+		break;
+	case 't':
+		cmd(s, CMD_STOP, 0, 0, NULL);
+		send_stop(s, GDB_SIGINT);
+		break;
+	default:
+		reply(s, "");
+	}
+}
+
+static void handle_xfer(struct gdb_server *s, const char *doc,
+			const char *p)
+{
+	unsigned int offs, len;
+	size_t doc_len = strlen(doc);
+
+	if (sscanf(p, "%x,%x", &offs, &len) != 2) {
+		reply(s, "E01");
+		return;
+	}
+
+	out_reset(s);
+	if (offs >= doc_len) {
+		out_str(s, "l");
+	} else {
+		if (len > doc_len - offs)
+			len = doc_len - offs;
+		if (len > GDB_PACKET_SIZE / 2)
+			len = GDB_PACKET_SIZE / 2;
+		out_str(s, offs + len == doc_len ? "l" : "m");
+		out_binary(s, doc + offs, len);
+	}
+	reply_out(s);
+}
+
+static void handle_query(struct gdb_server *s, const char *p)
+{
+	if (!strncmp(p, "qSupported", 10)) {
+		char buf[256];
+
+		snprintf(buf, sizeof(buf),
+			 "PacketSize=%x;qXfer:memory-map:read+;"
+			 "qXfer:features:read+;QStartNoAckMode+;"
+			 "vContSupported+%s", GDB_PACKET_SIZE,
+			 s->target->reversible ?
+			 ";ReverseStep+;ReverseContinue+" : "");
+		reply(s, buf);
+	} else if (!strncmp(p, "qXfer:memory-map:read::", 23)) {
+		handle_xfer(s, s->memory_map, p + 23);
+	} else if (!strncmp(p, "qXfer:features:read:target.xml:", 31)) {
+		handle_xfer(s, s->target_xml, p + 31);
+	} else if (!strcmp(p, "qAttached")) {
+		reply(s, "1");
+	} else if (!strcmp(p, "qC")) {
+		reply(s, "QC1");
+	} else if (!strcmp(p, "qfThreadInfo")) {
+		reply(s, "m1");
+	} else if (!strcmp(p, "qsThreadInfo")) {
+		reply(s, "l");
+	} else {
+		reply(s, "");
+	}
+}
+
+/* Stop using the client and wake the server thread to close it. */
+static void close_client(struct gdb_server *s)
+{
+	uint64_t one = 1;
+
+	s->running = false;
+	s->no_ack = false;
+	s->in_len = 0;
+	s->client_fd = -1;
+
+	if (write(s->close_fd, &one, sizeof(one)) != sizeof(one))
+		warn("gdb: failed to wake server thread");
+}
+
+/* Returns true if the client connection should be closed. */
+static bool handle_packet(struct gdb_server *s, char *p, size_t len)
+{
+	p[len] = '\0';
+
+	switch (p[0]) {
+	case '?':
+		/* GDB expects the target to be stopped when it attaches. */
+		cmd(s, CMD_STOP, 0, 0, NULL);
+		s->running = false;
+		send_stop(s, GDB_SIGTRAP);
+		break;
+	case 'g':
+		handle_read_regs(s);
+		break;
+	case 'G':
+		handle_write_regs(s, p + 1, len - 1);
+		break;
+	case 'p':
+		handle_read_reg(s, p + 1);
+		break;
+	case 'P':
+		handle_write_reg(s, p + 1, len - 1);
+		break;
+	case 'm':
+		handle_read_mem(s, p + 1);
+		break;
+	case 'M':
+		handle_write_mem(s, p + 1, len - 1, false);
+		break;
+	case 'X':
+		handle_write_mem(s, p + 1, len - 1, true);
+		break;
+	case 'c':
+		resume(s, false);
+		break;
+	case 's':
+		resume(s, true);
+		break;
+	case 'b':
+		if (p[1] == 's')
+			reverse(s, CMD_REVERSE_STEP);
+		else if (p[1] == 'c')
+			reverse(s, CMD_REVERSE_CONTINUE);
+		else
+			reply(s, "");
+		break;
+	case 'Z':
+	case 'z':
+		handle_breakpoint(s, p + 1, p[0] == 'Z');
+		break;
+	case 'v':
+		if (!strncmp(p, "vCont", 5))
+			handle_vcont(s, p + 5);
+		else
+			reply(s, "");
+		break;
+	case 'q':
+		handle_query(s, p);
+		break;
+	case 'Q':
+		if (!strcmp(p, "QStartNoAckMode")) {
+			reply(s, "OK");
+			s->no_ack = true;
+		} else {
+			reply(s, "");
+		}
+		break;
+	case 'H':
+	case 'T':
+		reply(s, "OK");
+		break;
+	case 'D':
+		remove_all_breakpoints(s);
+		cmd(s, CMD_RUN, 0, 0, NULL);
+		reply(s, "OK");
+		return true;
+	case 'k':
+		remove_all_breakpoints(s);
+		return true;
+	default:
+		reply(s, "");
+	}
+
+	return false;
+}
+
+/* Returns true if the client connection should be closed. */
+static bool process_input(struct gdb_server *s)
+{
+	size_t pos = 0;
+	bool done = false;
+
+	while (pos < s->in_len && !done) {
+		char *start = s->in + pos, *hash;
+		size_t remain = s->in_len - pos, len, i;
+		uint8_t csum = 0;
+
+		if (*start == '\x03') {
+			if (s->running) {
+				cmd(s, CMD_STOP, 0, 0, NULL);
+				s->running = false;
+				send_stop(s, GDB_SIGINT);
+			}
+			++pos;
+			continue;
+		}
+
+		if (*start != '$') {
+			/* Acks and line noise. */
+			++pos;
+			continue;
+		}
+
+		hash = memchr(start, '#', remain);
+		if (!hash || hash + 3 > start + remain)
+			break;
+
+		len = hash - start - 1;
+		for (i = 0; i < len; ++i)
+			csum += (uint8_t)start[i + 1];
+
+		pos += len + 4;
+		if (fromhex(hash[1]) << 4 != (csum & 0xf0) ||
+		    fromhex(hash[2]) != (csum & 0x0f)) {
+			if (!s->no_ack)
+				write_all(s->client_fd, "-", 1);
+			continue;
+		}
+
+		if (!s->no_ack && write_all(s->client_fd, "+", 1))
+			return true;
+		done = handle_packet(s, start + 1, len);
+	}
+
+	memmove(s->in, s->in + pos, s->in_len - pos);
+	s->in_len -= pos;
+
+	/* A packet that doesn't fit in the buffer can't be handled. */
+	if (s->in_len == sizeof(s->in) - 1)
+		s->in_len = 0;
+
+	return done;
+}
+
+static void read_client(struct gdb_server *s)
+{
+	for (;;) {
+		ssize_t br = read(s->client_fd, s->in + s->in_len,
+				  sizeof(s->in) - 1 - s->in_len);
+
+		if (br < 0 && errno == EAGAIN)
+			return;
+		if (br <= 0) {
+			remove_all_breakpoints(s);
+			close_client(s);
+			return;
+		}
+
+		s->in_len += br;
+		if (process_input(s)) {
+			close_client(s);
+			return;
+		}
+	}
+}
+
+static bool target_stopped(struct gdb_server *s)
+{
+	uint32_t status;
+
+	if (cmd(s, CMD_GET_EXEC_STATUS, 0, 0, &status))
+		return false;
+
+	return !(status & EXEC_STATUS_RUNNING);
+}
+
+/*
+ * Process any pending packets and report a stop if the target was running.
+ * Returns non-zero if there was any activity.
+ */
+int gdb_server_poll(struct gdb_server *s)
+{
+	int active = 0;
+
+	if (__sync_val_compare_and_swap(&s->pending, 1, 0)) {
+		if (s->client_fd >= 0)
+			read_client(s);
+		active = 1;
+	}
+
+	if (s->running && target_stopped(s)) {
+		s->running = false;
+		send_stop(s, GDB_SIGTRAP);
+		active = 1;
+	}
+
+	return active;
+}
+
+static void *server_thread(void *d)
+{
+	struct gdb_server *s = d;
+
+	for (;;) {
+		struct epoll_event event = {
+			.events = EPOLLIN | EPOLLRDHUP | EPOLLET,
+		};
+		int client = accept4(s->sock_fd, NULL, NULL, SOCK_NONBLOCK);
+
+		if (client < 0)
+			continue;
+
+		event.data.fd = client;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, client, &event)) {
+			warn("gdb: failed to add client to epoll (%d)", client);
+			close(client);
+			continue;
+		}
+
+		s->client_fd = client;
+
+		/*
+		 * Flag input and hangups for the poller until it has finished
+		 * with the connection.
+		 */
+		for (;;) {
+			struct epoll_event revent;
+			uint64_t count;
+			int nevents;
+
+			nevents = epoll_wait(s->epoll_fd, &revent, 1, -1);
+			if (nevents < 0 && errno == EINTR)
+				continue;
+			if (nevents < 0)
+				err(1, "epoll_wait() failed");
+
+			if (revent.data.fd == s->close_fd) {
+				if (read(s->close_fd, &count, sizeof(count)) < 0)
+					warn("gdb: failed to read close event");
+				break;
+			}
+
+			__sync_val_compare_and_swap(&s->pending, 0, 1);
+		}
+
+		epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, client, NULL);
+		shutdown(client, SHUT_RDWR);
+		close(client);
+	}
+
+	return NULL;
+}
+
+static void enable_reuseaddr(int fd)
+{
+	int val = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)))
+		err(1, "failed to enable SO_REUSEADDR");
+}
+
+static int spawn_server(const char *port)
+{
+	struct addrinfo *result, *rp, hints = {
+		.ai_family	= AF_INET,
+		.ai_socktype	= SOCK_STREAM,
+		.ai_flags	= AI_PASSIVE,
+	};
+	int s, fd;
+
+	s = getaddrinfo(NULL, port, &hints, &result);
+	if (s)
+		err(1, "getaddrinfo failed");
+
+	for (rp = result; rp; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		enable_reuseaddr(fd);
+
+		if (!bind(fd, rp->ai_addr, rp->ai_addrlen))
+			break;
+
+		close(fd);
+	}
+
+	if (!rp)
+		err(1, "failed to bind gdb server");
+
+	freeaddrinfo(result);
+
+	if (listen(fd, 1))
+		err(1, "failed to listen on socket");
+
+	return fd;
+}
+
+static char *build_memory_map(const struct gdb_target *target)
+{
+	char *map = NULL;
+	size_t len;
+	FILE *f = open_memstream(&map, &len);
+	size_t n;
+
+	if (!f)
+		err(1, "failed to allocate memory map");
+
+	fprintf(f, "<?xml version=\"1.0\"?>\n"
+		"<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" "
+		"\"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+		"<memory-map>\n");
+	for (n = 0; n < target->nr_regions; ++n)
+		fprintf(f, "<memory type=\"%s\" start=\"0x%x\" length=\"0x%x\"/>\n",
+			target->regions[n].type == GDB_MEM_ROM ? "rom" : "ram",
+			target->regions[n].start, target->regions[n].length);
+	fprintf(f, "</memory-map>\n");
+	fclose(f);
+
+	return map;
+}
+
+static char *build_target_xml(void)
+{
+	char *xml = NULL;
+	size_t len;
+	FILE *f = open_memstream(&xml, &len);
+	unsigned int n;
+
+	if (!f)
+		err(1, "failed to allocate target description");
+
+	fprintf(f, "<?xml version=\"1.0\"?>\n"
+		"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+		"<target version=\"1.0\">\n"
+		"<feature name=\"org.gnu.gdb.oldland.core\">\n");
+	for (n = 0; n < GDB_NR_REGS; ++n)
+		fprintf(f, "<reg name=\"%s\" bitsize=\"32\" regnum=\"%u\"%s/>\n",
+			reg_names[n], n,
+			n == GDB_PC_REGNUM ? " type=\"code_ptr\"" :
+			n == 13 || n == 14 ? " type=\"data_ptr\"" : "");
+	fprintf(f, "</feature>\n</target>\n");
+	fclose(f);
+
+	return xml;
+}
+
+struct gdb_server *gdb_server_new(const char *port,
+				  const struct gdb_target *target)
+{
+	struct epoll_event close_event = {
+		.events = EPOLLIN,
+	};
+	pthread_t thread;
+	struct gdb_server *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		err(1, "failed to allocate gdb server");
+
+	s->target = target;
+	s->client_fd = -1;
+	s->memory_map = build_memory_map(target);
+	s->target_xml = build_target_xml();
+	s->sock_fd = spawn_server(port);
+	s->epoll_fd = epoll_create(1);
+	if (s->epoll_fd < 0)
+		err(1, "failed to create epoll fd");
+	s->close_fd = eventfd(0, 0);
+	if (s->close_fd < 0)
+		err(1, "failed to create gdb close eventfd");
+	close_event.data.fd = s->close_fd;
+	if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->close_fd, &close_event))
+		err(1, "failed to add gdb close eventfd to epoll");
+
+	if (pthread_create(&thread, NULL, server_thread, s))
+		err(1, "failed to spawn gdb server thread");
+
+	return s;
+}
@@ -0,0 +1,50 @@
+#ifndef __GDBSTUB_H__
+#define __GDBSTUB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../debugger/protocol.h"
+
+enum gdb_mem_type {
+	GDB_MEM_RAM,
+	GDB_MEM_ROM,
+};
+
+struct gdb_mem_region {
+	enum gdb_mem_type type;
+	uint32_t start;
+	uint32_t length;
+};
+
+/*
+ * A target is driven with the same commands that oldland-debug sends over
+ * the debug protocol, so the simulator and oldland-jtagd only need to
+ * provide a way to execute a single command.
+ */
+struct gdb_target {
+	int (*command)(void *priv, enum dbg_cmd cmd, uint32_t addr,
+		       uint32_t wdata, uint32_t *rdata);
+	void *priv;
+	const struct gdb_mem_region *regions;
+	size_t nr_regions;
+	/* Supports CMD_REVERSE_STEP and CMD_REVERSE_CONTINUE. */
+	bool reversible;
+};
+
+struct gdb_server;
+
+struct gdb_server *gdb_server_new(const char *port,
+				  const struct gdb_target *target);
+int gdb_server_poll(struct gdb_server *s);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* __GDBSTUB_H__ */
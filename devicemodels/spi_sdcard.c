@@ -6,14 +6,22 @@
  * - master sends ACMD41 until card is ready.
  * - master sends CMD58 to get CCS.
  *
- * The master can then set the block length and perform single block reads.
+ * The master can then set the block length and perform block reads and
+ * writes.
  *
  * Supported features:
  * - reset
- * - single block read
- * - crc validation
+ * - single and multiple block reads (CMD17, CMD18 + CMD12)
+ * - single and multiple block writes (CMD24, CMD25) with data response tokens
+ * - high speed function switch (CMD6)
  * - set blocklen
  *
+ * Addresses are byte addresses.  By default writes are kept in memory and the
+ * image is left untouched, spi_sdcard_open() can instead write through to the
+ * image or to an overlay file.  The overlay holds a copy of each 512 byte
+ * sector that has been written followed by a bitmap of those sectors, so the
+ * base image is never modified and the overlay stays sparse.
+ *
  * The SD spec
  * (http://users.ece.utexas.edu/~valvano/EE345M/SD_Physical_Layer_Spec.pdf)
  * has a habit of not using names for commands and bit fields etc.  So we have
@@ -21,6 +29,7 @@
  */
 #define _GNU_SOURCE
 #include <assert.h>
+#include <err.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -29,14 +38,27 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "spi_sdcard.h"
 
 #define DATA_BUF_SIZE 1024
+#define SECTOR_SIZE 512
+#define MAX_BLOCKLEN 512
+/* Bytes of busy signalling after a block has been written. */
+#define WRITE_BUSY_BYTES 2
 
 #define IN_IDLE_STATE (1 << 0)
 #define ILLEGAL_COMMAND (1 << 2)
+#define ADDRESS_ERROR (1 << 5)
+#define PARAMETER_ERROR (1 << 6)
 #define CARD_HIGH_CAPACITY (1 << 6)
 #define DATA_START_TOKEN 0xfe
+#define MULTI_WRITE_START_TOKEN 0xfc
+#define STOP_TRAN_TOKEN 0xfd
+#define DATA_ACCEPTED 0x05
+#define DATA_WRITE_ERROR 0x0d
 
 #ifdef DEBUG
 #define debug printf
@@ -51,6 +73,13 @@ static inline void __attribute__((format(printf,1,2)))
 enum card_state {
 	STATE_READING_COMMAND,
 	STATE_RESPONSE,
+	/* Sending data blocks until the master sends CMD12. */
+	STATE_READ_MULTIPLE,
+	/* Waiting for a start token or, for CMD25, a stop token. */
+	STATE_WRITE_WAIT_TOKEN,
+	STATE_WRITE_DATA,
+	/* Sending the data response token followed by busy. */
+	STATE_WRITE_RESPONSE,
 };
 
 struct spi_command {
@@ -60,11 +89,19 @@ struct spi_command {
 };
 
 struct spi_sdcard {
-	int fd;
+	/* The image is mapped so that block reads are a copy. */
+	uint8_t *image;
+	size_t image_size;
+	/* Overlay data and the bitmap of sectors that it holds. */
+	uint8_t *overlay;
+	uint8_t *overlay_map;
 	union {
 		struct spi_command current_cmd;
 		uint8_t cmd_buf[sizeof(struct spi_command)];
 	};
+	/* A command received while sending blocks for CMD18. */
+	uint8_t stop_buf[sizeof(struct spi_command)];
+	unsigned int stop_len;
 	char data_buf[DATA_BUF_SIZE];
 	unsigned int num_bytes_rx;
 	unsigned int num_bytes_tx;
@@ -74,9 +111,62 @@ struct spi_sdcard {
 	size_t blocklen;
 	size_t msg_len;
 	int ncr_delay;
+	uint32_t data_address;
+	bool multi_block;
+	bool write_error;
+	unsigned int busy_count;
+	bool high_speed;
 };
 
-struct spi_sdcard *spi_sdcard_new(const char *path)
+static uint8_t *map_file(const char *path, bool shared, size_t *size)
+{
+	struct stat st;
+	uint8_t *p = NULL;
+	int fd = open(path, shared ? O_RDWR : O_RDONLY);
+
+	if (fd < 0)
+		err(1, "failed to open %s", path);
+	if (fstat(fd, &st))
+		err(1, "failed to stat %s", path);
+	*size = st.st_size;
+	if (*size) {
+		p = mmap(NULL, *size, PROT_READ | PROT_WRITE,
+			 shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			err(1, "failed to map %s", path);
+	}
+	close(fd);
+
+	return p;
+}
+
+static size_t overlay_map_size(size_t image_size)
+{
+	size_t nr_sectors = (image_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+	return (nr_sectors + 7) / 8;
+}
+
+static void open_overlay(struct spi_sdcard *card, const char *path)
+{
+	size_t len = card->image_size + overlay_map_size(card->image_size);
+	size_t size;
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	/* A new overlay is sparse, so untouched sectors use no space. */
+	if (fd < 0)
+		err(1, "failed to open overlay %s", path);
+	if (ftruncate(fd, len))
+		err(1, "failed to size overlay %s", path);
+	close(fd);
+
+	card->overlay = map_file(path, true, &size);
+	assert(size == len);
+	card->overlay_map = card->overlay + card->image_size;
+}
+
+struct spi_sdcard *spi_sdcard_open(const char *path, const char *overlay,
+				   unsigned int flags)
 {
 	struct spi_sdcard *card;
 
@@ -85,12 +175,74 @@ struct spi_sdcard *spi_sdcard_new(const char *path)
 	card->state = STATE_READING_COMMAND;
 	card->ncr_delay = 1;
 
-	card->fd = open(path, O_RDONLY);
-	assert(card->fd >= 0);
+	card->image = map_file(path, !overlay && (flags & SPI_SDCARD_WRITABLE),
+			       &card->image_size);
+	if (overlay)
+		open_overlay(card, overlay);
 
 	return card;
 }
 
+struct spi_sdcard *spi_sdcard_new(const char *path)
+{
+	return spi_sdcard_open(path, NULL, 0);
+}
+
+static bool in_overlay(const struct spi_sdcard *sd, size_t sector)
+{
+	return sd->overlay && (sd->overlay_map[sector / 8] & (1 << (sector % 8)));
+}
+
+static bool range_valid(const struct spi_sdcard *sd, uint32_t addr,
+			size_t len)
+{
+	return (size_t)addr + len <= sd->image_size;
+}
+
+static void image_read(const struct spi_sdcard *sd, uint32_t addr,
+		       void *dst, size_t len)
+{
+	while (len) {
+		size_t sector = addr / SECTOR_SIZE;
+		size_t n = SECTOR_SIZE - addr % SECTOR_SIZE;
+		const uint8_t *src = in_overlay(sd, sector) ?
+			sd->overlay : sd->image;
+
+		if (n > len)
+			n = len;
+		memcpy(dst, src + addr, n);
+		dst += n;
+		addr += n;
+		len -= n;
+	}
+}
+
+static void image_write(struct spi_sdcard *sd, uint32_t addr,
+			const void *src, size_t len)
+{
+	while (len) {
+		size_t sector = addr / SECTOR_SIZE;
+		size_t n = SECTOR_SIZE - addr % SECTOR_SIZE;
+		uint8_t *dst = sd->overlay ? sd->overlay : sd->image;
+
+		if (sd->overlay && !in_overlay(sd, sector)) {
+			size_t start = sector * SECTOR_SIZE;
+			size_t copy = sd->image_size - start < SECTOR_SIZE ?
+				sd->image_size - start : SECTOR_SIZE;
+
+			memcpy(sd->overlay + start, sd->image + start, copy);
+			sd->overlay_map[sector / 8] |= 1 << (sector % 8);
+		}
+
+		if (n > len)
+			n = len;
+		memcpy(dst + addr, src, n);
+		src += n;
+		addr += n;
+		len -= n;
+	}
+}
+
 static inline bool command_is_complete(const struct spi_sdcard *sd)
 {
 	return sd->num_bytes_rx == sizeof(sd->current_cmd);
@@ -126,10 +278,51 @@ static void set_next_state(struct spi_sdcard *sd)
 	}
 }
 
-void spi_sdcard_next_byte_to_slave(struct spi_sdcard *sd, uint8_t v)
+enum sd_cmds {
+	/* Normal commands. */
+	GO_IDLE_STATE = 0,
+	SEND_OP_COND = 1,
+	SWITCH_FUNC = 6,
+	SEND_IF_COND = 8,
+	SEND_CSD = 9,
+	SEND_CID = 10,
+	STOP_TRANSMISSION = 12,
+	SEND_STATUS = 13,
+	SET_BLOCKLEN = 16,
+	READ_SINGLE_BLOCK = 17,
+	READ_MULTIPLE_BLOCK = 18,
+	WRITE_BLOCK = 24,
+	WRITE_MULTIPLE_BLOCK = 25,
+	APP_CMD = 55,
+	READ_OCR = 58,
+	/* Application commands. */
+	SD_SEND_OP_COND = 41,
+};
+
+/*
+ * While sending blocks for CMD18 the master's bytes are only checked for a
+ * CMD12 to stop the transfer.
+ */
+static void read_stop_command(struct spi_sdcard *sd, uint8_t v)
 {
-	read_data(sd, v);
-	set_next_state(sd);
+	if (sd->stop_len == 0 && (v & 0xc0) != 0x40)
+		return;
+
+	sd->stop_buf[sd->stop_len++] = v;
+	if (sd->stop_len < sizeof(sd->stop_buf))
+		return;
+
+	sd->stop_len = 0;
+	if ((sd->stop_buf[0] & 0x3f) != STOP_TRANSMISSION)
+		return;
+
+	debug("+ received CMD12\n");
+	memcpy(sd->cmd_buf, sd->stop_buf, sizeof(sd->cmd_buf));
+	sd->multi_block = false;
+	sd->state = STATE_RESPONSE;
+	sd->num_bytes_tx = 0;
+	sd->num_bytes_rx = sizeof(sd->current_cmd);
+	sd->ncr_delay = 1;
 }
 
 static void finish_command(struct spi_sdcard *sd)
@@ -140,6 +333,84 @@ static void finish_command(struct spi_sdcard *sd)
 	sd->ncr_delay = 1;
 }
 
+static void write_token(struct spi_sdcard *sd, uint8_t v)
+{
+	if (v == DATA_START_TOKEN ||
+	    (sd->multi_block && v == MULTI_WRITE_START_TOKEN)) {
+		sd->state = STATE_WRITE_DATA;
+		sd->num_bytes_rx = 0;
+	} else if (sd->multi_block && v == STOP_TRAN_TOKEN) {
+		debug("+ stop tran\n");
+		sd->multi_block = false;
+		sd->state = STATE_WRITE_RESPONSE;
+		/* No data response token, just busy. */
+		sd->num_bytes_tx = 1;
+		sd->busy_count = WRITE_BUSY_BYTES;
+	}
+}
+
+static void write_data(struct spi_sdcard *sd, uint8_t v)
+{
+	sd->data_buf[sd->num_bytes_rx++] = v;
+
+	/* The data block is followed by a CRC16 which isn't checked. */
+	if (sd->num_bytes_rx < sd->blocklen + 2)
+		return;
+
+	sd->write_error = !range_valid(sd, sd->data_address, sd->blocklen);
+	debug("+ write to %08x%s\n", sd->data_address,
+	      sd->write_error ? " (out of range)" : "");
+	if (!sd->write_error)
+		image_write(sd, sd->data_address, sd->data_buf, sd->blocklen);
+	sd->data_address += sd->blocklen;
+
+	sd->state = STATE_WRITE_RESPONSE;
+	sd->num_bytes_tx = 0;
+	sd->busy_count = WRITE_BUSY_BYTES;
+}
+
+void spi_sdcard_next_byte_to_slave(struct spi_sdcard *sd, uint8_t v)
+{
+	switch (sd->state) {
+	case STATE_READ_MULTIPLE:
+		read_stop_command(sd, v);
+		return;
+	case STATE_WRITE_WAIT_TOKEN:
+		write_token(sd, v);
+		return;
+	case STATE_WRITE_DATA:
+		write_data(sd, v);
+		return;
+	case STATE_WRITE_RESPONSE:
+		return;
+	default:
+		break;
+	}
+
+	read_data(sd, v);
+	set_next_state(sd);
+}
+
+static uint8_t write_response_byte(struct spi_sdcard *sd)
+{
+	if (sd->num_bytes_tx++ == 0)
+		return sd->write_error ? DATA_WRITE_ERROR : DATA_ACCEPTED;
+
+	if (sd->busy_count) {
+		--sd->busy_count;
+		return 0;
+	}
+
+	if (sd->multi_block && !sd->write_error) {
+		sd->state = STATE_WRITE_WAIT_TOKEN;
+	} else {
+		sd->multi_block = false;
+		finish_command(sd);
+	}
+
+	return 0xff;
+}
+
 struct r7 {
 	uint8_t bytes[5];
 };
@@ -181,52 +452,113 @@ static void do_cmd58(struct spi_sdcard *sd)
 	memcpy(sd->data_buf, &r3, sizeof(r3));
 }
 
-enum sd_cmds {
-	/* Normal commands. */
-	GO_IDLE_STATE = 0,
-	SEND_OP_COND = 1,
-	SEND_IF_COND = 8,
-	SEND_CSD = 9,
-	SEND_CID = 10,
-	SEND_STATUS = 13,
-	SET_BLOCKLEN = 16,
-	READ_SINGLE_BLOCK = 17,
-	APP_CMD = 55,
-	READ_OCR = 58,
-	/* Application commands. */
-	SD_SEND_OP_COND = 41,
-};
+static uint32_t command_argument(const struct spi_sdcard *sd)
+{
+	return (sd->current_cmd.argument[0] << 24) |
+	       (sd->current_cmd.argument[1] << 16) |
+	       (sd->current_cmd.argument[2] << 8) |
+	       (sd->current_cmd.argument[3] << 0);
+}
 
-static void do_set_blocklen(struct spi_sdcard *sd)
+static uint8_t do_set_blocklen(struct spi_sdcard *sd)
 {
-	uint32_t blocklen = (sd->current_cmd.argument[0] << 24) |
-			    (sd->current_cmd.argument[1] << 16) |
-			    (sd->current_cmd.argument[2] << 8) |
-			    (sd->current_cmd.argument[3] << 0);
+	uint32_t blocklen = command_argument(sd);
 
-	assert(sd->blocklen < sizeof(sd->data_buf) - 16);
 	debug("+ set blocklen=%u\n", blocklen);
+	if (blocklen == 0 || blocklen > MAX_BLOCKLEN)
+		return PARAMETER_ERROR;
 	sd->blocklen = blocklen;
+
+	return 0;
+}
+
+/* A data block is a start token, the data and a CRC16. */
+static void add_data_block(struct spi_sdcard *sd)
+{
+	sd->data_buf[sd->msg_len++] = DATA_START_TOKEN; /* data start token. */
+	image_read(sd, sd->data_address, sd->data_buf + sd->msg_len,
+		   sd->blocklen);
+	sd->msg_len += sd->blocklen;
+	sd->data_address += sd->blocklen;
+
+	/* CRC16 */
+	sd->data_buf[sd->msg_len++] = 0xde;
+	sd->data_buf[sd->msg_len++] = 0xad;
 }
 
 static void do_block_read(struct spi_sdcard *sd)
 {
-	uint32_t data_address = (sd->current_cmd.argument[0] << 24) |
-				(sd->current_cmd.argument[1] << 16) |
-				(sd->current_cmd.argument[2] << 8) |
-				(sd->current_cmd.argument[3] << 0);
-	ssize_t br;
+	sd->data_address = command_argument(sd);
+	debug("+ read from %08x\n", sd->data_address);
 
-	debug("+ read from %08x\n", data_address);
+	sd->msg_len = 0;
+	if (!range_valid(sd, sd->data_address, sd->blocklen)) {
+		sd->data_buf[sd->msg_len++] = ADDRESS_ERROR; /* r1 response. */
+		sd->multi_block = false;
+		return;
+	}
+
+	sd->data_buf[sd->msg_len++] = 0; /* r1 response. */
+	add_data_block(sd);
+}
+
+/*
+ * The next block of a multiple block read, there is a byte of Nac before the
+ * start token.  Past the end of the card the master only sees idle bytes
+ * until it stops the transfer.
+ */
+static void do_next_block_read(struct spi_sdcard *sd)
+{
+	sd->msg_len = 0;
+	sd->data_buf[sd->msg_len++] = 0xff;
+	if (range_valid(sd, sd->data_address, sd->blocklen))
+		add_data_block(sd);
+	sd->num_bytes_tx = 0;
+}
+
+static uint8_t do_write_start(struct spi_sdcard *sd, bool multi_block)
+{
+	sd->data_address = command_argument(sd);
+	debug("+ write%s from %08x\n", multi_block ? " multiple" : "",
+	      sd->data_address);
+
+	if (!range_valid(sd, sd->data_address, sd->blocklen)) {
+		finish_command(sd);
+		return ADDRESS_ERROR;
+	}
+
+	sd->multi_block = multi_block;
+	sd->state = STATE_WRITE_WAIT_TOKEN;
+
+	return 0;
+}
+
+/*
+ * CMD6 returns a 512 bit switch function status.  Only the high speed access
+ * mode in function group 1 is supported, and switching is immediate.
+ */
+static void do_switch_func(struct spi_sdcard *sd)
+{
+	uint32_t arg = command_argument(sd);
+	bool set = arg & (1U << 31);
+	unsigned int group1 = arg & 0xf;
+	uint8_t *status;
 
 	sd->msg_len = 0;
 	sd->data_buf[sd->msg_len++] = 0; /* r1 response. */
-	sd->data_buf[sd->msg_len++] = DATA_START_TOKEN; /* data start token. */
-	br = pread(sd->fd, sd->data_buf + sd->msg_len, sd->blocklen, data_address);
-	assert(br == sd->blocklen);
-	sd->msg_len += br;
+	sd->data_buf[sd->msg_len++] = DATA_START_TOKEN;
+	status = (uint8_t *)sd->data_buf + sd->msg_len;
+	memset(status, 0, 64);
+
+	status[1] = 100;	/* Maximum current, mA. */
+	status[13] = 0x03;	/* Group 1 supports default and high speed. */
+	if (group1 == 0xf)
+		group1 = sd->high_speed;
+	status[16] = group1 <= 1 ? group1 : 0xf;
+	if (set && group1 <= 1)
+		sd->high_speed = group1;
+	sd->msg_len += 64;
 
-	/* CRC16 */
 	sd->data_buf[sd->msg_len++] = 0xde;
 	sd->data_buf[sd->msg_len++] = 0xad;
 }
@@ -279,6 +611,20 @@ uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd)
 {
 	uint8_t v = 0xff;
 
+	switch (sd->state) {
+	case STATE_READ_MULTIPLE:
+		if (sd->num_bytes_tx == sd->msg_len)
+			do_next_block_read(sd);
+		return sd->data_buf[sd->num_bytes_tx++];
+	case STATE_WRITE_WAIT_TOKEN:
+	case STATE_WRITE_DATA:
+		return 0xff;
+	case STATE_WRITE_RESPONSE:
+		return write_response_byte(sd);
+	default:
+		break;
+	}
+
 	if (sd->state == STATE_RESPONSE && sd->ncr_delay != 0) {
 		v = 0xff;
 	} else if (sd->state == STATE_RESPONSE && !sd->next_cmd_is_acmd) {
@@ -293,6 +639,13 @@ uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd)
 			v = reset_complete(sd) ? 0 : IN_IDLE_STATE;
 			finish_command(sd);
 			break;
+		case SWITCH_FUNC:
+			if (sd->num_bytes_tx == 0)
+				do_switch_func(sd);
+			v = sd->data_buf[sd->num_bytes_tx];
+			if (sd->num_bytes_tx == sd->msg_len - 1)
+				finish_command(sd);
+			break;
 		case SEND_IF_COND:
 			/* CMD8 sends an R7 response. */
 			do_cmd8(sd);
@@ -323,11 +676,15 @@ uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd)
 			if (sd->num_bytes_tx == sd->msg_len - 1)
 				finish_command(sd);
 			break;
-		case SET_BLOCKLEN:
-			do_set_blocklen(sd);
+		case STOP_TRANSMISSION:
+			/* Outside of a CMD18 transfer this is a no-op. */
 			v = 0;
 			finish_command(sd);
 			break;
+		case SET_BLOCKLEN:
+			v = do_set_blocklen(sd);
+			finish_command(sd);
+			break;
 		case READ_SINGLE_BLOCK:
 			if (sd->num_bytes_tx == 0)
 				do_block_read(sd);
@@ -335,6 +692,28 @@ uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd)
 			if (sd->num_bytes_tx == sd->msg_len - 1)
 				finish_command(sd);
 			break;
+		case READ_MULTIPLE_BLOCK:
+			/*
+			 * Send the r1 response and first block, then keep
+			 * sending blocks until CMD12.
+			 */
+			sd->multi_block = true;
+			do_block_read(sd);
+			v = sd->data_buf[0];
+			if (sd->multi_block) {
+				sd->state = STATE_READ_MULTIPLE;
+				sd->stop_len = 0;
+				sd->num_bytes_tx = 1;
+				return v;
+			}
+			finish_command(sd);
+			break;
+		case WRITE_BLOCK:
+			v = do_write_start(sd, false);
+			return v;
+		case WRITE_MULTIPLE_BLOCK:
+			v = do_write_start(sd, true);
+			return v;
 		case APP_CMD:
 			v = 0x0;
 			sd->next_cmd_is_acmd = true;
@@ -376,3 +755,9 @@ uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd)
 
 	return v;
 }
+
+/* The card state is self-contained so it can be saved with a copy. */
+size_t spi_sdcard_state_size(void)
+{
+	return sizeof(struct spi_sdcard);
+}
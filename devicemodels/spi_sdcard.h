@@ -1,6 +1,7 @@
 #ifndef __SPI_SDCARD_H__
 #define __SPI_SDCARD_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -9,10 +10,16 @@ extern "C" {
 
 struct spi_sdcard;
 
+/* Write block writes through to the image rather than keeping them. */
+#define SPI_SDCARD_WRITABLE (1 << 0)
+
 struct spi_sdcard *spi_sdcard_new(const char *path);
+struct spi_sdcard *spi_sdcard_open(const char *path, const char *overlay,
+				   unsigned int flags);
 
 uint8_t spi_sdcard_next_byte_to_master(struct spi_sdcard *sd);
 void spi_sdcard_next_byte_to_slave(struct spi_sdcard *sd, uint8_t v);
+size_t spi_sdcard_state_size(void);
 
 #ifdef __cplusplus
 };
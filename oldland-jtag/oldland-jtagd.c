@@ -20,10 +20,13 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "gdbstub.h"
 #include "jtag/jtag.h"
 
 #include "../debugger/protocol.h"
 
+#define ARRAY_SIZE(_a) (sizeof((_a)) / sizeof((_a)[0]))
+
 struct debug_data {
 	int sock_fd;
 	int epoll_fd;
@@ -168,34 +171,57 @@ static int wait_complete(struct debug_data *debug)
 	return rc;
 }
 
-static int handle_req(struct debug_data *debug, struct dbg_request *req)
+static int write_dbg_reg(struct debug_data *debug, uint32_t addr,
+			 uint32_t value)
 {
-	struct dbg_response resp = { .status = req->addr > 3 ? -EINVAL : 0 };
-	uint32_t addr = req->addr;
 	unsigned out;
 
-	if (!req->read_not_write) {
-		addr |= (1 << 3); /* Write enable. */
+	addr |= (1 << 3); /* Write enable. */
 
-		if (set_vir(debug, addr) || jtag_vdr(32, req->value, &out)) {
-			warnx("failed to write request");
-			return -EIO;
-		}
+	if (set_vir(debug, addr) || jtag_vdr(32, value, &out)) {
+		warnx("failed to write request");
+		return -EIO;
+	}
+
+	if (wait_complete(debug)) {
+		warnx("failed to complete request");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int read_dbg_reg(struct debug_data *debug, uint32_t addr,
+			uint32_t *value)
+{
+	unsigned out;
+
+	if (set_vir(debug, addr) || jtag_vdr(32, 0, &out)) {
+		warnx("failed to perform read");
+		return -EIO;
+	}
+
+	if (wait_complete(debug)) {
+		warnx("failed to complete read request");
+		return -EIO;
+	}
+
+	*value = out;
+
+	return 0;
+}
+
+static int handle_req(struct debug_data *debug, struct dbg_request *req)
+{
+	struct dbg_response resp = { .status = req->addr > 3 ? -EINVAL : 0 };
+	uint32_t out = 0;
 
-		if (wait_complete(debug)) {
-			warnx("failed to complete request");
+	if (!req->read_not_write) {
+		if (write_dbg_reg(debug, req->addr, req->value))
 			return -EIO;
-		}
 	} else {
-		if (set_vir(debug, addr) || jtag_vdr(32, 0, &out)) {
-			warnx("failed to perform read");
-			return -EIO;
-		}
-
-		if (wait_complete(debug)) {
-			warnx("failed to complete read request");
+		if (read_dbg_reg(debug, req->addr, &out))
 			return -EIO;
-		}
 	}
 
 	resp.data = out;
@@ -205,6 +231,50 @@ static int handle_req(struct debug_data *debug, struct dbg_request *req)
 	return 0;
 }
 
+/* Execute a complete debug command for the gdb server. */
+static int gdb_command(void *priv, enum dbg_cmd cmd, uint32_t addr,
+		       uint32_t wdata, uint32_t *rdata)
+{
+	struct debug_data *debug = priv;
+
+	if (write_dbg_reg(debug, REG_ADDRESS, addr) ||
+	    write_dbg_reg(debug, REG_WDATA, wdata) ||
+	    write_dbg_reg(debug, REG_CMD, cmd) ||
+	    read_dbg_reg(debug, REG_RDATA, rdata))
+		return -EIO;
+
+	return 0;
+}
+
+static const struct gdb_mem_region jtag_mem_regions[] = {
+	{ GDB_MEM_RAM, RAM_ADDRESS, RAM_SIZE },
+	{ GDB_MEM_ROM, BOOTROM_ADDRESS, BOOTROM_SIZE },
+	{ GDB_MEM_RAM, SDRAM_ADDRESS, SDRAM_SIZE },
+};
+
+/*
+ * The JTAG link has to be polled to see when the target stops, so poll at
+ * 1ms intervals when there is no other activity.
+ */
+static void gdb_server_loop(struct debug_data *debug, const char *port)
+{
+	struct gdb_target target = {
+		.command = gdb_command,
+		.priv = debug,
+		.regions = jtag_mem_regions,
+		.nr_regions = ARRAY_SIZE(jtag_mem_regions),
+	};
+	struct gdb_server *gdb;
+
+	if (jtag_open_virtual_device(0x00))
+		err(1, "failed to open virtual device");
+
+	gdb = gdb_server_new(port, &target);
+	for (;;)
+		if (!gdb_server_poll(gdb))
+			usleep(1000);
+}
+
 static void server_loop(struct debug_data *d)
 {
 	for (;;) {
@@ -254,8 +324,21 @@ static struct debug_data *start_server(void)
 
 int main(int argc, char *argv[])
 {
-	struct debug_data *debug = start_server();
+	struct debug_data *debug;
+
+	/*
+	 * With --gdb PORT, serve the gdb remote protocol instead of the
+	 * oldland-debug protocol.
+	 */
+	if (argc == 3 && !strcmp(argv[1], "--gdb")) {
+		debug = calloc(1, sizeof(*debug));
+		if (!debug)
+			err(1, "failed to allocate data");
+		debug->cur_ir = -1;
+		gdb_server_loop(debug, argv[2]);
+	}
 
+	debug = start_server();
 	for (;;)
 		server_loop(debug);
 
@@ -0,0 +1,49 @@
+module sync_fifo(input wire			clk,
+		 input wire			push,
+		 input wire [data_bits - 1:0]	wr_data,
+		 input wire			pop,
+		 output wire [data_bits - 1:0]	rd_data,
+		 output wire			empty,
+		 output wire			full);
+
+parameter data_bits = 8;
+parameter nr_entries = 16;
+
+localparam ptr_bits = $clog2(nr_entries);
+
+reg [data_bits - 1:0]	mem[nr_entries - 1:0];
+reg [ptr_bits - 1:0]	rd_ptr = {ptr_bits{1'b0}};
+reg [ptr_bits - 1:0]	wr_ptr = {ptr_bits{1'b0}};
+reg [ptr_bits:0]	count = {(ptr_bits + 1){1'b0}};
+
+wire			do_push = push && !full;
+wire			do_pop = pop && !empty;
+
+assign			empty = count == {(ptr_bits + 1){1'b0}};
+assign			full = count == nr_entries;
+/* The head of the FIFO is always visible. */
+assign			rd_data = mem[rd_ptr];
+
+integer i;
+
+initial begin
+	for (i = 0; i < nr_entries; i = i + 1)
+		mem[i] = {data_bits{1'b0}};
+end
+
+always @(posedge clk) begin
+	if (do_push) begin
+		mem[wr_ptr] <= wr_data;
+		wr_ptr <= wr_ptr + 1'b1;
+	end
+
+	if (do_pop)
+		rd_ptr <= rd_ptr + 1'b1;
+
+	if (do_push && !do_pop)
+		count <= count + 1'b1;
+	else if (do_pop && !do_push)
+		count <= count - 1'b1;
+end
+
+endmodule
@@ -0,0 +1,70 @@
+/*
+ * Data bus arbiter between the CPU and a DMA master.
+ *
+ * Masters hold access high until the access is acked, the bus is granted to
+ * a master for the duration of an access.  When both masters request the bus
+ * at the same time the one that didn't have the last access wins so that
+ * neither can starve the other.
+ *
+ * Acks and errors are routed by the registered owner rather than the grant so
+ * that there is no path from a master's access through the grant logic back
+ * to its ack.  A master with a registered access may still have it raised in
+ * the ack cycle, so the owner's access isn't forwarded to the bus then.
+ */
+module keynsham_dbus_arbiter(input wire		clk,
+			     /* CPU data bus. */
+			     input wire		cpu_access,
+			     input wire [29:0]	cpu_addr,
+			     input wire [31:0]	cpu_wr_val,
+			     input wire		cpu_wr_en,
+			     input wire [3:0]	cpu_bytesel,
+			     output wire	cpu_ack,
+			     output wire	cpu_error,
+			     /* DMA master. */
+			     input wire		dma_access,
+			     input wire [29:0]	dma_addr,
+			     input wire [31:0]	dma_wr_val,
+			     input wire		dma_wr_en,
+			     input wire [3:0]	dma_bytesel,
+			     output wire	dma_ack,
+			     output wire	dma_error,
+			     /* Shared bus. */
+			     output wire	bus_access,
+			     output wire [29:0]	bus_addr,
+			     output wire [31:0]	bus_wr_val,
+			     output wire	bus_wr_en,
+			     output wire [3:0]	bus_bytesel,
+			     input wire		bus_ack,
+			     input wire		bus_error);
+
+reg		busy = 1'b0;
+reg		dma_owner = 1'b0;
+reg		last_was_dma = 1'b0;
+
+wire		pick_dma = dma_access & (~cpu_access | ~last_was_dma);
+wire		grant_dma = busy ? dma_owner : pick_dma;
+
+wire		acked = busy & (bus_ack | bus_error);
+
+assign		bus_access = ~acked & (grant_dma ? dma_access : cpu_access);
+assign		bus_addr = grant_dma ? dma_addr : cpu_addr;
+assign		bus_wr_val = grant_dma ? dma_wr_val : cpu_wr_val;
+assign		bus_wr_en = grant_dma ? dma_wr_en : cpu_wr_en;
+assign		bus_bytesel = grant_dma ? dma_bytesel : cpu_bytesel;
+
+assign		cpu_ack = ~dma_owner & bus_ack;
+assign		cpu_error = ~dma_owner & bus_error;
+assign		dma_ack = dma_owner & bus_ack;
+assign		dma_error = dma_owner & bus_error;
+
+always @(posedge clk) begin
+	if (bus_ack || bus_error) begin
+		busy <= 1'b0;
+		last_was_dma <= dma_owner;
+	end else if (bus_access) begin
+		busy <= 1'b1;
+		dma_owner <= grant_dma;
+	end
+end
+
+endmodule
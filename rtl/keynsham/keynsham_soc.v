@@ -48,10 +48,27 @@ wire [29:0]	i_addr;
 wire [31:0]	i_data;
 wire [29:0]	d_addr;
 wire [31:0]	d_data;
-wire [31:0]	d_wr_val = d_wr_en ? cpu_d_out : 32'b0;
+wire [31:0]	d_wr_val = d_wr_en ? d_master_wr_val : 32'b0;
 wire [3:0]	d_bytesel;
 wire		d_wr_en;
 wire		d_access;
+wire [31:0]	d_master_wr_val;
+
+/* CPU and SPI DMA masters, arbitrated onto the data bus. */
+wire [29:0]	cpu_d_addr;
+wire [3:0]	cpu_d_bytesel;
+wire		cpu_d_wr_en;
+wire		cpu_d_access;
+wire		cpu_d_ack;
+wire		cpu_d_error;
+
+wire [29:0]	spi_dma_addr;
+wire [31:0]	spi_dma_wr_val;
+wire [3:0]	spi_dma_bytesel;
+wire		spi_dma_wr_en;
+wire		spi_dma_access;
+wire		spi_dma_ack;
+wire		spi_dma_error;
 
 wire [31:0]	ram_data;
 wire [31:0]	i_ram_data;
@@ -66,6 +83,7 @@ wire		i_rom_ack;
 wire [31:0]	uart_data;
 wire		uart_ack;
 wire		uart_error;
+wire		uart_irq;
 
 wire [31:0]	timer_data;
 wire		timer_ack;
@@ -75,13 +93,18 @@ wire [3:0]	timer_irqs;
 wire [31:0]	spimaster_data;
 wire		spimaster_ack;
 wire		spimaster_error;
+wire		spimaster_irq;
 
 wire [31:0]	irq_data;
 wire		irq_ack;
 wire		irq_error;
 wire		irq_req;
 
-wire [3:0]	irqs = timer_irqs;
+/* Interrupt numbers come from the interrupts lists in the SoC config. */
+wire [5:0]	irqs;
+assign		irqs[`UART_IRQ] = uart_irq;
+assign		irqs[`SPIMASTER_IRQ] = spimaster_irq;
+assign		irqs[`TIMER_IRQ +: 4] = timer_irqs;
 
 wire [31:0]	d_sdram_data;
 wire		d_sdram_ack;
@@ -214,10 +237,11 @@ keynsham_sdram	#(.bus_address(`SDRAM_ADDRESS),
 		       .bus_error(uart_error),
 		       .bus_ack(uart_ack),
 		       .bus_data(uart_data),
+		       .irq(uart_irq),
 		       .rx(uart_rx),
 		       .tx(uart_tx));
 
-keynsham_irq	#(.nr_irqs(4),
+keynsham_irq	#(.nr_irqs(6),
 		  .bus_address(`IRQ_ADDRESS),
 		  .bus_size(`IRQ_SIZE))
 		irq(.clk(clk),
@@ -262,6 +286,15 @@ keynsham_spimaster	#(.bus_address(`SPIMASTER_ADDRESS),
 			    .bus_error(spimaster_error),
 			    .bus_ack(spimaster_ack),
 			    .bus_data(spimaster_data),
+			    .dma_access(spi_dma_access),
+			    .dma_addr(spi_dma_addr),
+			    .dma_wr_val(spi_dma_wr_val),
+			    .dma_wr_en(spi_dma_wr_en),
+			    .dma_bytesel(spi_dma_bytesel),
+			    .dma_data(d_data),
+			    .dma_ack(spi_dma_ack),
+			    .dma_error(spi_dma_error),
+			    .irq(spimaster_irq),
 			    .miso(miso),
 			    .mosi(mosi),
 			    .sclk(sclk),
@@ -310,14 +343,14 @@ oldland_cpu	#(.icache_size(`ICACHE_SIZE),
 		    .i_data(i_data),
 		    .i_ack(i_ack),
 		    .i_error(i_error),
-		    .d_addr(d_addr),
+		    .d_addr(cpu_d_addr),
 		    .d_data(d_data),
-		    .d_bytesel(d_bytesel),
-		    .d_wr_en(d_wr_en),
+		    .d_bytesel(cpu_d_bytesel),
+		    .d_wr_en(cpu_d_wr_en),
 		    .d_wr_val(cpu_d_out),
-		    .d_access(d_access),
-		    .d_ack(d_ack),
-		    .d_error(d_error),
+		    .d_access(cpu_d_access),
+		    .d_ack(cpu_d_ack),
+		    .d_error(cpu_d_error),
 		    .dbg_clk(dbg_clk),
 		    .dbg_addr(dbg_addr),
 		    .dbg_din(dbg_din),
@@ -327,6 +360,29 @@ oldland_cpu	#(.icache_size(`ICACHE_SIZE),
 		    .dbg_ack(dbg_ack),
 		    .dbg_rst(dbg_rst));
 
+keynsham_dbus_arbiter	d_arbiter(.clk(clk),
+				  .cpu_access(cpu_d_access),
+				  .cpu_addr(cpu_d_addr),
+				  .cpu_wr_val(cpu_d_out),
+				  .cpu_wr_en(cpu_d_wr_en),
+				  .cpu_bytesel(cpu_d_bytesel),
+				  .cpu_ack(cpu_d_ack),
+				  .cpu_error(cpu_d_error),
+				  .dma_access(spi_dma_access),
+				  .dma_addr(spi_dma_addr),
+				  .dma_wr_val(spi_dma_wr_val),
+				  .dma_wr_en(spi_dma_wr_en),
+				  .dma_bytesel(spi_dma_bytesel),
+				  .dma_ack(spi_dma_ack),
+				  .dma_error(spi_dma_error),
+				  .bus_access(d_access),
+				  .bus_addr(d_addr),
+				  .bus_wr_val(d_master_wr_val),
+				  .bus_wr_en(d_wr_en),
+				  .bus_bytesel(d_bytesel),
+				  .bus_ack(d_ack),
+				  .bus_error(d_error));
+
 always @(posedge clk) begin
 	d_default_ack <= d_access && d_default_cs;
 	d_default_error <= d_access && d_default_cs;
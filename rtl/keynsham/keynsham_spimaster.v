@@ -9,6 +9,17 @@ module keynsham_spimaster(input wire		clk,
 			  output reg		bus_error,
 			  output reg		bus_ack,
 			  output wire [31:0]	bus_data,
+			  /* DMA master. */
+			  output reg		dma_access,
+			  output reg [29:0]	dma_addr,
+			  output wire [31:0]	dma_wr_val,
+			  output reg		dma_wr_en,
+			  output reg [3:0]	dma_bytesel,
+			  input wire [31:0]	dma_data,
+			  input wire		dma_ack,
+			  input wire		dma_error,
+			  /* Completion interrupt. */
+			  output wire		irq,
 			  /* SPI bus. */
 			  input wire		miso,
 			  output wire		mosi,
@@ -30,18 +41,20 @@ reg [12:0]	data_addr = {13{1'b0}};
 reg [7:0]	data_val = 8'b0;
 wire [7:0]	buf_rd_val;
 wire		xfer_buf_cs = bus_addr[11];
-wire		buf_wr_en = bus_access & bus_cs & bus_wr_en & xfer_buf_cs; /* 8192 byte offset. */
+wire		bus_buf_wr_en = bus_access & bus_cs & bus_wr_en & xfer_buf_cs; /* 8192 byte offset. */
 
 wire		xfer_start = write_xfer_ctrl_reg & bus_wr_val[`XFER_GO_OFFSET] &
 			!xfer_ctrl_reg[`XFER_GO_OFFSET];
 wire		xfer_complete;
-reg		busy = 1'b0;
 
 wire		do_reg_access = bus_access & bus_cs & !xfer_buf_cs;
 
-wire            access_control = do_reg_access & {28'b0, bus_addr[1:0], 2'b0} == `SPI_CONTROL_REG_OFFS;
-wire            access_cs_enable = do_reg_access & {28'b0, bus_addr[1:0], 2'b0} == `SPI_CS_ENABLE_REG_OFFS;
-wire            access_xfer_control = do_reg_access & {28'b0, bus_addr[1:0], 2'b0} == `SPI_XFER_CONTROL_REG_OFFS;
+wire            access_control = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_CONTROL_REG_OFFS;
+wire            access_cs_enable = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_CS_ENABLE_REG_OFFS;
+wire            access_xfer_control = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_XFER_CONTROL_REG_OFFS;
+wire            access_dma_tx_addr = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_DMA_TX_ADDR_REG_OFFS;
+wire            access_dma_rx_addr = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_DMA_RX_ADDR_REG_OFFS;
+wire            access_eoi = do_reg_access & {27'b0, bus_addr[2:0], 2'b0} == `SPI_EOI_REG_OFFS;
 
 wire		write_xfer_ctrl_reg = bus_wr_en & access_xfer_control;
 
@@ -55,9 +68,57 @@ wire		miso_internal = loopback_enable ? ~mosi : miso;
 reg [31:0]	xfer_ctrl_reg = 32'b0;
 wire [12:0]	xfer_length = xfer_ctrl_reg[`XFER_LENGTH_OFFSET + `XFER_LENGTH_BITS - 1:`XFER_LENGTH_OFFSET];
 
+wire		dma_tx = xfer_ctrl_reg[`XFER_DMA_TX_OFFSET];
+wire		dma_rx = xfer_ctrl_reg[`XFER_DMA_RX_OFFSET];
+wire		irq_enable = xfer_ctrl_reg[`XFER_IRQ_ENABLE_OFFSET];
+reg		dma_fault = 1'b0;
+
 /* Chip select register. */
 reg [num_cs - 1:0] cs_reg = {num_cs{1'b0}};
 
+/* DMA addresses, must be word aligned. */
+reg [31:0]	dma_tx_addr = 32'b0;
+reg [31:0]	dma_rx_addr = 32'b0;
+
+reg		irq_active = 1'b0;
+assign		irq = irq_active;
+
+/*
+ * Transfers go through the DMA state machine.  Without DMA it just starts the
+ * sequencer and waits for completion.  With DMA the transmit bytes are copied
+ * a word at a time from memory into the transfer buffer before the transfer
+ * starts, and the received bytes are copied back out afterwards.  The DMA
+ * request is registered: it is raised on entering a copy state and dropped
+ * the cycle after the ack, the arbiter ignores it in the ack cycle.
+ */
+localparam	DMA_IDLE	= 3'd0;
+localparam	DMA_TX_READ	= 3'd1;
+localparam	DMA_TX_WRITE	= 3'd2;
+localparam	DMA_XFER	= 3'd3;
+localparam	DMA_RX_READ	= 3'd4;
+localparam	DMA_RX_WRITE	= 3'd5;
+
+reg [2:0]	dma_state = DMA_IDLE;
+reg [12:0]	dma_offs = 13'b0;
+reg [2:0]	dma_byte = 3'b0;
+reg [31:0]	dma_word = 32'b0;
+wire [12:0]	dma_remaining = xfer_length - dma_offs;
+wire		dma_last_word = dma_remaining <= 13'd4;
+reg		seq_start = 1'b0;
+wire		busy = dma_state != DMA_IDLE;
+
+assign		dma_wr_val = dma_word;
+
+/* The transfer buffer is owned by the DMA engine while it is copying. */
+wire		dma_buf_access = dma_state == DMA_TX_WRITE ||
+			dma_state == DMA_RX_READ;
+wire [12:0]	buf_addr = dma_buf_access ? dma_offs + {11'b0, dma_byte[1:0]} :
+			data_addr;
+wire [7:0]	buf_wr_val = dma_buf_access ? dma_word[{dma_byte[1:0], 3'b0}+:8] :
+			data_val;
+wire		buf_wr_en = dma_buf_access ? dma_state == DMA_TX_WRITE :
+			bus_buf_wr_en;
+
 assign          ncs = ~cs_reg;
 
 cs_gen		#(.address(bus_address), .size(bus_size))
@@ -65,13 +126,13 @@ cs_gen		#(.address(bus_address), .size(bus_size))
 
 spisequencer	seq(.clk(clk),
 		    /* Memory buffer signals. */
-		    .buf_addr(data_addr),
-		    .buf_wr_val(data_val),
+		    .buf_addr(buf_addr),
+		    .buf_wr_val(buf_wr_val),
 		    .buf_rd_val(buf_rd_val),
 		    .buf_wr_en(buf_wr_en),
 		    /* SPI transfer control signals. */
 		    .divider(divider),
-		    .xfer_start(xfer_start),
+		    .xfer_start(seq_start),
 		    .xfer_length(xfer_length),
 		    .xfer_complete(xfer_complete),
 		    /* SPI bus signals. */
@@ -83,6 +144,7 @@ initial begin
 	bus_error = 1'b0;
 	bus_ack = 1'b0;
 	reg_rd_val = 32'b0;
+	dma_access = 1'b0;
 end
 
 always @(*) begin
@@ -119,7 +181,12 @@ always @(posedge clk) begin
                 else if (access_cs_enable)
 			reg_rd_val <= {{(32 - num_cs){1'b0}}, cs_reg};
 		else if (access_xfer_control)
-			reg_rd_val <= xfer_ctrl_reg | {14'b0, busy, 17'b0};
+			reg_rd_val <= xfer_ctrl_reg | {14'b0, busy, 17'b0} |
+				(dma_fault ? `XFER_DMA_ERROR_MASK : 32'b0);
+		else if (access_dma_tx_addr)
+			reg_rd_val <= dma_tx_addr;
+		else if (access_dma_rx_addr)
+			reg_rd_val <= dma_rx_addr;
 		else
 			reg_rd_val <= 32'b0;
 	end
@@ -130,7 +197,12 @@ always @(posedge clk) begin
 		else if (access_cs_enable)
 			cs_reg <= bus_wr_val[num_cs - 1:0];
 		else if (access_xfer_control)
-			xfer_ctrl_reg <= bus_wr_val & ~`XFER_GO_MASK;
+			xfer_ctrl_reg <= bus_wr_val & ~(`XFER_GO_MASK |
+							`XFER_DMA_ERROR_MASK);
+		else if (access_dma_tx_addr)
+			dma_tx_addr <= bus_wr_val;
+		else if (access_dma_rx_addr)
+			dma_rx_addr <= bus_wr_val;
 	end
 
 	if (bus_access && xfer_buf_cs && !bus_wr_en)
@@ -149,11 +221,118 @@ always @(posedge clk) begin
 		bus_rd_from_regs <= 1'b1;
 end
 
+always @(*) begin
+	dma_addr = 30'b0;
+	dma_wr_en = 1'b0;
+	dma_bytesel = 4'b1111;
+
+	case (dma_state)
+	DMA_TX_READ: begin
+		dma_addr = dma_tx_addr[31:2] + {19'b0, dma_offs[12:2]};
+	end
+	DMA_RX_WRITE: begin
+		dma_addr = dma_rx_addr[31:2] + {19'b0, dma_offs[12:2]};
+		dma_wr_en = 1'b1;
+		case (dma_remaining)
+		13'd1: dma_bytesel = 4'b0001;
+		13'd2: dma_bytesel = 4'b0011;
+		13'd3: dma_bytesel = 4'b0111;
+		default: dma_bytesel = 4'b1111;
+		endcase
+	end
+	default: ;
+	endcase
+end
+
 always @(posedge clk) begin
-	if (xfer_start)
-		busy <= 1'b1;
-	else if (xfer_complete)
-		busy <= 1'b0;
+	seq_start <= 1'b0;
+
+	case (dma_state)
+	DMA_IDLE: begin
+		dma_offs <= 13'b0;
+		dma_byte <= 3'b0;
+		if (xfer_start) begin
+			dma_fault <= 1'b0;
+			if (bus_wr_val[`XFER_DMA_TX_OFFSET]) begin
+				dma_state <= DMA_TX_READ;
+				dma_access <= 1'b1;
+			end else begin
+				dma_state <= DMA_XFER;
+				seq_start <= 1'b1;
+			end
+		end
+	end
+	DMA_TX_READ: begin
+		if (dma_error) begin
+			dma_access <= 1'b0;
+			dma_fault <= 1'b1;
+			dma_state <= DMA_IDLE;
+			irq_active <= irq_enable;
+		end else if (dma_ack) begin
+			dma_access <= 1'b0;
+			dma_word <= dma_data;
+			dma_byte <= 3'b0;
+			dma_state <= DMA_TX_WRITE;
+		end
+	end
+	DMA_TX_WRITE: begin
+		dma_byte <= dma_byte + 1'b1;
+		if (dma_byte == 3'd3) begin
+			dma_offs <= dma_offs + 13'd4;
+			if (dma_last_word) begin
+				dma_state <= DMA_XFER;
+				seq_start <= 1'b1;
+			end else begin
+				dma_state <= DMA_TX_READ;
+				dma_access <= 1'b1;
+			end
+		end
+	end
+	DMA_XFER: begin
+		if (xfer_complete) begin
+			dma_offs <= 13'b0;
+			dma_byte <= 3'b0;
+			if (dma_rx) begin
+				dma_state <= DMA_RX_READ;
+			end else begin
+				dma_state <= DMA_IDLE;
+				irq_active <= irq_enable;
+			end
+		end
+	end
+	DMA_RX_READ: begin
+		/* The buffer read data is valid the cycle after the address. */
+		dma_byte <= dma_byte + 1'b1;
+		if (dma_byte != 3'd0)
+			dma_word[{dma_byte[1:0] - 2'd1, 3'b0}+:8] <= buf_rd_val;
+		if (dma_byte == 3'd4) begin
+			dma_state <= DMA_RX_WRITE;
+			dma_access <= 1'b1;
+		end
+	end
+	DMA_RX_WRITE: begin
+		if (dma_error) begin
+			dma_access <= 1'b0;
+			dma_fault <= 1'b1;
+			dma_state <= DMA_IDLE;
+			irq_active <= irq_enable;
+		end else if (dma_ack) begin
+			dma_access <= 1'b0;
+			dma_offs <= dma_offs + 13'd4;
+			dma_byte <= 3'b0;
+			if (dma_last_word) begin
+				dma_state <= DMA_IDLE;
+				irq_active <= irq_enable;
+			end else begin
+				dma_state <= DMA_RX_READ;
+			end
+		end
+	end
+	default: dma_state <= DMA_IDLE;
+	endcase
+
+	if (access_eoi && bus_wr_en)
+		irq_active <= 1'b0;
 end
 
 always @(*) begin
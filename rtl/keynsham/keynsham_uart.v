@@ -12,6 +12,7 @@ module keynsham_uart(input wire		clk,
 		     output reg		bus_error,
 		     output reg		bus_ack,
 		     output reg [31:0]	bus_data,
+		     output wire	irq,
 		     input wire		rx,
 		     output wire	tx);
 
@@ -25,15 +26,57 @@ reg		uart_rdy_clr = 1'b0;
 wire [7:0]	uart_dout;
 wire		uart_tx_busy;
 
-wire [31:0] status_reg = (uart_tx_busy ? 32'b0 : `TX_EMPTY_MASK) |
-			 (uart_rdy ? `RX_READY_MASK : 32'b0);
-
 wire            access_data_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_DATA_REG_OFFS;
 wire            access_status_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_STATUS_REG_OFFS;
+wire            access_control_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_CONTROL_REG_OFFS;
+
+/*
+ * Writes are queued in the transmit FIFO and fed to the transmitter while it
+ * is idle, received characters are queued in the receive FIFO until the data
+ * register is read.
+ */
+wire [7:0]	tx_fifo_data;
+wire		tx_fifo_empty;
+wire		tx_fifo_full;
+wire		tx_fifo_push = bus_access && bus_cs && bus_wr_en && access_data_reg;
+wire		tx_fifo_pop = !uart_tx_busy && !uart_write && !tx_fifo_empty;
+
+wire [7:0]	rx_fifo_data;
+wire		rx_fifo_empty;
+wire		rx_fifo_push = uart_rdy && !uart_rdy_clr;
+wire		rx_fifo_pop = bus_access && bus_cs && !bus_wr_en && access_data_reg;
+
+reg [31:0]	control_reg = 32'b0;
+wire		tx_empty = tx_fifo_empty && !uart_tx_busy && !uart_write;
+
+wire [31:0] status_reg = (tx_empty ? `TX_EMPTY_MASK : 32'b0) |
+			 (!rx_fifo_empty ? `RX_READY_MASK : 32'b0) |
+			 (tx_fifo_full ? `TX_FULL_MASK : 32'b0);
+
+assign		irq = (control_reg[`RX_IRQ_ENABLE_OFFSET] && !rx_fifo_empty) ||
+		      (control_reg[`TX_IRQ_ENABLE_OFFSET] && tx_empty);
 
 cs_gen		#(.address(bus_address), .size(bus_size))
 		d_cs_gen(.bus_addr(bus_addr), .cs(bus_cs));
 
+sync_fifo	#(.data_bits(8), .nr_entries(16))
+		tx_fifo(.clk(clk),
+			.push(tx_fifo_push),
+			.wr_data(bus_wr_val[7:0]),
+			.pop(tx_fifo_pop),
+			.rd_data(tx_fifo_data),
+			.empty(tx_fifo_empty),
+			.full(tx_fifo_full));
+
+sync_fifo	#(.data_bits(8), .nr_entries(16))
+		rx_fifo(.clk(clk),
+			.push(rx_fifo_push),
+			.wr_data(uart_dout),
+			.pop(rx_fifo_pop),
+			.rd_data(rx_fifo_data),
+			.empty(rx_fifo_empty),
+			.full());
+
 uart		uart0(.clk_50m(clk),
 		      .wr_en(uart_write),
 		      .din(uart_din),
@@ -55,21 +98,26 @@ always @(posedge clk) begin
 
 	if (!uart_tx_busy)
 		uart_write <= 1'b0;
-	uart_rdy_clr <= 1'b0;
+	if (tx_fifo_pop) begin
+		uart_din <= tx_fifo_data;
+		uart_write <= 1'b1;
+	end
+
+	/* Characters received with the FIFO full are dropped. */
+	uart_rdy_clr <= rx_fifo_push;
 
 	if (bus_access && bus_cs && bus_wr_en) begin
-		if (access_data_reg) begin
-			/* Data register write. */
-			uart_din <= bus_wr_val[7:0];
-			uart_write <= 1'b1;
-		end
+		if (access_control_reg)
+			control_reg <= bus_wr_val & (`RX_IRQ_ENABLE_MASK |
+						     `TX_IRQ_ENABLE_MASK);
 	end else if (bus_access && bus_cs) begin
 		if (access_data_reg) begin
-			bus_data <= {24'b0, uart_dout};
-			uart_rdy_clr <= 1'b1;
+			bus_data <= rx_fifo_empty ? 32'b0 : {24'b0, rx_fifo_data};
 		end else if (access_status_reg) begin
 			/* Status register read. */
 			bus_data <= status_reg;
+		end else if (access_control_reg) begin
+			bus_data <= control_reg;
 		end
 	end
 
@@ -37,7 +37,10 @@ module oldland_cache(input wire		clk,
 		     input wire		tlb_valid,
 		     input wire		tlb_miss,
 		     input wire		tlb_complete,
-		     input wire [1:0]	tlb_access);
+		     input wire [1:0]	tlb_access,
+		     /* Page table walker memory reads. */
+		     input wire		walk_access,
+		     input wire [29:0]	walk_addr);
 
 parameter cache_size		= 8192;
 parameter cache_line_size	= 32;
@@ -96,11 +99,18 @@ reg				bypass = 1'b0;
 reg				bypass_access = 1'b0;
 reg				bypass_error = 1'b0;
 reg				bypass_ack = 1'b0;
-assign				m_access = bypass ? bypass_access : wm_access[victim_sel];
-assign				m_addr = bypass ? {tlb_phys, latched_addr[9:0]} : wm_addr[victim_sel];
+/*
+ * The TLB only walks while the access is waiting for its translation so the
+ * ways and bypass are idle and the walker can have the bus.
+ */
+assign				m_access = walk_access | (bypass ? bypass_access : wm_access[victim_sel]);
+assign				m_addr = walk_access ? walk_addr :
+					bypass ? {tlb_phys, latched_addr[9:0]} : wm_addr[victim_sel];
 assign				m_wr_val = bypass ? latched_wr_val : wm_wr_val[victim_sel];
-assign				m_wr_en = bypass ? latched_wr_en : wm_wr_en[victim_sel];
-assign				m_bytesel = bypass ? latched_bytesel : wm_bytesel[victim_sel];
+assign				m_wr_en = walk_access ? 1'b0 :
+					bypass ? latched_wr_en : wm_wr_en[victim_sel];
+assign				m_bytesel = walk_access ? 4'b1111 :
+					bypass ? latched_bytesel : wm_bytesel[victim_sel];
 
 wire				access_ok = 
 					((latched_wr_en && tlb_access[`TLB_WRITE]) ||
@@ -126,6 +126,11 @@ wire		itlb_valid;
 wire		itlb_translate;
 wire		itlb_miss;
 wire		itlb_complete;
+wire [31:0]	ptbr;
+wire		dtlb_walk_access;
+wire [29:0]	dtlb_walk_addr;
+wire		itlb_walk_access;
+wire [29:0]	itlb_walk_addr;
 
 /* CPUID signals. */
 wire [2:0]	cpu_cpuid_sel;
@@ -188,7 +193,9 @@ oldland_cache		#(.cache_size(icache_size),
 			       .tlb_valid(itlb_valid),
 			       .tlb_miss(itlb_miss),
 			       .tlb_complete(itlb_complete),
-			       .tlb_access(itlb_access));
+			       .tlb_access(itlb_access),
+			       .walk_access(itlb_walk_access),
+			       .walk_addr(itlb_walk_addr));
 
 oldland_cache		#(.cache_size(dcache_size),
 			  .cache_line_size(dcache_line_size),
@@ -225,7 +232,9 @@ oldland_cache		#(.cache_size(dcache_size),
 			       .tlb_valid(dtlb_valid),
 			       .tlb_miss(dtlb_miss),
 			       .tlb_complete(dtlb_complete),
-			       .tlb_access(dtlb_access));
+			       .tlb_access(dtlb_access),
+			       .walk_access(dtlb_walk_access),
+			       .walk_addr(dtlb_walk_addr));
 
 oldland_tlb		#(.nr_entries(dtlb_num_entries))
 			dtlb(.clk(clk),
@@ -243,7 +252,13 @@ oldland_tlb		#(.nr_entries(dtlb_num_entries))
 			     .access(dtlb_access),
 			     .valid(dtlb_valid),
 			     .miss(dtlb_miss),
-			     .complete(dtlb_complete));
+			     .complete(dtlb_complete),
+			     .ptbr(ptbr),
+			     .walk_access(dtlb_walk_access),
+			     .walk_addr(dtlb_walk_addr),
+			     .walk_data(d_data),
+			     .walk_ack(d_ack),
+			     .walk_error(d_error));
 
 oldland_tlb		#(.nr_entries(itlb_num_entries))
 			itlb(.clk(clk),
@@ -261,7 +276,13 @@ oldland_tlb		#(.nr_entries(itlb_num_entries))
 			     .access(itlb_access),
 			     .valid(itlb_valid),
 			     .miss(itlb_miss),
-			     .complete(itlb_complete));
+			     .complete(itlb_complete),
+			     .ptbr(ptbr),
+			     .walk_access(itlb_walk_access),
+			     .walk_addr(itlb_walk_addr),
+			     .walk_data(i_data),
+			     .walk_ack(i_ack),
+			     .walk_error(i_error));
 
 oldland_debug		#(.icache_nr_lines(icache_nr_lines),
 			  .dcache_nr_lines(dcache_nr_lines))
@@ -354,6 +375,7 @@ oldland_pipeline	#(.icache_idx_bits(icache_idx_bits),
 				 .itlb_load_virt(itlb_load_virt),
 				 .itlb_load_phys(itlb_load_phys),
 				 .tlb_load_data(tlb_load_data),
+				 .ptbr(ptbr),
 				 /* Debug signals. */
 				 .run(cpu_run),
 				 .stopped(cpu_stopped),
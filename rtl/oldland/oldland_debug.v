@@ -55,52 +55,60 @@ parameter dcache_nr_lines	= 0;
 localparam icache_idx_bits	= $clog2(icache_nr_lines);
 localparam dcache_idx_bits	= $clog2(dcache_nr_lines);
 
-localparam STATE_IDLE		= 18'b000000000000000001;
-localparam STATE_LOAD_CMD	= 18'b000000000000000010;
-localparam STATE_LOAD_ADDR	= 18'b000000000000000100;
-localparam STATE_LOAD_DATA	= 18'b000000000000001000;
-localparam STATE_WAIT_STOPPED	= 18'b000000000000010000;
-localparam STATE_STEP		= 18'b000000000000100000;
-localparam STATE_COMPL		= 18'b000000000001000000;
-localparam STATE_STORE_REG_RVAL	= 18'b000000000010000000;
-localparam STATE_WRITE_REG	= 18'b000000000100000000;
-localparam STATE_WAIT_RMEM	= 18'b000000001000000000;
-localparam STATE_WAIT_WMEM	= 18'b000000010000000000;
-localparam STATE_EXECUTE	= 18'b000000100000000000;
-localparam STATE_RESET		= 18'b000001000000000000;
-localparam STATE_CACHE_FLUSH	= 18'b000010000000000000;
-localparam STATE_CACHE_INVAL	= 18'b000100000000000000;
-localparam STATE_EXT_RESET_STOP = 18'b001000000000000000;
-localparam STATE_EXT_RESET_RESET= 18'b010000000000000000;
-localparam STATE_EXT_RESET_START= 18'b100000000000000000;
+localparam STATE_IDLE		= 19'b0000000000000000001;
+localparam STATE_LOAD_CMD	= 19'b0000000000000000010;
+localparam STATE_LOAD_ADDR	= 19'b0000000000000000100;
+localparam STATE_LOAD_DATA	= 19'b0000000000000001000;
+localparam STATE_WAIT_STOPPED	= 19'b0000000000000010000;
+localparam STATE_STEP		= 19'b0000000000000100000;
+localparam STATE_COMPL		= 19'b0000000000001000000;
+localparam STATE_STORE_REG_RVAL	= 19'b0000000000010000000;
+localparam STATE_WRITE_REG	= 19'b0000000000100000000;
+localparam STATE_WAIT_RMEM	= 19'b0000000001000000000;
+localparam STATE_WAIT_WMEM	= 19'b0000000010000000000;
+localparam STATE_EXECUTE	= 19'b0000000100000000000;
+localparam STATE_RESET		= 19'b0000001000000000000;
+localparam STATE_CACHE_FLUSH	= 19'b0000010000000000000;
+localparam STATE_CACHE_INVAL	= 19'b0000100000000000000;
+localparam STATE_EXT_RESET_STOP = 19'b0001000000000000000;
+localparam STATE_EXT_RESET_RESET= 19'b0010000000000000000;
+localparam STATE_EXT_RESET_START= 19'b0100000000000000000;
+localparam STATE_RUN_N_NEXT	= 19'b1000000000000000000;
 
-localparam CMD_HALT		= 4'h0;
-localparam CMD_RUN		= 4'h1;
-localparam CMD_STEP		= 4'h2;
-localparam CMD_READ_REG		= 4'h3;
-localparam CMD_WRITE_REG	= 4'h4;
-localparam CMD_RMEM32		= 4'h5;
-localparam CMD_RMEM16		= 4'h6;
-localparam CMD_RMEM8		= 4'h7;
-localparam CMD_WMEM32		= 4'h8;
-localparam CMD_WMEM16		= 4'h9;
-localparam CMD_WMEM8		= 4'ha;
-localparam CMD_RESET            = 4'hb;
-localparam CMD_CACHE_SYNC	= 4'hc;
-localparam CMD_CPUID		= 4'hd;
-localparam CMD_GET_EXEC_STATUS	= 4'he;
+localparam CMD_HALT		= 5'h00;
+localparam CMD_RUN		= 5'h01;
+localparam CMD_STEP		= 5'h02;
+localparam CMD_READ_REG		= 5'h03;
+localparam CMD_WRITE_REG	= 5'h04;
+localparam CMD_RMEM32		= 5'h05;
+localparam CMD_RMEM16		= 5'h06;
+localparam CMD_RMEM8		= 5'h07;
+localparam CMD_WMEM32		= 5'h08;
+localparam CMD_WMEM16		= 5'h09;
+localparam CMD_WMEM8		= 5'h0a;
+localparam CMD_RESET            = 5'h0b;
+localparam CMD_CACHE_SYNC	= 5'h0c;
+localparam CMD_CPUID		= 5'h0d;
+localparam CMD_GET_EXEC_STATUS	= 5'h0e;
+localparam CMD_RUN_N		= 5'h0f;
 
 reg [1:0]	ctl_addr = 2'b00;
 reg [31:0]	ctl_din = 32'b0;
 wire [31:0]	ctl_dout;
 reg		ctl_wr_en = 1'b0;
 
-reg [17:0]	state = STATE_IDLE;
-reg [17:0]	next_state = STATE_IDLE;
+reg [18:0]	state = STATE_IDLE;
+reg [18:0]	next_state = STATE_IDLE;
 
-reg [3:0]	debug_cmd = 4'b0;
+/*
+ * Bit 4 is set for any command outside of 0-15, those are reserved for the
+ * simulator and complete without doing anything.
+ */
+reg [4:0]	debug_cmd = 5'b0;
 reg [31:0]	debug_addr = 32'b0;
 reg [31:0]	debug_data = 32'b0;
+/* Instructions left to step for CMD_RUN_N. */
+reg [31:0]	run_count = 32'b0;
 
 reg [11:0]	reset_count = 12'hfff;
 
@@ -220,6 +228,8 @@ always @(*) begin
 		CMD_HALT: next_state = STATE_WAIT_STOPPED;
 		CMD_RUN: next_state = STATE_COMPL;
 		CMD_STEP: next_state = STATE_STEP;
+		CMD_RUN_N: next_state = |debug_addr ? STATE_STEP :
+			STATE_WAIT_STOPPED;
 		CMD_READ_REG: begin
 			next_state = STATE_STORE_REG_RVAL;
 		end
@@ -315,13 +325,20 @@ always @(*) begin
 		next_state = STATE_WAIT_STOPPED;
 	end
 	STATE_WAIT_STOPPED: begin
-		next_state = stopped ? STATE_COMPL : STATE_WAIT_STOPPED;
+		if (stopped && debug_cmd == CMD_RUN_N && |run_count &&
+		    !stopped_on_bkpt)
+			next_state = STATE_RUN_N_NEXT;
+		else
+			next_state = stopped ? STATE_COMPL : STATE_WAIT_STOPPED;
 		if (stopped) begin
 			ctl_addr = 2'b11;
 			ctl_wr_en = 1'b1;
 			ctl_din = dbg_pc;
 		end
 	end
+	STATE_RUN_N_NEXT: begin
+		next_state = STATE_STEP;
+	end
 	STATE_EXT_RESET_STOP: begin
 		next_state = stopped ? STATE_EXT_RESET_RESET :
 			STATE_EXT_RESET_STOP;
@@ -352,7 +369,7 @@ always @(posedge clk) begin
 	STATE_IDLE: begin
 	end
 	STATE_LOAD_CMD: begin
-		debug_cmd <= ctl_dout[3:0];
+		debug_cmd <= {|ctl_dout[31:4], ctl_dout[3:0]};
 	end
 	STATE_LOAD_ADDR: begin
 		debug_addr <= ctl_dout;
@@ -382,6 +399,11 @@ always @(posedge clk) begin
 		CMD_HALT: do_run <= 1'b0;
 		CMD_RUN: do_run <= 1'b1;
 		CMD_STEP: do_run <= 1'b1;
+		CMD_RUN_N: begin
+			/* Step N times, stopping early on a breakpoint. */
+			do_run <= |debug_addr;
+			run_count <= |debug_addr ? debug_addr - 1'b1 : 32'b0;
+		end
 		CMD_RESET: do_run <= 1'b0;
 		default: begin
 		end
@@ -404,6 +426,10 @@ always @(posedge clk) begin
 	STATE_STEP: begin
 		do_run <= 1'b0;
 	end
+	STATE_RUN_N_NEXT: begin
+		do_run <= 1'b1;
+		run_count <= run_count - 1'b1;
+	end
 	STATE_EXT_RESET_START: begin
 		do_run <= 1'b1;
 	end
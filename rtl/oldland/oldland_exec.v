@@ -60,6 +60,7 @@ module oldland_exec(input wire		clk,
 		    input wire		dtlb_miss,
                     output reg [31:2]   dtlb_miss_handler,
                     output reg [31:2]   itlb_miss_handler,
+		    output wire [31:0]	ptbr,
 		    output reg		user_mode);
 
 wire [31:0]	op1 = alu_op1_ra ? ra : alu_op1_rb ? rb : pc_plus_4;
@@ -101,7 +102,11 @@ assign		control_regs[3] = fault_address;
 assign		control_regs[4] = data_fault_address;
 assign		control_regs[5] = {dtlb_miss_handler, 2'b0};
 assign		control_regs[6] = {itlb_miss_handler, 2'b0};
-assign		control_regs[7] = 32'b0;
+assign		control_regs[7] = ptbr;
+
+reg [31:12]	ptbr_base = 20'b0;
+reg		ptbr_walk_enable = 1'b0;
+assign		ptbr = {ptbr_base, 11'b0, ptbr_walk_enable};
 
 assign		dbg_cr_val = control_regs[dbg_cr_sel];
 
@@ -264,6 +269,19 @@ always @(posedge clk)
 	else if (write_cr && cr_sel == 3'h6)
 		itlb_miss_handler <= ra[31:2];
 
+/* CR7: page table base register. */
+always @(posedge clk)
+	if (rst) begin
+		ptbr_base <= 20'b0;
+		ptbr_walk_enable <= 1'b0;
+	end else if (dbg_cr_wr_en && dbg_cr_sel == 3'h7) begin
+		ptbr_base <= dbg_cr_wr_val[31:12];
+		ptbr_walk_enable <= dbg_cr_wr_val[0];
+	end else if (write_cr && cr_sel == 3'h7) begin
+		ptbr_base <= ra[31:12];
+		ptbr_walk_enable <= ra[0];
+	end
+
 always @(posedge clk) begin
 	if (rst) begin
 		alu_out <= 32'b0;
@@ -34,6 +34,7 @@ module oldland_pipeline(input wire		clk,
                         output wire             itlb_load_virt,
                         output wire             itlb_load_phys,
                         output wire [31:0]      tlb_load_data,
+                        output wire [31:0]      ptbr,
 			/* Debug signals. */
 			input wire		run,
 			output wire		stopped,
@@ -293,6 +294,7 @@ oldland_exec	execute(.clk(clk),
 			.dtlb_miss(dtlb_miss),
                         .dtlb_miss_handler(dtlb_miss_handler),
                         .itlb_miss_handler(itlb_miss_handler),
+			.ptbr(ptbr),
 			.user_mode(user_mode));
 
 oldland_memory	#(.icache_idx_bits(icache_idx_bits),
@@ -15,7 +15,16 @@ module oldland_tlb(input wire clk,
 		   output reg [1:0] access,
 		   output reg valid,
 		   output wire miss,
-		   output reg complete);
+		   output reg complete,
+		   /* Page table walker. */
+		   // verilator lint_off UNUSED
+		   input wire [31:0] ptbr,
+		   input wire [31:0] walk_data,
+		   // verilator lint_on UNUSED
+		   output wire walk_access,
+		   output wire [29:0] walk_addr,
+		   input wire walk_ack,
+		   input wire walk_error);
 
 parameter		nr_entries = 8;
 localparam		entry_bits = $clog2(nr_entries);
@@ -33,6 +42,37 @@ reg [entry_bits:0]	entry_idx = {entry_bits + 1{1'b0}};
 reg [entry_bits - 1:0]	entry = {entry_bits{1'b0}};
 reg			tlb_miss = 1'b0;
 assign			miss = tlb_miss && enabled;
+reg			hit = 1'b0;
+integer			hit_idx;
+
+/*
+ * When the walker is enabled in the PTBR a miss reads the PDE then the PTE
+ * and loads the entry, only raising a miss for software if either is invalid
+ * or the read faults.
+ */
+localparam		WALK_IDLE = 2'b00;
+localparam		WALK_PDE = 2'b01;
+localparam		WALK_PTE = 2'b10;
+
+reg [1:0]		walk_state = WALK_IDLE;
+reg [31:12]		walk_virt = 20'b0;
+reg [31:12]		walk_table = 20'b0;
+wire			start_walk = translate && enabled && !starting_miss &&
+				     ptbr[0] && !hit;
+wire			walk_entry_valid = walk_state == WALK_PDE ?
+					walk_data[0] : walk_data[4];
+wire			walk_failed = walk_state != WALK_IDLE && walk_ack &&
+					(walk_error || !walk_entry_valid);
+wire			walk_done = walk_state == WALK_PTE && walk_ack &&
+					!walk_failed;
+assign			walk_access = walk_state != WALK_IDLE && !walk_ack;
+assign			walk_addr = {walk_table, walk_state == WALK_PDE ?
+				     walk_virt[31:22] : walk_virt[21:12]};
+
+wire			do_load = load_phys || walk_done;
+wire [31:12]		load_virt_in = walk_done ? walk_virt : next_virt[31:12];
+wire [31:12]		load_phys_in = walk_done ? walk_data[31:12] : load_data[31:12];
+wire [3:0]		load_access_in = walk_done ? walk_data[3:0] : next_virt[3:0];
 
 genvar		i;
 
@@ -49,9 +89,9 @@ generate
 					.rst(rst),
 					.user_mode(user_mode),
 					.inval(inval),
-					.virt_in(next_virt[31:12]),
-					.phys_in(load_data[31:12]),
-					.access_in(next_virt[3:0]),
+					.virt_in(load_virt_in),
+					.phys_in(load_phys_in),
+					.access_in(load_access_in),
 					.load(load_entry[i]),
 					.virt_out(entry_virt[i]),
 					.phys_out(entry_phys[i]),
@@ -66,7 +106,7 @@ always @(posedge clk) begin
 
 	if (rst)
 		victim_sel <= {entry_bits{1'b0}};
-	if (load_phys)
+	if (do_load)
 		victim_sel <= victim_sel + 1'b1;
 end
 
@@ -79,16 +119,38 @@ always @(*) begin
 	 */
 	for (entry_idx = 0; entry_idx < nr_entries; entry_idx = entry_idx + 1'b1) begin
 		entry = entry_idx[entry_bits - 1:0];
-		if (entry_valid[entry] && entry_virt[entry] == next_virt[31:12] && load_phys)
+		if (entry_valid[entry] && entry_virt[entry] == load_virt_in && do_load)
 			load_entry[entry] = 1'b1;
 		else
 			load_entry[entry] = 1'b0;
 	end
 
-	if (~|load_entry && load_phys)
+	if (~|load_entry && do_load)
 		load_entry[victim_sel] = 1'b1;
 end
 
+always @(*) begin
+	hit = 1'b0;
+	for (hit_idx = 0; hit_idx < nr_entries; hit_idx = hit_idx + 1)
+		if (entry_valid[hit_idx] && entry_virt[hit_idx] == virt[31:12])
+			hit = 1'b1;
+end
+
+always @(posedge clk) begin
+	if (rst) begin
+		walk_state <= WALK_IDLE;
+	end else if (start_walk) begin
+		walk_virt <= virt[31:12];
+		walk_table <= ptbr[31:12];
+		walk_state <= WALK_PDE;
+	end else if (walk_failed || walk_done) begin
+		walk_state <= WALK_IDLE;
+	end else if (walk_state == WALK_PDE && walk_ack) begin
+		walk_table <= walk_data[31:12];
+		walk_state <= WALK_PTE;
+	end
+end
+
 always @(posedge clk) begin
 	if (translate) begin
 		valid <= 1'b0;
@@ -113,6 +175,22 @@ always @(posedge clk) begin
 		end
 	end
 
+	/* Hold off completion until the walk has finished. */
+	if (start_walk) begin
+		tlb_miss <= 1'b0;
+		complete <= 1'b0;
+	end
+
+	if (walk_done) begin
+		phys <= walk_data[31:12];
+		access <= user_mode ? walk_data[3:2] : walk_data[1:0];
+		valid <= 1'b1;
+		complete <= 1'b1;
+	end else if (walk_failed) begin
+		tlb_miss <= 1'b1;
+		complete <= 1'b1;
+	end
+
 	/*
 	 * If we are starting a new miss then the TLB will be disabled on the
 	 * next cycle so we need to make sure that we have a valid output.
@@ -1,11 +1,14 @@
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "cache.h"
+#include "checkpoint.h"
 #include "io.h"
+#include "simd.h"
 
 #define CACHE_OFFSET_SZ		(1 << ICACHE_OFFSET_BITS)
 #define CACHE_OFFSET_MASK	((1 << ICACHE_OFFSET_BITS) - 1)
@@ -18,19 +21,28 @@
 #define CACHE_TAG_SHIFT		(ICACHE_OFFSET_BITS + ICACHE_INDEX_BITS)
 #define CACHE_TAG_MASK		(((1 << CACHE_TAG_BITS) - 1) << CACHE_TAG_SHIFT)
 
+/*
+ * The tags for each index are kept together, away from the line data, so
+ * that a lookup compares all of the ways with vector compares on a single
+ * host cache line.  The valid bit is stored above the tag so an invalid or
+ * padding way never matches, and the ways are padded to the vector width.
+ */
+#define CACHE_TAG_VALID		(1U << 31)
+#define CACHE_TAG_WAYS		SIMD_U32_PAD(ICACHE_NUM_WAYS)
+
 struct cache_line {
 	union {
 		uint32_t data32[CACHE_OFFSET_SZ / sizeof(uint32_t)];
 		uint16_t data16[CACHE_OFFSET_SZ / sizeof(uint16_t)];
 		uint8_t data8[CACHE_OFFSET_SZ / sizeof(uint16_t)];
 	};
-	unsigned tag:CACHE_TAG_BITS;
-	unsigned valid:1;
 	unsigned dirty:1;
 };
 
 struct cache {
 	struct mem_map *mem;
+	uint32_t tags[CACHE_INDEX_SZ][CACHE_TAG_WAYS]
+		__attribute__((aligned(SIMD_U32_LANES * sizeof(uint32_t))));
 	struct cache_line lines[ICACHE_NUM_WAYS][CACHE_INDEX_SZ];
 	unsigned victimsel;
 };
@@ -39,8 +51,10 @@ struct cache *cache_new(struct mem_map *mem)
 {
 	struct cache *c = calloc(1, sizeof(*c));
 
-	if (c)
+	if (c) {
 		c->mem = mem;
+		checkpoint_register(c, sizeof(*c));
+	}
 
 	return c;
 }
@@ -66,7 +80,7 @@ void cache_inval_index(struct cache *cache, uint32_t indx)
 		unsigned way;
 
 		for (way = 0; way < ICACHE_NUM_WAYS; ++way) {
-			cache->lines[way][indx].valid = 0;
+			cache->tags[indx][way] = 0;
 			cache->lines[way][indx].dirty = 0;
 		}
 	}
@@ -80,16 +94,15 @@ void cache_inval_all(struct cache *cache)
 		unsigned way;
 
 		for (way = 0; way < ICACHE_NUM_WAYS; ++way) {
-			cache->lines[way][i].valid = 0;
+			cache->tags[i][way] = 0;
 			cache->lines[way][i].dirty = 0;
 		}
 	}
 }
 
-static int cache_fill_line(const struct cache *cache, struct cache_line *line,
-			   uint32_t addr)
+static int cache_fill_line(struct cache *cache, unsigned way, uint32_t addr)
 {
-	uint32_t tag = addr_tag(addr);
+	struct cache_line *line = &cache->lines[way][addr_index(addr)];
 	int rc = 0, br = 0;
 
 	for (br = 0; br < CACHE_OFFSET_SZ; br += sizeof(uint32_t)) {
@@ -99,40 +112,40 @@ static int cache_fill_line(const struct cache *cache, struct cache_line *line,
 			break;
 	}
 
-	line->valid = !rc;
 	line->dirty = 0;
-	line->tag = tag;
+	cache->tags[addr_index(addr)][way] = rc ? 0 :
+		addr_tag(addr) | CACHE_TAG_VALID;
 
 	return rc;
 }
 
-static struct cache_line *cache_find_line(struct cache *cache, uint32_t addr)
+/* Find the way that hits for addr, or the next victim. */
+static unsigned cache_find_way(struct cache *cache, uint32_t addr)
 {
-	unsigned way;
+	int way = simd_find_u32(cache->tags[addr_index(addr)], CACHE_TAG_WAYS,
+				addr_tag(addr) | CACHE_TAG_VALID);
 
-	/* Look for a cache hit. */
-	for (way = 0; way < ICACHE_NUM_WAYS; ++way) {
-		struct cache_line *line = &cache->lines[way][addr_index(addr)];
-		if (line->valid && line->tag == addr_tag(addr))
-			return line;
-	}
+	return way < 0 ? cache->victimsel : (unsigned)way;
+}
 
-	/* Return the next victim. */
-	return &cache->lines[cache->victimsel][addr_index(addr)];
+static bool cache_way_holds(const struct cache *cache, unsigned way,
+			    uint32_t indx, uint32_t tag)
+{
+	return cache->tags[indx][way] == (tag | CACHE_TAG_VALID);
 }
 
 int cache_read(struct cache *cache, uint32_t virt, uint32_t phys,
 	       unsigned int nr_bits, uint32_t *val)
 {
-	struct cache_line *line = cache_find_line(cache, virt);
-	uint32_t tag = addr_tag(phys);
+	unsigned way = cache_find_way(cache, virt);
+	struct cache_line *line = &cache->lines[way][addr_index(virt)];
 	uint32_t offs = addr_offs(virt);
 	int rc = 0;
 
-	if (!line->valid || tag != line->tag) {
+	if (!cache_way_holds(cache, way, addr_index(virt), addr_tag(phys))) {
 		cache_flush_index(cache, addr_index(virt));
 
-		rc = cache_fill_line(cache, line, phys & ~CACHE_OFFSET_MASK);
+		rc = cache_fill_line(cache, way, phys & ~CACHE_OFFSET_MASK);
 		if (rc != 0)
 			goto out;
 	}
@@ -160,13 +173,13 @@ out:
 int cache_write(struct cache *cache, uint32_t virt, uint32_t phys,
 		unsigned int nr_bits, uint32_t val)
 {
-	struct cache_line *line = cache_find_line(cache, virt);
-	uint32_t tag = addr_tag(phys);
+	unsigned way = cache_find_way(cache, virt);
+	struct cache_line *line = &cache->lines[way][addr_index(virt)];
 	uint32_t offs = addr_offs(virt);
 	int rc = 0;
 
 	/* No allocate on write. */
-	if (!line->valid || tag != line->tag)
+	if (!cache_way_holds(cache, way, addr_index(virt), addr_tag(phys)))
 		return mem_map_write(cache->mem, phys, nr_bits, val);
 
 	switch (nr_bits) {
@@ -198,8 +211,8 @@ int cache_flush_index(struct cache *cache, uint32_t indx)
 		return 0;
 
 	for (way = 0; way < ICACHE_NUM_WAYS; ++way) {
-		uint32_t addr = (cache->lines[way][indx].tag << CACHE_TAG_SHIFT) |
-			(indx << CACHE_INDEX_SHIFT);
+		uint32_t addr = ((cache->tags[indx][way] & ~CACHE_TAG_VALID) <<
+				 CACHE_TAG_SHIFT) | (indx << CACHE_INDEX_SHIFT);
 
 		if (!cache->lines[way][indx].dirty)
 			continue;
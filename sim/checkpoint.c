@@ -0,0 +1,246 @@
+/*
+ * Simulation checkpoints.
+ *
+ * A checkpoint is a copy of all of the registered device and CPU state plus
+ * an undo log of RAM.  RAM isn't copied when the checkpoint is taken, instead
+ * the first write to each page after the most recent checkpoint saves the
+ * original contents of the page into that checkpoint.  Restoring a checkpoint
+ * rolls back the undo logs of it and all newer checkpoints, which are then
+ * discarded as the run will diverge from them.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+#include "internal.h"
+#include "io.h"
+#include "list.h"
+
+struct state_region {
+	void *state;
+	size_t len;
+};
+
+struct ram_region {
+	uint8_t *mem;
+	size_t len;
+	/* A bit per page, set when the page is in the current undo log. */
+	unsigned long *saved;
+};
+
+struct saved_page {
+	struct list_head head;
+	void *addr;
+	uint8_t data[PAGE_SIZE];
+};
+
+struct checkpoint {
+	struct list_head head;
+	unsigned long long cycle;
+	uint8_t *state;
+	struct list_head pages;
+};
+
+#define BITS_PER_LONG		(sizeof(unsigned long) * 8)
+/*
+ * Each core registers itself, its caches and its TLBs even though
+ * checkpointing is single core only, so leave room for 16 cores and the
+ * devices.
+ */
+#define MAX_STATE_REGIONS	128
+#define MAX_RAM_REGIONS		8
+
+bool checkpoint_tracking;
+
+static struct state_region state_regions[MAX_STATE_REGIONS];
+static unsigned int nr_state_regions;
+static size_t state_size;
+static struct ram_region ram_regions[MAX_RAM_REGIONS];
+static unsigned int nr_ram_regions;
+static unsigned int nr_checkpoints;
+static DEFINE_LIST(checkpoints);
+
+void checkpoint_register(void *state, size_t len)
+{
+	assert(nr_state_regions < MAX_STATE_REGIONS);
+
+	state_regions[nr_state_regions++] = (struct state_region) {
+		.state = state,
+		.len = len,
+	};
+	state_size += len;
+}
+
+void checkpoint_register_ram(void *mem, size_t len)
+{
+	size_t nr_pages = len / PAGE_SIZE;
+	struct ram_region *r;
+
+	assert(nr_ram_regions < MAX_RAM_REGIONS);
+
+	r = &ram_regions[nr_ram_regions++];
+	r->mem = mem;
+	r->len = len;
+	r->saved = calloc((nr_pages + BITS_PER_LONG - 1) / BITS_PER_LONG,
+			  sizeof(unsigned long));
+	assert(r->saved);
+}
+
+void checkpoint_enable(void)
+{
+	checkpoint_tracking = true;
+}
+
+static void clear_saved_pages(void)
+{
+	unsigned int n;
+
+	for (n = 0; n < nr_ram_regions; ++n) {
+		struct ram_region *r = &ram_regions[n];
+		size_t nr_pages = r->len / PAGE_SIZE;
+
+		memset(r->saved, 0, ((nr_pages + BITS_PER_LONG - 1) /
+				     BITS_PER_LONG) * sizeof(unsigned long));
+	}
+}
+
+void __checkpoint_ram_write(void *addr)
+{
+	struct checkpoint *ck;
+	struct saved_page *page;
+	unsigned int n;
+
+	if (list_empty(&checkpoints))
+		return;
+
+	for (n = 0; n < nr_ram_regions; ++n) {
+		struct ram_region *r = &ram_regions[n];
+		size_t pfn;
+
+		if ((uint8_t *)addr < r->mem || (uint8_t *)addr >= r->mem + r->len)
+			continue;
+
+		pfn = ((uint8_t *)addr - r->mem) / PAGE_SIZE;
+		if (r->saved[pfn / BITS_PER_LONG] & (1UL << (pfn % BITS_PER_LONG)))
+			return;
+
+		ck = checkpoint_latest();
+		page = malloc(sizeof(*page));
+		assert(page);
+		page->addr = r->mem + pfn * PAGE_SIZE;
+		memcpy(page->data, page->addr, PAGE_SIZE);
+		list_add(&page->head, &ck->pages);
+		r->saved[pfn / BITS_PER_LONG] |= 1UL << (pfn % BITS_PER_LONG);
+
+		return;
+	}
+}
+
+struct checkpoint *checkpoint_take(unsigned long long cycle)
+{
+	struct checkpoint *ck = calloc(1, sizeof(*ck));
+	uint8_t *p;
+	unsigned int n;
+
+	assert(ck);
+	ck->cycle = cycle;
+	list_init(&ck->pages);
+	ck->state = p = malloc(state_size);
+	assert(ck->state);
+
+	for (n = 0; n < nr_state_regions; ++n) {
+		memcpy(p, state_regions[n].state, state_regions[n].len);
+		p += state_regions[n].len;
+	}
+
+	list_add_tail(&ck->head, &checkpoints);
+	++nr_checkpoints;
+	clear_saved_pages();
+
+	return ck;
+}
+
+static void free_pages(struct checkpoint *ck, bool undo)
+{
+	while (!list_empty(&ck->pages)) {
+		struct saved_page *page = container_of(ck->pages.next,
+						       struct saved_page, head);
+
+		if (undo)
+			memcpy(page->addr, page->data, PAGE_SIZE);
+		list_del(&page->head);
+		free(page);
+	}
+}
+
+static void checkpoint_free(struct checkpoint *ck)
+{
+	free_pages(ck, false);
+	list_del(&ck->head);
+	free(ck->state);
+	free(ck);
+	--nr_checkpoints;
+}
+
+void checkpoint_restore(struct checkpoint *ck)
+{
+	const uint8_t *p = ck->state;
+	unsigned int n;
+
+	while (checkpoint_latest() != ck) {
+		struct checkpoint *newer = checkpoint_latest();
+
+		free_pages(newer, true);
+		checkpoint_free(newer);
+	}
+	free_pages(ck, true);
+
+	for (n = 0; n < nr_state_regions; ++n) {
+		memcpy(state_regions[n].state, p, state_regions[n].len);
+		p += state_regions[n].len;
+	}
+
+	clear_saved_pages();
+}
+
+void checkpoint_discard_oldest(void)
+{
+	if (!list_empty(&checkpoints))
+		checkpoint_free(container_of(checkpoints.next,
+					     struct checkpoint, head));
+}
+
+void checkpoint_discard_all(void)
+{
+	while (!list_empty(&checkpoints))
+		checkpoint_discard_oldest();
+}
+
+struct checkpoint *checkpoint_latest(void)
+{
+	if (list_empty(&checkpoints))
+		return NULL;
+
+	return container_of(checkpoints.prev, struct checkpoint, head);
+}
+
+struct checkpoint *checkpoint_prev(struct checkpoint *ck)
+{
+	if (ck->head.prev == &checkpoints)
+		return NULL;
+
+	return container_of(ck->head.prev, struct checkpoint, head);
+}
+
+unsigned long long checkpoint_cycle(const struct checkpoint *ck)
+{
+	return ck->cycle;
+}
+
+unsigned int checkpoint_count(void)
+{
+	return nr_checkpoints;
+}
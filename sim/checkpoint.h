@@ -0,0 +1,37 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Simulation state for checkpointing.  Devices register the memory that
+ * holds their state when they are created, RAM is registered separately and
+ * saved a page at a time when written.
+ */
+void checkpoint_register(void *state, size_t len);
+void checkpoint_register_ram(void *mem, size_t len);
+
+extern bool checkpoint_tracking;
+
+void __checkpoint_ram_write(void *addr);
+
+static inline void checkpoint_ram_write(void *addr)
+{
+	if (checkpoint_tracking)
+		__checkpoint_ram_write(addr);
+}
+
+struct checkpoint;
+
+void checkpoint_enable(void);
+struct checkpoint *checkpoint_take(unsigned long long cycle);
+void checkpoint_restore(struct checkpoint *ck);
+void checkpoint_discard_oldest(void);
+void checkpoint_discard_all(void);
+struct checkpoint *checkpoint_latest(void);
+struct checkpoint *checkpoint_prev(struct checkpoint *ck);
+unsigned long long checkpoint_cycle(const struct checkpoint *ck);
+unsigned int checkpoint_count(void);
+
+#endif /* __CHECKPOINT_H__ */
@@ -1,6 +1,7 @@
 #define _GNU_SOURCE
 #include <assert.h>
 #include <err.h>
+#include <errno.h>
 #include <libgen.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -10,26 +11,25 @@
 #include <unistd.h>
 
 #include "cache.h"
+#include "checkpoint.h"
 #include "cpu.h"
 #include "internal.h"
 #include "irq_ctrl.h"
 #include "io.h"
 #include "microcode.h"
+#include "oldland-decode.h"
 #include "tlb.h"
 #include "trace.h"
 #include "oldland-types.h"
 #include "periodic.h"
 #include "sdcard.h"
+#include "soc.h"
 #include "spimaster.h"
 
 #ifndef ROM_FILE
 #define ROM_FILE NULL
 #endif
 
-#ifndef MICROCODE_FILE
-#define MICROCODE_FILE NULL
-#endif
-
 enum instruction_class {
 	INSTR_ARITHMETIC,
 	INSTR_BRANCH,
@@ -54,9 +54,17 @@ enum control_register {
 	CR_DATA_FAULT_ADDRESS	= 4,
         CR_DTLB_MISS_HANDLER    = 5,
         CR_ITLB_MISS_HANDLER    = 6,
+	CR_PTBR			= 7,
 	NUM_CONTROL_REGS
 };
 
+/* Page table walker, see docs/tlb.md for the table format. */
+#define PTBR_WALK_ENABLE	(1 << 0)
+#define PDE_VALID		(1 << 0)
+#define PTE_VALID		(1 << 4)
+#define PTE_PERMS_MASK		0xf
+#define PT_ADDR_MASK		~(PAGE_SIZE - 1)
+
 #define MICROCODE_NR_WORDS	(1 << 7)
 #define GPSR_SPSR_MASK          (0xf)
 
@@ -79,16 +87,20 @@ struct cpu {
 		} flagsbf;
 	};
 
+	unsigned int core_id;
+	unsigned int nr_cores;
+	bool stop_on_swi;
 	struct mem_map *mem;
 	FILE *trace_file;
 	unsigned long long cycle_count;
+	struct cpu_retire retire;
         uint32_t control_regs[NUM_CONTROL_REGS];
-	uint32_t ucode[MICROCODE_NR_WORDS];
 	bool irq_active;
 	struct event_list events;
 	struct irq_ctrl *irq_ctrl;
 	struct timer_base *timers;
         struct spimaster *spimaster;
+	struct debug_uart *uart;
 	struct cache *icache;
 	struct cache *dcache;
         struct tlb *dtlb;
@@ -102,6 +114,7 @@ enum cpuid_reg_names {
 	CPUID_ICACHE,
 	CPUID_DCACHE,
 	CPUID_TLB,
+	CPUID_CORE,
 };
 
 #define CPUID_ICACHE_VAL	((ICACHE_LINE_SIZE / sizeof(uint32_t)) | \
@@ -110,18 +123,39 @@ enum cpuid_reg_names {
 #define CPUID_DCACHE_VAL	((DCACHE_LINE_SIZE / sizeof(uint32_t)) | \
 				  ((1 << DCACHE_INDEX_BITS) << 8) | \
                                  (DCACHE_NUM_WAYS << 24))
-#define CPUID_TLB_VAL		((ITLB_NUM_ENTRIES << 16) | \
-				 (DTLB_NUM_ENTRIES))
 
 static const uint32_t cpuid_regs[] = {
-	[CPUID_VERSION]		= (CPUID_MANUFACTURER << 16) | CPUID_MODEL,
-	[CPUID_CORE_SPEED]	= CPU_CLOCK_SPEED,
 	[CPUID_FEATURES]	= 0,
 	[CPUID_ICACHE]		= CPUID_ICACHE_VAL,
 	[CPUID_DCACHE]		= CPUID_DCACHE_VAL,
-	[CPUID_TLB]		= CPUID_TLB_VAL,
+	[CPUID_CORE]		= 0,
 };
 
+/*
+ * The core register is the only per-core CPUID register: [7:0] is the number
+ * of this core and [15:8] the number of cores in the system.  The version,
+ * clock and TLB registers come from the board description, the caches always
+ * report the geometry that is simulated.
+ */
+static uint32_t cpuid_read(const struct cpu *c, unsigned int reg)
+{
+	const struct soc *soc = soc_get();
+
+	if (reg >= ARRAY_SIZE(cpuid_regs))
+		return 0;
+
+	if (reg == CPUID_CORE)
+		return c->core_id | (c->nr_cores << 8);
+	if (reg == CPUID_VERSION)
+		return (soc->manufacturer << 16) | soc->model;
+	if (reg == CPUID_CORE_SPEED)
+		return soc->clock_speed;
+	if (reg == CPUID_TLB)
+		return (soc->itlb_entries << 16) | soc->dtlb_entries;
+
+	return cpuid_regs[reg];
+}
+
 enum psr_flags {
 	PSR_Z	= (1 << 0),
 	PSR_C	= (1 << 1),
@@ -234,6 +268,33 @@ static void do_itlb_miss(struct cpu *c, uint32_t fault_address)
 	cpu_set_next_pc(c, c->control_regs[CR_ITLB_MISS_HANDLER]);
 }
 
+/*
+ * Walk the page tables for a TLB miss and install the mapping.  Returns
+ * non-zero if the walker is disabled or there is no valid mapping, in which
+ * case the miss is handled in software.  Table reads bypass the caches.
+ */
+static int walk_page_table(struct cpu *c, struct tlb *tlb, uint32_t virt)
+{
+	uint32_t ptbr = c->control_regs[CR_PTBR];
+	uint32_t pde, pte;
+
+	if (!(ptbr & PTBR_WALK_ENABLE))
+		return -1;
+
+	if (mem_map_read(c->mem, (ptbr & PT_ADDR_MASK) | ((virt >> 22) << 2),
+			 32, &pde) || !(pde & PDE_VALID))
+		return -1;
+	if (mem_map_read(c->mem, (pde & PT_ADDR_MASK) |
+			 (((virt >> 12) & 0x3ff) << 2), 32, &pte) ||
+	    !(pte & PTE_VALID))
+		return -1;
+
+	tlb_install(tlb, (virt & PT_ADDR_MASK) | (pte & PTE_PERMS_MASK),
+		    pte & PT_ADDR_MASK);
+
+	return 0;
+}
+
 static int translate_data_address(struct cpu *c,
 				  struct translation *translation)
 {
@@ -242,6 +303,8 @@ static int translate_data_address(struct cpu *c,
 
 	if (mmu_enabled(c)) {
 		int err = tlb_translate(c->dtlb, translation);
+		if (err && !walk_page_table(c, c->dtlb, translation->virt))
+			err = tlb_translate(c->dtlb, translation);
 		if (err) {
 			do_dtlb_miss(c, translation->virt);
 			return -1;
@@ -259,6 +322,8 @@ static int translate_instruction_address(struct cpu *c,
 
 	if (mmu_enabled(c)) {
 		int err = tlb_translate(c->itlb, translation);
+		if (err && !walk_page_table(c, c->itlb, translation->virt))
+			err = tlb_translate(c->itlb, translation);
 		if (err) {
 			do_itlb_miss(c, translation->virt);
 			return -1;
@@ -290,8 +355,9 @@ int cpu_read_mem(struct cpu *c, uint32_t addr, uint32_t *v, size_t nbits,
 
 	*tlb_miss = 0;
 
-	if (mem_map_addr_cacheable(c->mem, translation.phys) &&
-	    data_cache_enabled(c))
+	if (!mem_map_addr_cacheable(c->mem, translation.phys))
+		c->retire.io_load = true;
+	else if (data_cache_enabled(c))
 		return cache_read(c->dcache, addr, translation.phys, nbits,
 				  v);
 
@@ -365,107 +431,199 @@ static void cpu_wr_reg(struct cpu *c, enum regs r, uint32_t v)
 {
 	trace(c->trace_file, TRACE_R0 + r, v);
 	c->regs[r] = v;
+	c->retire.reg_written = true;
+	c->retire.rd = r;
+	c->retire.rd_val = v;
 }
 
-static int load_microcode(struct cpu *c, const char *path)
+/*
+ * Interrupts may be raised by another core's host thread (IPIs) so the flag
+ * is accessed atomically.
+ */
+static void cpu_raise_irq(void *data)
 {
-	FILE *fp = fopen(path, "r");
-	unsigned m = 0;
-
-	if (!fp)
-		return -1;
+	struct cpu *c = data;
 
-	while (!feof(fp)) {
-		/* microcode lines should be 8 hex chars + newline. */
-		char buf[16];
-		char *end;
-		uint32_t v;
+	__atomic_store_n(&c->irq_active, true, __ATOMIC_RELAXED);
+}
 
-		if (!fgets(buf, sizeof(buf), fp))
-			break;
+static void cpu_clear_irq(void *data)
+{
+	struct cpu *c = data;
 
-		v = strtoul(buf, &end, 16);
-		if (end == buf)
-			continue;
+	__atomic_store_n(&c->irq_active, false, __ATOMIC_RELAXED);
+}
 
-		if (m == MICROCODE_NR_WORDS)
-			errx(1, "malformed microcode file, too many words");
+/*
+ * Secondary cores share the memory map and devices of the boot core but have
+ * their own caches, TLBs and interrupt controller bank.
+ */
+static struct cpu *new_secondary_cpu(const struct cpu *boot_cpu,
+				     unsigned int core_id)
+{
+	struct cpu *c = calloc(1, sizeof(*c));
+	int err;
 
-		c->ucode[m++] = v;
-	}
+	assert(c);
+	checkpoint_register(c, sizeof(*c));
 
-	fclose(fp);
+	event_list_init(&c->events);
+	c->core_id = core_id;
+	c->nr_cores = boot_cpu->nr_cores;
+	c->stop_on_swi = boot_cpu->stop_on_swi;
+	c->mem = boot_cpu->mem;
+	c->irq_ctrl = boot_cpu->irq_ctrl;
+	c->timers = boot_cpu->timers;
+	c->spimaster = boot_cpu->spimaster;
+	c->uart = boot_cpu->uart;
+
+	if (!c->irq_ctrl)
+		die("secondary cores need an irq controller\n");
+	err = irq_ctrl_add_cpu(c->irq_ctrl, c);
+	assert(err == (int)core_id);
 
-	return 0;
-}
+	c->icache = cache_new(c->mem);
+	assert(c->icache);
 
-static void cpu_raise_irq(void *data)
-{
-	struct cpu *c = data;
+	c->dcache = cache_new(c->mem);
+	assert(c->dcache);
 
-	c->irq_active = true;
-}
+        c->dtlb = tlb_new(soc_get()->dtlb_entries);
+        assert(c->dtlb);
+        c->itlb = tlb_new(soc_get()->itlb_entries);
+        assert(c->itlb);
 
-static void cpu_clear_irq(void *data)
-{
-	struct cpu *c = data;
+	cpu_reset(c);
 
-	c->irq_active = false;
+	return c;
 }
 
 struct cpu *new_cpu(const char *binary, int flags,
 		    const char *bootrom_image,
 		    const char *sdcard_image)
 {
-	int err;
 	struct cpu *c;
+
+	new_cpus(&c, 1, binary, flags, bootrom_image, sdcard_image, NULL);
+
+	return c;
+}
+
+static uint32_t peripheral_irq(const struct soc_peripheral *p,
+			       unsigned int n, uint32_t def)
+{
+	return n < p->nr_irqs ? p->irqs[n] : def;
+}
+
+/*
+ * Instantiate the models for the peripherals in the board description.  The
+ * interrupt controller comes first as the other devices connect to it.
+ */
+static void add_peripherals(struct cpu *c, int flags, const char *binary,
+			    const char *bootrom_image,
+			    const char *sdcard_image, const char *sdram_image)
+{
+	const struct soc *soc = soc_get();
+	const struct soc_peripheral *p;
 	struct timer_init_data timer_data;
 	struct spislave **spislaves;
+	unsigned int m;
+	int err = 0;
 
-	c = calloc(1, sizeof(*c));
-	assert(c);
+	p = soc_find(soc, "irq");
+	if (p) {
+		c->irq_ctrl = irq_ctrl_init(c->mem, p->address, p->size,
+					    cpu_raise_irq, cpu_clear_irq, c);
+		assert(c->irq_ctrl != NULL);
+	}
 
-	if (!(flags & CPU_NOTRACE))
-		c->trace_file = init_trace_file();
+	for (m = 0; m < soc->nr_peripherals; ++m) {
+		p = &soc->peripherals[m];
 
-	event_list_init(&c->events);
+		if (!strcmp(p->name, "irq"))
+			continue;
 
-	c->mem = mem_map_new();
-	assert(c->mem);
+		if (!c->irq_ctrl && (!strcmp(p->name, "uart") ||
+				     !strcmp(p->name, "timer") ||
+				     !strcmp(p->name, "spimaster")))
+			die("%s needs an irq controller\n", p->name);
+
+		if (!strcmp(p->name, "ram")) {
+			err = ram_init(c->mem, p->address, p->size, binary);
+		} else if (!strcmp(p->name, "bootrom")) {
+			err = rom_init(c->mem, p->address, p->size,
+				       bootrom_image);
+		} else if (!strcmp(p->name, "sdram")) {
+			err = ram_init(c->mem, p->address, p->size,
+				       sdram_image);
+		} else if (!strcmp(p->name, "sdram_ctrl")) {
+			err = sdram_ctrl_init(c->mem, p->address, p->size);
+		} else if (!strcmp(p->name, "uart")) {
+			c->uart = debug_uart_init(c->mem, p->address, p->size,
+						  &c->events, c->irq_ctrl,
+						  peripheral_irq(p, 0, UART_IRQ),
+						  !(flags & CPU_NO_HOST_IO));
+			assert(c->uart != NULL);
+		} else if (!strcmp(p->name, "timer")) {
+			timer_data = (struct timer_init_data) {
+				.irq_ctrl = c->irq_ctrl,
+				.irqs = {
+					peripheral_irq(p, 0, TIMER_IRQ),
+					peripheral_irq(p, 1, TIMER_IRQ + 1),
+					peripheral_irq(p, 2, TIMER_IRQ + 2),
+					peripheral_irq(p, 3, TIMER_IRQ + 3),
+				},
+			};
+			c->timers = timers_init(c->mem, p->address, p->size,
+						&c->events, &timer_data);
+			assert(c->timers);
+		} else if (!strcmp(p->name, "spimaster")) {
+			spislaves = calloc(1, sizeof(*spislaves));
+			assert(spislaves != NULL);
+			if (sdcard_image)
+				spislaves[0] = sdcard_new(sdcard_image);
+			c->spimaster = spimaster_init(c->mem, p->address,
+						      p->size, &c->events,
+						      c->irq_ctrl,
+						      peripheral_irq(p, 0,
+							SPIMASTER_IRQ),
+						      spislaves, 1);
+			if (!c->spimaster)
+				err = -EINVAL;
+		} else {
+			warnx("no model for %s, leaving it unmapped", p->name);
+		}
 
-	err = ram_init(c->mem, RAM_ADDRESS, RAM_SIZE, binary);
-	assert(!err);
+		if (err)
+			die("failed to add %s at %#x\n", p->name, p->address);
+	}
+}
 
-	err = rom_init(c->mem, BOOTROM_ADDRESS, BOOTROM_SIZE, bootrom_image);
-	assert(!err);
+void new_cpus(struct cpu **cpus, unsigned int nr_cores, const char *binary,
+	      int flags, const char *bootrom_image, const char *sdcard_image,
+	      const char *sdram_image)
+{
+	unsigned int n;
+	struct cpu *c;
 
-	err = ram_init(c->mem, SDRAM_ADDRESS, SDRAM_SIZE, NULL);
-	assert(!err);
+	assert(nr_cores > 0);
 
-	err = sdram_ctrl_init(c->mem, SDRAM_CTRL_ADDRESS, SDRAM_CTRL_SIZE);
-	assert(!err);
+	c = calloc(1, sizeof(*c));
+	assert(c);
+	checkpoint_register(c, sizeof(*c));
 
-	err = debug_uart_init(c->mem, UART_ADDRESS, UART_SIZE);
-	assert(!err);
+	if (!(flags & CPU_NOTRACE))
+		c->trace_file = init_trace_file();
 
-	c->irq_ctrl = irq_ctrl_init(c->mem, IRQ_ADDRESS, cpu_raise_irq,
-				    cpu_clear_irq, c);
-	assert(c->irq_ctrl != NULL);
+	event_list_init(&c->events);
+	c->nr_cores = nr_cores;
+	c->stop_on_swi = !!(flags & CPU_STOP_ON_SWI);
 
-	timer_data = (struct timer_init_data) {
-		.irq_ctrl = c->irq_ctrl,
-		.irqs = { 0, 1, 2, 3 },
-	};
-	c->timers = timers_init(c->mem, TIMER_ADDRESS, &c->events, &timer_data);
-	assert(c->timers);
+	c->mem = mem_map_new();
+	assert(c->mem);
 
-	spislaves = calloc(1, sizeof(*spislaves));
-	assert(spislaves != NULL);
-	if (sdcard_image)
-		spislaves[0] = sdcard_new(sdcard_image);
-	c->spimaster = spimaster_init(c->mem, SPIMASTER_ADDRESS, spislaves,
-				      ARRAY_SIZE(spislaves));
-        assert(c->spimaster);
+	add_peripherals(c, flags, binary, bootrom_image, sdcard_image,
+			sdram_image);
 
 	c->icache = cache_new(c->mem);
 	assert(c->icache);
@@ -473,17 +631,19 @@ struct cpu *new_cpu(const char *binary, int flags,
 	c->dcache = cache_new(c->mem);
 	assert(c->dcache);
 
-        c->dtlb = tlb_new(DTLB_NUM_ENTRIES);
+        c->dtlb = tlb_new(soc_get()->dtlb_entries);
         assert(c->dtlb);
-        c->itlb = tlb_new(ITLB_NUM_ENTRIES);
+        c->itlb = tlb_new(soc_get()->itlb_entries);
         assert(c->itlb);
 
-	err = load_microcode(c, MICROCODE_FILE);
-	assert(!err);
-
 	cpu_reset(c);
 
-	return c;
+	cpus[0] = c;
+	for (n = 1; n < nr_cores; ++n)
+		cpus[n] = new_secondary_cpu(c, n);
+
+	if (nr_cores > 1)
+		mem_map_set_shared(c->mem);
 }
 
 static void do_vector(struct cpu *c, enum exception_vector vector)
@@ -496,16 +656,25 @@ static void do_vector(struct cpu *c, enum exception_vector vector)
 	cpu_set_next_pc(c, c->control_regs[CR_VECTOR_ADDRESS] | vector);
 }
 
-static int cpu_mem_map_write(struct cpu *c, physaddr_t addr,
+/*
+ * Stores are recorded for the retire effects with the virtual address, as the
+ * RTL's memory stage sees it.  cpu_write_mem() does the translation.
+ */
+static int cpu_mem_map_write(struct cpu *c, uint32_t virt,
 			     unsigned int nr_bits, uint32_t val)
 {
-	trace(c->trace_file, TRACE_DADDR, addr);
+	trace(c->trace_file, TRACE_DADDR, virt);
 	trace(c->trace_file, TRACE_DOUT, val);
+	c->retire.stored = true;
+	c->retire.store_addr = virt;
+	c->retire.store_val = val;
+	c->retire.store_bits = nr_bits;
 
-	return cpu_write_mem(c, addr, val, nr_bits);
+	return cpu_write_mem(c, virt, val, nr_bits);
 }
 
-static uint32_t fetch_op1(struct cpu *c, uint32_t instr, uint32_t ucode)
+static __always_inline uint32_t fetch_op1(struct cpu *c, uint32_t instr,
+					  uint32_t ucode)
 {
 	if (ucode_op1ra(ucode))
 		return c->regs[instr_ra(instr)];
@@ -515,7 +684,8 @@ static uint32_t fetch_op1(struct cpu *c, uint32_t instr, uint32_t ucode)
 		return c->pc + 4;
 }
 
-static uint32_t fetch_op2(struct cpu *c, uint32_t instr, uint32_t ucode)
+static __always_inline uint32_t fetch_op2(struct cpu *c, uint32_t instr,
+					  uint32_t ucode)
 {
 	if (ucode_op2rb(ucode))
 		return c->regs[instr_rb(instr)];
@@ -587,8 +757,8 @@ struct alu_result {
 	uint32_t mem_write_val;
 };
 
-static void do_alu(struct cpu *c, uint32_t instr, uint32_t ucode,
-		   struct alu_result *alu)
+static __always_inline void do_alu(struct cpu *c, uint32_t instr,
+				   uint32_t ucode, struct alu_result *alu)
 {
 	uint64_t op1 = fetch_op1(c, instr, ucode);
 	uint64_t op2 = fetch_op2(c, instr, ucode);
@@ -686,10 +856,7 @@ static void do_alu(struct cpu *c, uint32_t instr, uint32_t ucode,
 		alu->alu_q = op1;
 		break;
 	case ALU_OPCODE_CPUID:
-		if (op2 >= ARRAY_SIZE(cpuid_regs))
-			alu->alu_q = 0;
-		else
-			alu->alu_q = cpuid_regs[op2];
+		alu->alu_q = cpuid_read(c, op2);
 		break;
         case ALU_OPCODE_GPSR:
                 alu->alu_q = current_psr(c) & GPSR_SPSR_MASK;
@@ -699,7 +866,8 @@ static void do_alu(struct cpu *c, uint32_t instr, uint32_t ucode,
 	alu->mem_write_val = c->regs[instr_rb(instr)];
 }
 
-static bool branch_taken(const struct cpu *c, uint32_t instr, uint32_t ucode)
+static __always_inline bool branch_taken(const struct cpu *c, uint32_t instr,
+					 uint32_t ucode)
 {
 	if (instr_class(instr) != INSTR_BRANCH)
 		return false;
@@ -708,8 +876,9 @@ static bool branch_taken(const struct cpu *c, uint32_t instr, uint32_t ucode)
 		 ucode_swi(ucode) || ucode_rfe(ucode);
 }
 
-static void commit_alu(struct cpu *c, uint32_t instr, uint32_t ucode,
-		       const struct alu_result *alu)
+static __always_inline void commit_alu(struct cpu *c, uint32_t instr,
+				       uint32_t ucode,
+				       const struct alu_result *alu)
 {
 	if (ucode_upc(ucode))
 		c->flagsbf.c = alu->alu_c;
@@ -728,8 +897,9 @@ static void commit_alu(struct cpu *c, uint32_t instr, uint32_t ucode,
 	}
 }
 
-static void process_branch(struct cpu *c, uint32_t instr, uint32_t ucode,
-			   const struct alu_result *alu)
+static __always_inline void process_branch(struct cpu *c, uint32_t instr,
+					   uint32_t ucode,
+					   const struct alu_result *alu)
 {
 	if (branch_taken(c, instr, ucode))
 		cpu_set_next_pc(c, alu->alu_q);
@@ -745,8 +915,8 @@ static void process_branch(struct cpu *c, uint32_t instr, uint32_t ucode,
 	}
 }
 
-static void do_scr(struct cpu *c, uint32_t instr, uint32_t ucode,
-		   const struct alu_result *alu)
+static __always_inline void do_scr(struct cpu *c, uint32_t instr,
+				   uint32_t ucode, const struct alu_result *alu)
 {
 	unsigned cr_sel = (instr >> 12) & 0x7;
 
@@ -761,8 +931,9 @@ static void do_scr(struct cpu *c, uint32_t instr, uint32_t ucode,
 		set_psr(c, c->control_regs[CR_PSR]);
 }
 
-static void do_spsr(struct cpu *c, uint32_t instr, uint32_t ucode,
-                    const struct alu_result *alu)
+static __always_inline void do_spsr(struct cpu *c, uint32_t instr,
+				    uint32_t ucode,
+				    const struct alu_result *alu)
 {
         uint32_t cr1 = c->control_regs[CR_PSR];
 
@@ -775,7 +946,7 @@ static void do_spsr(struct cpu *c, uint32_t instr, uint32_t ucode,
         set_psr(c, c->control_regs[CR_PSR]);
 }
 
-static unsigned maw_to_bits(enum maw maw)
+static __always_inline unsigned maw_to_bits(enum maw maw)
 {
 	switch (maw) {
 	case MAW_8:
@@ -789,8 +960,9 @@ static unsigned maw_to_bits(enum maw maw)
 	}
 }
 
-static int do_memory(struct cpu *c, uint32_t instr, uint32_t ucode,
-		     const struct alu_result *alu)
+static __always_inline int do_memory(struct cpu *c, uint32_t instr,
+				     uint32_t ucode,
+				     const struct alu_result *alu)
 {
 	uint32_t v, addr = alu->alu_q;
 	int err = 0;
@@ -857,17 +1029,16 @@ static bool instr_is_breakpoint(uint32_t instr)
 	return true;
 }
 
-static void emul_insn(struct cpu *c, uint32_t instr, bool *breakpoint_hit)
+/*
+ * Executes an instruction for a constant microcode word: each decode ROM entry
+ * gets its own copy from OLDLAND_DECODE_TABLE so the microcode tests are
+ * resolved at compile time.
+ */
+static __always_inline void emul_ucode(struct cpu *c, uint32_t instr,
+				       uint32_t ucode, bool *breakpoint_hit)
 {
-	/* 7 MSB's are the microcode address. */
-	uint32_t ucode = c->ucode[instr >> (32 - 7)];
 	struct alu_result alu = {};
 
-	if (c->irq_active && c->flagsbf.i) {
-		do_vector(c, VECTOR_IRQ);
-		return;
-	}
-
 	if (!ucode_valid(ucode) ||
 	    (ucode_priv(ucode) && c->flagsbf.u)) {
 		do_vector(c, VECTOR_ILLEGAL_INSTR);
@@ -877,13 +1048,51 @@ static void emul_insn(struct cpu *c, uint32_t instr, bool *breakpoint_hit)
 	if (instr_is_breakpoint(instr))
 		*breakpoint_hit = true;
 
+	/* Headless runs can use swi to exit, stop without taking it. */
+	if (c->stop_on_swi && ucode_swi(ucode)) {
+		*breakpoint_hit = true;
+		return;
+	}
+
 	do_alu(c, instr, ucode, &alu);
 	commit_alu(c, instr, ucode, &alu);
 	process_branch(c, instr, ucode, &alu);
 	do_scr(c, instr, ucode, &alu);
         do_spsr(c, instr, ucode, &alu);
 	do_memory(c, instr, ucode, &alu);
+}
+
+typedef void (*emul_fn)(struct cpu *c, uint32_t instr, bool *breakpoint_hit);
 
+#define DEFINE_EMUL(address, ucode)					\
+static void emul_##address(struct cpu *c, uint32_t instr,		\
+			   bool *breakpoint_hit)			\
+{									\
+	emul_ucode(c, instr, ucode, breakpoint_hit);			\
+}
+OLDLAND_DECODE_TABLE(DEFINE_EMUL)
+
+static void emul_illegal(struct cpu *c, uint32_t instr, bool *breakpoint_hit)
+{
+	do_vector(c, VECTOR_ILLEGAL_INSTR);
+}
+
+/* Indexed by the 7 MSB's of the instruction, the microcode address. */
+#define EMUL_ENTRY(address, ucode)	[address] = emul_##address,
+static const emul_fn emul_table[MICROCODE_NR_WORDS] = {
+	[0 ... MICROCODE_NR_WORDS - 1] = emul_illegal,
+	OLDLAND_DECODE_TABLE(EMUL_ENTRY)
+};
+
+static void emul_insn(struct cpu *c, uint32_t instr, bool *breakpoint_hit)
+{
+	if (__atomic_load_n(&c->irq_active, __ATOMIC_RELAXED) &&
+	    c->flagsbf.i) {
+		do_vector(c, VECTOR_IRQ);
+		return;
+	}
+
+	emul_table[instr >> (32 - 7)](c, instr, breakpoint_hit);
 }
 
 static int instruction_read(struct cpu *c, uint32_t phys, uint32_t *instr)
@@ -901,12 +1110,21 @@ int cpu_cycle(struct cpu *c, bool *breakpoint_hit)
 		.phys = c->pc,
 	};
 
-	event_list_tick(&c->events);
+	/*
+	 * With multiple cores the devices are advanced at the end of each
+	 * quantum instead.
+	 */
+	if (c->nr_cores == 1)
+		event_list_tick(&c->events);
 
 	c->next_pc = c->pc + 4;
+	c->retire = (struct cpu_retire) {
+		.pc = c->pc,
+	};
 
 	if (c->trace_file)
-		fprintf(c->trace_file, "#%llu\n", c->cycle_count++);
+		fprintf(c->trace_file, "#%llu\n", c->cycle_count);
+	++c->cycle_count;
 	trace(c->trace_file, TRACE_PC, c->pc);
 
 	/*
@@ -921,6 +1139,7 @@ int cpu_cycle(struct cpu *c, bool *breakpoint_hit)
 	}
 	if (c->trace_file)
 		trace(c->trace_file, TRACE_INSTR, instr);
+	c->retire.instr = instr;
 
 	emul_insn(c, instr, breakpoint_hit);
 
@@ -937,19 +1156,31 @@ void cpu_cache_sync(struct cpu *cpu)
 	cache_inval_all(cpu->icache);
 }
 
-uint32_t cpu_cpuid(unsigned int reg)
+uint32_t cpu_cpuid(const struct cpu *c, unsigned int reg)
 {
-	if (reg >= ARRAY_SIZE(cpuid_regs))
-		return 0;
+	return cpuid_read(c, reg);
+}
 
-	return cpuid_regs[reg];
+struct event_list *cpu_events(struct cpu *c)
+{
+	return &c->events;
+}
+
+const unsigned long long *cpu_cycle_counter(const struct cpu *c)
+{
+	return &c->cycle_count;
+}
+
+const struct cpu_retire *cpu_last_retire(const struct cpu *c)
+{
+	return &c->retire;
 }
 
 void cpu_reset(struct cpu *c)
 {
 	int r;
 
-	c->pc = c->next_pc = BOOTROM_ADDRESS;
+	c->pc = c->next_pc = soc_find(soc_get(), "bootrom")->address;
 	for (r = 0; r <= LR; ++r)
 		c->regs[r] = 0;
 	c->flagsw = 0;
@@ -958,8 +1189,17 @@ void cpu_reset(struct cpu *c)
 	for (r = 0; r < NUM_CONTROL_REGS; ++r)
 		c->control_regs[r] = 0;
 	c->irq_active = false;
-	irq_ctrl_reset(c->irq_ctrl);
-	timers_reset(c->timers);
+	if (c->core_id == 0) {
+		/* A board description may leave any of these out. */
+		if (c->irq_ctrl)
+			irq_ctrl_reset(c->irq_ctrl);
+		if (c->timers)
+			timers_reset(c->timers);
+		if (c->spimaster)
+			spimaster_reset(c->spimaster);
+		if (c->uart)
+			debug_uart_reset(c->uart);
+	}
 	cache_inval_all(c->icache);
 	cache_inval_all(c->dcache);
 	tlb_inval(c->dtlb);
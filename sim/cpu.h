@@ -6,6 +6,7 @@
 #include <stdint.h>
 
 struct mem_map;
+struct event_list;
 
 enum regs {
 	R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10, R11, R12, FP, SP, LR, PC,
@@ -14,11 +15,35 @@ enum regs {
 
 enum cpu_flags {
 	CPU_NOTRACE = 1 << 0,
+	CPU_STOP_ON_SWI = 1 << 1,	/* swi stops the CPU like bkp. */
+	CPU_NO_HOST_IO = 1 << 2,	/* Devices don't use host fds. */
+};
+
+/*
+ * Architectural effects of the last instruction executed by cpu_cycle(), for
+ * comparing against another model.
+ */
+struct cpu_retire {
+	uint32_t pc;
+	uint32_t instr;
+	bool reg_written;
+	unsigned int rd;
+	uint32_t rd_val;
+	/* The register was loaded from a device rather than memory. */
+	bool io_load;
+	bool stored;
+	/* Virtual address, before TLB translation. */
+	uint32_t store_addr;
+	uint32_t store_val;
+	unsigned int store_bits;
 };
 
 struct cpu *new_cpu(const char *binary, int flags,
 		    const char *bootrom_image,
 		    const char *sdcard_image);
+void new_cpus(struct cpu **cpus, unsigned int nr_cores, const char *binary,
+	      int flags, const char *bootrom_image, const char *sdcard_image,
+	      const char *sdram_image);
 int cpu_cycle(struct cpu *c, bool *breakpoint_hit);
 int cpu_read_reg(struct cpu *c, unsigned regnum, uint32_t *v);
 int cpu_write_reg(struct cpu *c, unsigned regnum, uint32_t v);
@@ -27,6 +52,9 @@ int cpu_read_mem(struct cpu *c, uint32_t addr, uint32_t *v, size_t nbits,
 int cpu_write_mem(struct cpu *c, uint32_t addr, uint32_t v, size_t nbits);
 void cpu_reset(struct cpu *c);
 void cpu_cache_sync(struct cpu *cpu);
-uint32_t cpu_cpuid(unsigned int reg);
+uint32_t cpu_cpuid(const struct cpu *c, unsigned int reg);
+struct event_list *cpu_events(struct cpu *c);
+const unsigned long long *cpu_cycle_counter(const struct cpu *c);
+const struct cpu_retire *cpu_last_retire(const struct cpu *c);
 
 #endif /* __CPU_H__ */
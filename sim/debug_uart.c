@@ -1,59 +1,166 @@
+/*
+ * UART with receive and transmit FIFOs.  The transmitter drains as soon as a
+ * character is written so the transmit FIFO is always empty, and output is
+ * batched into a host buffer.  Input is read by the host I/O thread and moved
+ * into the receive FIFO periodically.
+ *
+ * Register map:
+ *   - 0: data, writes transmit a character, reads pop the receive FIFO.
+ *   - 4: status:
+ *        - [0]: transmit FIFO empty.
+ *        - [1]: receive FIFO not empty.
+ *        - [2]: transmit FIFO full.
+ *   - 8: control:
+ *        - [0]: interrupt while the receive FIFO is not empty.
+ *        - [1]: interrupt while the transmit FIFO is empty.
+ */
 #include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "checkpoint.h"
+#include "hostio.h"
 #include "internal.h"
 #include "io.h"
+#include "irq_ctrl.h"
+#include "periodic.h"
+#include "replay.h"
 #include "uart.h"
 
-static int uart_write(unsigned int offs, uint32_t val, size_t nr_bits,
-		      void *priv)
+#define UART_FIFO_SIZE		16
+#define UART_HOST_BUF_SIZE	4096
+/* Host output is flushed and input collected at this interval. */
+#define UART_HOST_POLL_CYCLES	10000
+
+/* Host state, kept out of checkpoints. */
+struct uart_host {
+	struct uart_data data;
+	struct hostio_queue *input;
+	char out[UART_HOST_BUF_SIZE];
+	size_t out_len;
+};
+
+struct debug_uart {
+	struct uart_host *host;
+	struct event *event;
+	struct irq_ctrl *irq_ctrl;
+	unsigned int irq;
+	uint32_t control;
+	uint8_t rx_fifo[UART_FIFO_SIZE];
+	unsigned int rx_head;
+	unsigned int rx_count;
+};
+
+static struct uart_host *uart_host;
+
+static void uart_update_irq(struct debug_uart *u)
+{
+	/* The transmit FIFO is always empty. */
+	if ((u->control & TX_IRQ_ENABLE_MASK) ||
+	    ((u->control & RX_IRQ_ENABLE_MASK) && u->rx_count))
+		irq_ctrl_raise_irq(u->irq_ctrl, u->irq);
+	else
+		irq_ctrl_clear_irq(u->irq_ctrl, u->irq);
+}
+
+static void uart_host_flush(struct uart_host *h)
+{
+	size_t pos = 0;
+
+	while (h->data.fd >= 0 && pos < h->out_len) {
+		ssize_t bw = write(h->data.fd, h->out + pos, h->out_len - pos);
+
+		if (bw <= 0)
+			break;
+		pos += bw;
+	}
+	h->out_len = 0;
+}
+
+void debug_uart_flush(void)
+{
+	if (uart_host)
+		uart_host_flush(uart_host);
+}
+
+static void uart_rx_push(struct debug_uart *u, uint8_t c)
 {
-	struct uart_data *u = priv;
-	char c = val & 0xff;
-	ssize_t bw;
+	u->rx_fifo[(u->rx_head + u->rx_count) % UART_FIFO_SIZE] = c;
+	u->rx_count++;
+}
+
+static void uart_host_poll(struct debug_uart *u)
+{
+	uint8_t buf[UART_FIFO_SIZE];
+	unsigned int room = UART_FIFO_SIZE - u->rx_count;
+	size_t m, br;
+
+	if (replay_playing()) {
+		while (room-- && replay_pending(REPLAY_EV_UART_DATA))
+			uart_rx_push(u, replay_input(REPLAY_EV_UART_DATA, 0));
+		return;
+	}
+
+	if (!u->host->input)
+		return;
+
+	br = hostio_read(u->host->input, buf, room);
+	for (m = 0; m < br; ++m)
+		uart_rx_push(u, replay_input(REPLAY_EV_UART_DATA, buf[m]));
+}
+
+static void uart_event(struct event *event)
+{
+	struct debug_uart *u = event->cookie;
+
+	uart_host_flush(u->host);
+	uart_host_poll(u);
+	uart_update_irq(u);
+}
+
+int debug_uart_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		     void *priv)
+{
+	struct debug_uart *u = priv;
+	struct uart_host *h = u->host;
 
 	if (nr_bits != 32)
 		return -EFAULT;
 
 	if (offs == UART_DATA_REG_OFFS) {
-		bw = write(u->fd, &c, 1);
-		(void)bw;
+		if (h->out_len == sizeof(h->out))
+			uart_host_flush(h);
+		h->out[h->out_len++] = val & 0xff;
+	} else if (offs == UART_CONTROL_REG_OFFS) {
+		u->control = val & (RX_IRQ_ENABLE_MASK | TX_IRQ_ENABLE_MASK);
+		uart_update_irq(u);
 	}
 
 	return 0;
 }
 
-static int uart_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-		     void *priv)
+int debug_uart_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		    void *priv)
 {
-	struct uart_data *u = priv;
-	uint32_t regval= 0;
+	struct debug_uart *u = priv;
+	uint32_t regval = 0;
 
 	if (nr_bits != 32)
 		return -EFAULT;
 
 	if (offs == UART_STATUS_REG_OFFS) {
-		struct pollfd pfd = {
-			.fd = u->fd,
-			.events = POLLIN | POLLOUT,
-		};
-
-		if (poll(&pfd, 1, 0)) {
-			if (pfd.revents & POLLIN)
-				regval |= RX_READY_MASK;
-			if (pfd.revents & POLLOUT)
-				regval |= TX_EMPTY_MASK;
-		}
-	} else if (offs == UART_DATA_REG_OFFS) {
-		char c = 0;
-
-		if (read(u->fd, &c, 1) == 1)
-			regval = c;
+		regval = TX_EMPTY_MASK;
+		if (u->rx_count)
+			regval |= RX_READY_MASK;
+	} else if (offs == UART_DATA_REG_OFFS && u->rx_count) {
+		regval = u->rx_fifo[u->rx_head];
+		u->rx_head = (u->rx_head + 1) % UART_FIFO_SIZE;
+		u->rx_count--;
+		uart_update_irq(u);
+	} else if (offs == UART_CONTROL_REG_OFFS) {
+		regval = u->control;
 	}
 
 	*val = regval;
@@ -62,27 +169,55 @@ static int uart_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 }
 
 static const struct io_ops uart_io_ops = {
-	.write = uart_write,
-	.read = uart_read,
+	.type = IO_UART,
+	.write = debug_uart_write,
+	.read = debug_uart_read,
 };
 
-int debug_uart_init(struct mem_map *mem, physaddr_t base, size_t len)
+struct debug_uart *debug_uart_init(struct mem_map *mem, physaddr_t base,
+				   size_t len, struct event_list *events,
+				   struct irq_ctrl *irq_ctrl, unsigned int irq,
+				   bool host_io)
 {
 	struct region *r;
-	struct uart_data *u;
+	struct debug_uart *u;
 
-	u = malloc(sizeof(*u));
+	u = calloc(1, sizeof(*u));
 	assert(u);
-
-	if (sim_is_interactive()) {
-		u->fd = create_pts();
-		assert(u->fd >= 0);
+	checkpoint_register(u, sizeof(*u));
+
+	u->host = calloc(1, sizeof(*u->host));
+	assert(u->host);
+	if (!host_io) {
+		/* A reference model: output is dropped and input never arrives. */
+		u->host->data.fd = -1;
+	} else if (sim_is_interactive() && !replay_playing()) {
+		u->host->data.fd = create_pts();
+		assert(u->host->data.fd >= 0);
 	} else {
-		u->fd = STDOUT_FILENO;
+		u->host->data.fd = STDOUT_FILENO;
 	}
+	if (host_io && !replay_playing())
+		u->host->input = hostio_add_input(u->host->data.fd);
+
+	u->irq_ctrl = irq_ctrl;
+	u->irq = irq;
+	u->event = event_new(events, UART_HOST_POLL_CYCLES, uart_event, u);
+	assert(u->event != NULL);
+	event_enable(u->event);
 
 	r = mem_map_region_add(mem, base, len, &uart_io_ops, u, 0);
 	assert(r != NULL);
 
-	return 0;
+	uart_host = u->host;
+	atexit(debug_uart_flush);
+
+	return u;
+}
+
+void debug_uart_reset(struct debug_uart *u)
+{
+	u->control = 0;
+	u->rx_head = u->rx_count = 0;
+	uart_update_irq(u);
 }
@@ -0,0 +1,196 @@
+/*
+ * Host input for devices.
+ *
+ * A single thread waits on the host fds of all devices with epoll and reads
+ * whatever arrives into a single producer, single consumer ring per device.
+ * Devices collect the input from their periodic events, so the simulation
+ * thread doesn't poll the host.  Each fd is armed with EPOLLONESHOT: the
+ * thread re-arms it after reading unless the ring is full, in which case the
+ * consumer re-arms it once it has made space.
+ *
+ * A pts master reports a hangup until something opens the slave, so fds that
+ * hang up are retried periodically rather than dropped.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+
+#include "hostio.h"
+#include "internal.h"
+
+#define HOSTIO_QUEUE_SIZE	4096
+#define HOSTIO_MAX_QUEUES	8
+#define HOSTIO_HANGUP_RETRY_MS	100
+
+struct hostio_queue {
+	int fd;
+	/* Free running, the consumer owns head and the producer owns tail. */
+	unsigned int head;
+	unsigned int tail;
+	bool stalled;
+	bool hangup;
+	uint8_t buf[HOSTIO_QUEUE_SIZE];
+};
+
+static struct {
+	pthread_once_t once;
+	int epoll_fd;
+	struct hostio_queue *queues[HOSTIO_MAX_QUEUES];
+	unsigned int nr_queues;
+} hostio = {
+	.once = PTHREAD_ONCE_INIT,
+};
+
+static int hostio_arm(struct hostio_queue *q, int op)
+{
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLONESHOT,
+		.data.ptr = q,
+	};
+
+	return epoll_ctl(hostio.epoll_fd, op, q->fd, &event);
+}
+
+/* Returns true if the fd hung up and needs to be retried. */
+static bool hostio_fill(struct hostio_queue *q, uint32_t revents)
+{
+	unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	unsigned int tail = q->tail;
+	unsigned int offs = tail % HOSTIO_QUEUE_SIZE;
+	size_t room = HOSTIO_QUEUE_SIZE - (tail - head);
+	ssize_t br = 0;
+
+	if (room > HOSTIO_QUEUE_SIZE - offs)
+		room = HOSTIO_QUEUE_SIZE - offs;
+
+	/* Only read once, the fd may be blocking. */
+	if (revents & EPOLLIN)
+		br = read(q->fd, q->buf + offs, room);
+	if (br > 0) {
+		__atomic_store_n(&q->tail, tail + br, __ATOMIC_RELEASE);
+	} else if (revents & EPOLLHUP) {
+		q->hangup = true;
+		return true;
+	} else if (br == 0 || (revents & EPOLLERR)) {
+		/* End of file or not readable at all, stop watching it. */
+		epoll_ctl(hostio.epoll_fd, EPOLL_CTL_DEL, q->fd, NULL);
+		return false;
+	}
+
+	if (tail + br - head == HOSTIO_QUEUE_SIZE) {
+		/*
+		 * The consumer may have emptied it before seeing stalled.  This
+		 * store then load pairs with the head store then stalled load
+		 * in hostio_read(), and both need to be sequentially consistent
+		 * so that at least one side sees the other's store.
+		 */
+		__atomic_store_n(&q->stalled, true, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&q->head, __ATOMIC_SEQ_CST) == head ||
+		    !__atomic_exchange_n(&q->stalled, false, __ATOMIC_ACQ_REL))
+			return false;
+	}
+
+	hostio_arm(q, EPOLL_CTL_MOD);
+
+	return false;
+}
+
+static void *hostio_thread(void *unused)
+{
+	struct epoll_event events[HOSTIO_MAX_QUEUES];
+	bool hangups = false;
+
+	for (;;) {
+		int m, nevents;
+
+		nevents = epoll_wait(hostio.epoll_fd, events,
+				     HOSTIO_MAX_QUEUES,
+				     hangups ? HOSTIO_HANGUP_RETRY_MS : -1);
+		if (nevents < 0 && errno == EINTR)
+			continue;
+		if (nevents < 0)
+			err(1, "epoll_wait() failed");
+
+		for (m = 0; m < nevents; ++m)
+			hangups |= hostio_fill(events[m].data.ptr,
+					       events[m].events);
+
+		if (nevents)
+			continue;
+
+		/* Timed out, retry the fds that had hung up. */
+		hangups = false;
+		for (m = 0; m < (int)hostio.nr_queues; ++m) {
+			struct hostio_queue *q = hostio.queues[m];
+
+			if (q->hangup) {
+				q->hangup = false;
+				hostio_arm(q, EPOLL_CTL_MOD);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void hostio_start(void)
+{
+	pthread_t thread;
+
+	hostio.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (hostio.epoll_fd < 0)
+		err(1, "failed to create epoll fd");
+
+	if (pthread_create(&thread, NULL, hostio_thread, NULL))
+		err(1, "failed to spawn host I/O thread");
+}
+
+struct hostio_queue *hostio_add_input(int fd)
+{
+	struct hostio_queue *q;
+
+	pthread_once(&hostio.once, hostio_start);
+
+	q = calloc(1, sizeof(*q));
+	assert(q);
+	q->fd = fd;
+
+	assert(hostio.nr_queues < HOSTIO_MAX_QUEUES);
+	hostio.queues[hostio.nr_queues++] = q;
+
+	/* Regular files can't be polled and never have input. */
+	if (hostio_arm(q, EPOLL_CTL_ADD) && errno != EPERM)
+		err(1, "failed to add fd %d to epoll", fd);
+
+	return q;
+}
+
+size_t hostio_read(struct hostio_queue *q, void *buf, size_t len)
+{
+	unsigned int head = q->head;
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	size_t m;
+
+	if (len > tail - head)
+		len = tail - head;
+
+	for (m = 0; m < len; ++m)
+		((uint8_t *)buf)[m] = q->buf[(head + m) % HOSTIO_QUEUE_SIZE];
+	/* Sequentially consistent to pair with hostio_fill(). */
+	__atomic_store_n(&q->head, head + len, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&q->stalled, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&q->stalled, false, __ATOMIC_ACQ_REL))
+		hostio_arm(q, EPOLL_CTL_MOD);
+
+	return len;
+}
@@ -0,0 +1,16 @@
+#ifndef __HOSTIO_H__
+#define __HOSTIO_H__
+
+#include <stddef.h>
+
+struct hostio_queue;
+
+/*
+ * Start reading from a host fd on the I/O thread.  Input is queued until the
+ * device collects it with hostio_read(), which never makes a syscall unless
+ * the queue had filled up.
+ */
+struct hostio_queue *hostio_add_input(int fd);
+size_t hostio_read(struct hostio_queue *q, void *buf, size_t len);
+
+#endif /* __HOSTIO_H__ */
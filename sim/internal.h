@@ -23,6 +23,10 @@ static inline ssize_t no_printf(const char *fmt, ...) { return 0; }
 	(type *)(((char *)(ptr)) - offsetof(type, member)); \
 })
 
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif /* __always_inline */
+
 static inline void __die(const char *file, unsigned int line, const char *fmt, ...)
 {
 	va_list ap;
@@ -10,10 +10,13 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "address_map.h"
 #include "io.h"
 
 #define NR_SUPERSECT_BITS	10
@@ -28,6 +31,7 @@
 
 struct region {
 	physaddr_t base;
+	enum io_type type;
 	int flags;
 	void *priv;
 	int (*read)(unsigned int offs, uint32_t *val, size_t nr_bits,
@@ -51,12 +55,41 @@ struct supersect {
 };
 
 struct mem_map {
+	/*
+	 * Regions at the board's addresses are found with the generated
+	 * board_decode(), anything else through the sections.
+	 */
+	struct region *board[BOARD_NR_REGIONS];
 	struct supersect *supersects[1 << NR_SUPERSECT_BITS];
+	/*
+	 * When the map is shared between cores running on different host
+	 * threads, accesses to uncacheable (device) regions are serialized
+	 * with io_lock.  Memory regions are accessed without locking, the
+	 * same as concurrent bus masters would.
+	 */
+	bool shared;
+	pthread_mutex_t io_lock;
 };
 
 struct mem_map *mem_map_new(void)
 {
-	return calloc(1, sizeof(struct mem_map));
+	struct mem_map *map = calloc(1, sizeof(struct mem_map));
+
+	if (map)
+		pthread_mutex_init(&map->io_lock, NULL);
+
+	return map;
+}
+
+void mem_map_set_shared(struct mem_map *map)
+{
+	map->shared = true;
+}
+
+static inline bool region_needs_lock(const struct mem_map *map,
+				     const struct region *r)
+{
+	return map->shared && !(r->flags & MEM_MAPF_CACHEABLE);
 }
 
 static int null_read(unsigned int offs, uint32_t *val, size_t nr_bits,
@@ -80,9 +113,13 @@ static const struct region null_region = {
 
 static const struct region *mem_map_lookup(struct mem_map *map, physaddr_t addr)
 {
+	int board_idx = board_decode(addr);
 	unsigned int idx = supersect_idx(addr);
 	struct supersect *ss;
 
+	if (board_idx >= 0 && map->board[board_idx])
+		return map->board[board_idx];
+
 	if (!map->supersects[idx])
 		return &null_region;
 
@@ -94,6 +131,52 @@ static const struct region *mem_map_lookup(struct mem_map *map, physaddr_t addr)
 	return ss->regions[idx];
 }
 
+/* Known device types are called directly so that the calls can be predicted. */
+static int region_write(const struct region *r, unsigned int offs,
+			uint32_t val, size_t nr_bits)
+{
+	switch (r->type) {
+	case IO_RAM:
+		return ram_write(offs, val, nr_bits, r->priv);
+	case IO_ROM:
+		return rom_write(offs, val, nr_bits, r->priv);
+	case IO_SDRAM_CTRL:
+		return sdram_ctrl_write(offs, val, nr_bits, r->priv);
+	case IO_UART:
+		return debug_uart_write(offs, val, nr_bits, r->priv);
+	case IO_IRQ_CTRL:
+		return irq_ctrl_write(offs, val, nr_bits, r->priv);
+	case IO_TIMER:
+		return timer_write(offs, val, nr_bits, r->priv);
+	case IO_SPIMASTER:
+		return spimaster_write(offs, val, nr_bits, r->priv);
+	default:
+		return r->write(offs, val, nr_bits, r->priv);
+	}
+}
+
+static int region_read(const struct region *r, unsigned int offs,
+		       uint32_t *val, size_t nr_bits)
+{
+	switch (r->type) {
+	case IO_RAM:
+	case IO_ROM:
+		return ram_read(offs, val, nr_bits, r->priv);
+	case IO_SDRAM_CTRL:
+		return sdram_ctrl_read(offs, val, nr_bits, r->priv);
+	case IO_UART:
+		return debug_uart_read(offs, val, nr_bits, r->priv);
+	case IO_IRQ_CTRL:
+		return irq_ctrl_read(offs, val, nr_bits, r->priv);
+	case IO_TIMER:
+		return timer_read(offs, val, nr_bits, r->priv);
+	case IO_SPIMASTER:
+		return spimaster_read(offs, val, nr_bits, r->priv);
+	default:
+		return r->read(offs, val, nr_bits, r->priv);
+	}
+}
+
 static struct supersect *fetch_or_create_supersect(struct mem_map *map,
 						   unsigned int idx)
 {
@@ -122,12 +205,15 @@ struct region *mem_map_region_add(struct mem_map *map, physaddr_t base,
 				  void *priv, int flags)
 {
 	struct region *r = calloc(1, sizeof(*r));
-	
+	size_t size = len;
+	unsigned int m;
+
 	assert(r != NULL);
 	assert(base % PAGE_SIZE == 0);
 	assert(len % PAGE_SIZE == 0);
 
 	r->base = base;
+	r->type = ops->type;
 	r->priv = priv;
 	r->read = ops->read;
 	r->write = ops->write;
@@ -147,6 +233,11 @@ struct region *mem_map_region_add(struct mem_map *map, physaddr_t base,
 		}
 	}
 
+	for (m = 0; m < BOARD_NR_REGIONS; ++m)
+		if (board_regions[m].address == r->base &&
+		    board_regions[m].size == size)
+			map->board[m] = r;
+
 	return r;
 }
 
@@ -154,6 +245,7 @@ int mem_map_write(struct mem_map *map, physaddr_t addr, unsigned int nr_bits,
 		  uint32_t val)
 {
 	const struct region *r;
+	int rc;
 
 	if (addr & ((nr_bits / 8) - 1))
 		return -EIO;
@@ -161,7 +253,14 @@ int mem_map_write(struct mem_map *map, physaddr_t addr, unsigned int nr_bits,
 	r = mem_map_lookup(map, addr);
 
 	val &= (uint32_t)((1LU << (unsigned long)nr_bits) - 1LU);
-	return r->write(addr - r->base, val, nr_bits, r->priv);
+	if (!region_needs_lock(map, r))
+		return region_write(r, addr - r->base, val, nr_bits);
+
+	pthread_mutex_lock(&map->io_lock);
+	rc = region_write(r, addr - r->base, val, nr_bits);
+	pthread_mutex_unlock(&map->io_lock);
+
+	return rc;
 }
 
 int mem_map_read(struct mem_map *map, physaddr_t addr, unsigned int nr_bits,
@@ -175,7 +274,13 @@ int mem_map_read(struct mem_map *map, physaddr_t addr, unsigned int nr_bits,
 
 	r = mem_map_lookup(map, addr);
 
-	rc = r->read(addr - r->base, val, nr_bits, r->priv);
+	if (!region_needs_lock(map, r)) {
+		rc = region_read(r, addr - r->base, val, nr_bits);
+	} else {
+		pthread_mutex_lock(&map->io_lock);
+		rc = region_read(r, addr - r->base, val, nr_bits);
+		pthread_mutex_unlock(&map->io_lock);
+	}
 	*val &= (uint32_t)((1LU << (unsigned long)nr_bits) - 1LU);
 
 	return rc;
@@ -11,6 +11,7 @@
 #ifndef __IO_H__
 #define __IO_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct event_list;
@@ -23,8 +24,29 @@ struct region;
 struct mem_map;
 
 struct mem_map *mem_map_new(void);
+/*
+ * Mark the map as accessed from multiple host threads, device accesses are
+ * then serialized.
+ */
+void mem_map_set_shared(struct mem_map *map);
+
+/*
+ * The device models the memory map calls directly rather than through the
+ * ops, anything else is IO_GENERIC.
+ */
+enum io_type {
+	IO_GENERIC,
+	IO_RAM,
+	IO_ROM,
+	IO_SDRAM_CTRL,
+	IO_UART,
+	IO_IRQ_CTRL,
+	IO_TIMER,
+	IO_SPIMASTER,
+};
 
 struct io_ops {
+	enum io_type type;
 	int (*write)(unsigned int offs, uint32_t val, size_t nr_bits,
 		     void *priv);
 	int (*read)(unsigned int offs, uint32_t *val, size_t nr_bits,
@@ -50,15 +72,45 @@ int mem_map_addr_cacheable(struct mem_map *map, physaddr_t addr);
 /*
  * Devices.
  */
-int debug_uart_init(struct mem_map *mem, physaddr_t base, size_t len);
+struct irq_ctrl;
+struct debug_uart;
+
+/* Register accessors of the IO_* device types. */
+int ram_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv);
+int ram_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv);
+int rom_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv);
+int sdram_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		     void *priv);
+int sdram_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		    void *priv);
+int debug_uart_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		     void *priv);
+int debug_uart_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		    void *priv);
+int irq_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		   void *priv);
+int irq_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		  void *priv);
+int timer_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv);
+int timer_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv);
+int spimaster_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		    void *priv);
+int spimaster_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		   void *priv);
+
+struct debug_uart *debug_uart_init(struct mem_map *mem, physaddr_t base,
+				   size_t len, struct event_list *events,
+				   struct irq_ctrl *irq_ctrl, unsigned int irq,
+				   bool host_io);
+void debug_uart_reset(struct debug_uart *u);
+/* Write out any buffered UART output. */
+void debug_uart_flush(void);
 int ram_init(struct mem_map *mem, physaddr_t base, size_t len,
 	     const char *init_contents);
 int rom_init(struct mem_map *mem, physaddr_t base, size_t len,
 	     const char *filename);
 int sdram_ctrl_init(struct mem_map *mem, physaddr_t base, size_t len);
 
-struct irq_ctrl;
-
 struct timer_init_data {
 	struct irq_ctrl *irq_ctrl;
 	unsigned int irqs[4];
@@ -67,7 +119,7 @@ struct timer_init_data {
 struct timer_base;
 
 struct timer_base *timers_init(struct mem_map *mem, physaddr_t base,
-			       struct event_list *events,
+			       size_t len, struct event_list *events,
 			       const struct timer_init_data *init_data);
 void timers_reset(struct timer_base *timers);
 
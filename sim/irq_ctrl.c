@@ -1,56 +1,113 @@
+/*
+ * Interrupt controller.
+ *
+ * Each core has its own bank of registers at a 256 byte stride with bank 0
+ * at the base of the controller, so a single core system sees the original
+ * register layout.  Device interrupts are shared between all of the cores
+ * and each core enables the interrupts that it wants to receive.
+ *
+ * The IPI registers let one core interrupt others: writing a mask of core
+ * numbers to the IPI raise register raises IRQ_CTRL_IPI_IRQ on each of those
+ * cores, and a core acknowledges its IPI by writing to its IPI clear
+ * register.
+ */
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "checkpoint.h"
 #include "internal.h"
 #include "io.h"
+#include "irq_ctrl.h"
 
-struct irq_ctrl {
+#define IRQ_CTRL_BANK_STRIDE	0x100
+#define IRQ_CTRL_MAX_CPUS	(4096 / IRQ_CTRL_BANK_STRIDE)
+
+struct irq_ctrl_cpu {
 	uint32_t	status;
-	uint32_t	raw_status;
 	uint32_t	enable_mask;
-	void		(*cpu_raise_irq)(void *data);
-	void		(*cpu_clear_irq)(void *data);
 	void		*cb_data;
 	bool		irq_raised;
 };
 
-static void irq_ctrl_update(struct irq_ctrl *ctrl)
+struct irq_ctrl {
+	uint32_t	raw_status;
+	uint32_t	ipi_pending;
+	void		(*cpu_raise_irq)(void *data);
+	void		(*cpu_clear_irq)(void *data);
+	unsigned int	nr_cpus;
+	struct irq_ctrl_cpu cpus[IRQ_CTRL_MAX_CPUS];
+};
+
+static uint32_t irq_ctrl_raw_status(const struct irq_ctrl *ctrl,
+				    unsigned int cpu)
+{
+	uint32_t raw = ctrl->raw_status;
+
+	if (ctrl->ipi_pending & (1 << cpu))
+		raw |= (1 << IRQ_CTRL_IPI_IRQ);
+
+	return raw;
+}
+
+static void irq_ctrl_update_cpu(struct irq_ctrl *ctrl, unsigned int cpu)
 {
-	ctrl->status = ctrl->raw_status & ctrl->enable_mask;
-
-	if (ctrl->status && !ctrl->irq_raised) {
-		ctrl->cpu_raise_irq(ctrl->cb_data);
-		ctrl->irq_raised = true;
-	} else if (ctrl->irq_raised) {
-		ctrl->cpu_clear_irq(ctrl->cb_data);
-		ctrl->irq_raised = false;
+	struct irq_ctrl_cpu *c = &ctrl->cpus[cpu];
+
+	c->status = irq_ctrl_raw_status(ctrl, cpu) & c->enable_mask;
+
+	if (c->status && !c->irq_raised) {
+		ctrl->cpu_raise_irq(c->cb_data);
+		c->irq_raised = true;
+	} else if (c->irq_raised) {
+		ctrl->cpu_clear_irq(c->cb_data);
+		c->irq_raised = false;
 	}
 }
 
-static int irq_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
-			  void *priv)
+static void irq_ctrl_update(struct irq_ctrl *ctrl)
+{
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < ctrl->nr_cpus; ++cpu)
+		irq_ctrl_update_cpu(ctrl, cpu);
+}
+
+int irq_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv)
 {
 	struct irq_ctrl *ctrl = priv;
+	unsigned int cpu = offs / IRQ_CTRL_BANK_STRIDE;
+	struct irq_ctrl_cpu *c = &ctrl->cpus[cpu];
 
 	if (nr_bits != 32)
 		return -EFAULT;
 
-	switch (offs) {
+	if (cpu >= ctrl->nr_cpus)
+		return 0;
+
+	switch (offs % IRQ_CTRL_BANK_STRIDE) {
 	case IRQ_CTRL_ENABLE_REG_OFFS:
-		ctrl->enable_mask |= val;
-		irq_ctrl_update(ctrl);
+		c->enable_mask |= val;
+		irq_ctrl_update_cpu(ctrl, cpu);
 		break;
 	case IRQ_CTRL_DISABLE_REG_OFFS:
-		ctrl->enable_mask &= ~val;
-		irq_ctrl_update(ctrl);
+		c->enable_mask &= ~val;
+		irq_ctrl_update_cpu(ctrl, cpu);
 		break;
 	case IRQ_CTRL_TEST_REG_OFFS:
 		ctrl->raw_status = val;
 		irq_ctrl_update(ctrl);
 		break;
+	case IRQ_CTRL_IPI_RAISE_REG_OFFS:
+		ctrl->ipi_pending |= val & ((1 << ctrl->nr_cpus) - 1);
+		irq_ctrl_update(ctrl);
+		break;
+	case IRQ_CTRL_IPI_CLEAR_REG_OFFS:
+		ctrl->ipi_pending &= ~(1 << cpu);
+		irq_ctrl_update_cpu(ctrl, cpu);
+		break;
 	case IRQ_CTRL_STATUS_REG_OFFS:
 		/* Fallthrough. */
 	default:
@@ -60,23 +117,31 @@ static int irq_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
 	return 0;
 }
 
-static int irq_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-			 void *priv)
+int irq_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv)
 {
 	struct irq_ctrl *ctrl = priv;
+	unsigned int cpu = offs / IRQ_CTRL_BANK_STRIDE;
+	struct irq_ctrl_cpu *c = &ctrl->cpus[cpu];
 
 	if (nr_bits != 32)
 		return -EFAULT;
 
-	switch (offs) {
+	*val = 0;
+	if (cpu >= ctrl->nr_cpus)
+		return 0;
+
+	switch (offs % IRQ_CTRL_BANK_STRIDE) {
 	case IRQ_CTRL_ENABLE_REG_OFFS:
-		*val = ctrl->enable_mask;
+		*val = c->enable_mask;
 		break;
 	case IRQ_CTRL_DISABLE_REG_OFFS:
-		*val = ~ctrl->enable_mask;
+		*val = ~c->enable_mask;
 		break;
 	case IRQ_CTRL_STATUS_REG_OFFS:
-		*val = ctrl->status;
+		*val = c->status;
+		break;
+	case IRQ_CTRL_IPI_RAISE_REG_OFFS:
+		*val = ctrl->ipi_pending;
 		break;
 	case IRQ_CTRL_TEST_REG_OFFS:
 		/* Fallthrough. */
@@ -90,7 +155,7 @@ static int irq_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 
 void irq_ctrl_raise_irq(struct irq_ctrl *ctrl, unsigned int irq_num)
 {
-	assert(irq_num < 32);
+	assert(irq_num < 32 && irq_num != IRQ_CTRL_IPI_IRQ);
 
 	ctrl->raw_status |= (1 << irq_num);
 	irq_ctrl_update(ctrl);
@@ -98,19 +163,20 @@ void irq_ctrl_raise_irq(struct irq_ctrl *ctrl, unsigned int irq_num)
 
 void irq_ctrl_clear_irq(struct irq_ctrl *ctrl, unsigned int irq_num)
 {
-	assert(irq_num < 32);
+	assert(irq_num < 32 && irq_num != IRQ_CTRL_IPI_IRQ);
 
 	ctrl->raw_status &= ~(1 << irq_num);
 	irq_ctrl_update(ctrl);
 }
 
 static const struct io_ops irq_ctrl_ops = {
+	.type = IO_IRQ_CTRL,
 	.write = irq_ctrl_write,
 	.read = irq_ctrl_read,
 };
 
 struct irq_ctrl *irq_ctrl_init(struct mem_map *mem, physaddr_t base,
-			       void (*cpu_raise_irq)(void *data),
+			       size_t len, void (*cpu_raise_irq)(void *data),
 			       void (*cpu_clear_irq)(void *data), void *data)
 {
 	struct region *r;
@@ -121,19 +187,39 @@ struct irq_ctrl *irq_ctrl_init(struct mem_map *mem, physaddr_t base,
 
 	ctrl->cpu_raise_irq = cpu_raise_irq;
 	ctrl->cpu_clear_irq = cpu_clear_irq;
-	ctrl->cb_data = data;
+	ctrl->cpus[0].cb_data = data;
+	ctrl->nr_cpus = 1;
+	checkpoint_register(ctrl, sizeof(*ctrl));
 
-	r = mem_map_region_add(mem, base, 4096, &irq_ctrl_ops, ctrl, 0);
+	r = mem_map_region_add(mem, base, len, &irq_ctrl_ops, ctrl, 0);
 	assert(r);
 
 	return ctrl;
 }
 
+int irq_ctrl_add_cpu(struct irq_ctrl *ctrl, void *data)
+{
+	if (ctrl->nr_cpus == IRQ_CTRL_MAX_CPUS)
+		return -ENOSPC;
+
+	ctrl->cpus[ctrl->nr_cpus].cb_data = data;
+
+	return ctrl->nr_cpus++;
+}
+
 void irq_ctrl_reset(struct irq_ctrl *irq_ctrl)
 {
-	irq_ctrl->enable_mask = 0;
+	unsigned int cpu;
+
 	irq_ctrl->raw_status = 0;
-	irq_ctrl->status = 0;
-	irq_ctrl->irq_raised = false;
-	irq_ctrl->cpu_clear_irq(irq_ctrl->cb_data);
+	irq_ctrl->ipi_pending = 0;
+
+	for (cpu = 0; cpu < irq_ctrl->nr_cpus; ++cpu) {
+		struct irq_ctrl_cpu *c = &irq_ctrl->cpus[cpu];
+
+		c->enable_mask = 0;
+		c->status = 0;
+		c->irq_raised = false;
+		irq_ctrl->cpu_clear_irq(c->cb_data);
+	}
 }
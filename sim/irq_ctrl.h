@@ -3,11 +3,15 @@
 
 #include "io.h"
 
+/* Inter-processor interrupts are delivered on the last IRQ line. */
+#define IRQ_CTRL_IPI_IRQ	31
+
 struct irq_ctrl;
 
 struct irq_ctrl *irq_ctrl_init(struct mem_map *mem, physaddr_t base,
-			       void (*cpu_raise_irq)(void *data),
+			       size_t len, void (*cpu_raise_irq)(void *data),
 			       void (*cpu_clear_irq)(void *data), void *data);
+int irq_ctrl_add_cpu(struct irq_ctrl *ctrl, void *data);
 void irq_ctrl_raise_irq(struct irq_ctrl *ctrl, unsigned int irq_num);
 void irq_ctrl_clear_irq(struct irq_ctrl *ctrl, unsigned int irq_num);
 void irq_ctrl_reset(struct irq_ctrl *irq_ctrl);
@@ -14,6 +14,11 @@ static inline void list_init(struct list_head *l)
 	l->prev = l->next = l;
 }
 
+static inline int list_empty(const struct list_head *l)
+{
+	return l->next == l;
+}
+
 static inline void list_add(struct list_head *new, struct list_head *list)
 {
 	new->prev = list;
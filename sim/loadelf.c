@@ -0,0 +1,49 @@
+/*
+ * Load an ELF file straight into the simulated memory for headless runs.
+ * This mirrors load_elf() in the debugger: PT_LOAD segments are written
+ * through the boot CPU's view of memory, then every core has its GPRs cleared
+ * and its PC set to the entry point, just as all cores start at the reset
+ * vector.
+ */
+#define _GNU_SOURCE
+#include <err.h>
+#include <stdint.h>
+
+#include <elf.h>
+
+#include "cpu.h"
+#include "loadelf.h"
+#include "../debugger/elfmap.h"
+
+static int cpu_write(void *priv, uint32_t addr, uint32_t v,
+		     unsigned int width)
+{
+	return cpu_write_mem(priv, addr, v, width);
+}
+
+int load_elf(struct cpu **cpus, unsigned int nr_cores, const char *path)
+{
+	struct elf_info elf = {};
+	unsigned int n;
+	int ret, r;
+
+	ret = init_elf(path, &elf);
+	if (ret)
+		return ret;
+
+	ret = load_elf_segments(&elf, cpu_write, cpus[0]);
+	if (ret)
+		goto out;
+
+	for (n = 0; n < nr_cores; ++n) {
+		cpu_cache_sync(cpus[n]);
+		for (r = R0; r < PC; ++r)
+			cpu_write_reg(cpus[n], r, 0);
+		cpu_write_reg(cpus[n], PC, (uint32_t)elf.ehdr->e_entry);
+	}
+
+out:
+	unmap_elf(&elf);
+
+	return ret;
+}
@@ -0,0 +1,8 @@
+#ifndef __LOADELF_H__
+#define __LOADELF_H__
+
+struct cpu;
+
+int load_elf(struct cpu **cpus, unsigned int nr_cores, const char *path);
+
+#endif /* __LOADELF_H__ */
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/epoll.h>
@@ -20,7 +21,16 @@
 #include <sys/types.h>
 
 #include "cpu.h"
+#include "gdbstub.h"
 #include "internal.h"
+#include "io.h"
+#include "loadelf.h"
+#include "replay.h"
+#include "reverse.h"
+#include "sdcard.h"
+#include "smp.h"
+#include "soc.h"
+#include "spimaster.h"
 
 #include "../debugger/protocol.h"
 #include "../devicemodels/jtag.h"
@@ -32,11 +42,29 @@ int sim_is_interactive(void)
 	return sim_interactive;
 }
 
+#define MAX_CORES		16
+#define DEFAULT_QUANTUM		1000
+#define DEFAULT_CHECKPOINT_INTERVAL	1000000
+
+/* Exit status of a headless run that reaches --max-cycles, as timeout(1). */
+#define EXIT_MAX_CYCLES		124
+
 struct debug_data {
 	struct jtag_debug_data *jtag;
 
+	/* The debugger accesses core 0, run/step/reset apply to all cores. */
+	struct cpu *cpus[MAX_CORES];
+	unsigned int nr_cores;
+	struct smp *smp;
+	struct gdb_server *gdb;
+
 	bool breakpoint_hit;
 	uint32_t debug_regs[4];
+
+	/* Sorted addresses that CMD_RUN_TO_STOP_PC stops at. */
+	uint32_t *stop_pcs;
+	unsigned int nr_stop_pcs;
+	unsigned int max_stop_pcs;
 };
 
 static enum {
@@ -44,119 +72,364 @@ static enum {
 	SIM_STATE_RUNNING,
 } sim_state = SIM_STATE_RUNNING;
 
-static void handle_req(struct debug_data *debug, struct dbg_request *req,
-		       struct cpu *cpu)
+static void sim_cycle(struct debug_data *debug)
 {
-	struct dbg_response resp = { .status = req->addr > 3 ? -EINVAL : 0 };
-	int tlb_miss = 0;
+	debug->breakpoint_hit = false;
 
-	if (!req->read_not_write)
-		debug->debug_regs[req->addr & 0x3] = req->value;
+	if (debug->smp)
+		smp_run(debug->smp, 1, &debug->breakpoint_hit);
+	else
+		cpu_cycle(debug->cpus[0], &debug->breakpoint_hit);
+}
 
-	if (req->addr == REG_CMD && !req->read_not_write) {
-		switch (debug->debug_regs[REG_CMD]) {
-		case CMD_STOP:
-			sim_state = SIM_STATE_STOPPED;
-			cpu_read_reg(cpu, PC, &debug->debug_regs[REG_RDATA]);
-			break;
-		case CMD_RUN:
-			sim_state = SIM_STATE_RUNNING;
-			break;
-		case CMD_STEP:
-			sim_state = SIM_STATE_STOPPED;
-			debug->breakpoint_hit = false;
-			cpu_cycle(cpu, &debug->breakpoint_hit);
-			cpu_read_reg(cpu, PC, &debug->debug_regs[REG_RDATA]);
-			break;
-		case CMD_READ_REG:
-			resp.status = cpu_read_reg(cpu,
-						   debug->debug_regs[REG_ADDRESS],
-						   &debug->debug_regs[REG_RDATA]);
-			break;
-		case CMD_WRITE_REG:
-			resp.status = cpu_write_reg(cpu,
-						    debug->debug_regs[REG_ADDRESS],
-						    debug->debug_regs[REG_WDATA]);
-			break;
-		case CMD_RMEM32:
-			resp.status = cpu_read_mem(cpu,
-						   debug->debug_regs[REG_ADDRESS],
-						   &debug->debug_regs[REG_RDATA],
-						   32, &tlb_miss);
-			if (tlb_miss && !resp.status)
-				resp.status = -1;
-			break;
-		case CMD_WMEM32:
-			resp.status = cpu_write_mem(cpu,
-						    debug->debug_regs[REG_ADDRESS],
-						    debug->debug_regs[REG_WDATA],
-						    32);
-			break;
-		case CMD_RMEM16:
-			resp.status = cpu_read_mem(cpu,
-						   debug->debug_regs[REG_ADDRESS],
-						   &debug->debug_regs[REG_RDATA],
-						   16, &tlb_miss);
-			if (tlb_miss && !resp.status)
-				resp.status = -1;
-			break;
-		case CMD_WMEM16:
-			resp.status = cpu_write_mem(cpu,
-						    debug->debug_regs[REG_ADDRESS],
-						    debug->debug_regs[REG_WDATA],
-						    16);
-			break;
-		case CMD_RMEM8:
-			resp.status = cpu_read_mem(cpu,
-						   debug->debug_regs[REG_ADDRESS],
-						   &debug->debug_regs[REG_RDATA],
-						   8, &tlb_miss);
-			if (tlb_miss && !resp.status)
-				resp.status = -1;
-			break;
-		case CMD_WMEM8:
-			resp.status = cpu_write_mem(cpu,
-						    debug->debug_regs[REG_ADDRESS],
-						    debug->debug_regs[REG_WDATA],
-						    8);
-			break;
-		case CMD_RESET:
-			cpu_reset(cpu);
-			break;
-		case CMD_CACHE_SYNC:
-			cpu_cache_sync(cpu);
-			break;
-		case CMD_CPUID:
-			debug->debug_regs[REG_RDATA] =
-				cpu_cpuid(debug->debug_regs[REG_ADDRESS]);
+static void sim_reset(struct debug_data *debug)
+{
+	unsigned int n;
+
+	for (n = 0; n < debug->nr_cores; ++n)
+		cpu_reset(debug->cpus[n]);
+}
+
+static void add_stop_pc(struct debug_data *debug, uint32_t pc)
+{
+	unsigned int n;
+
+	for (n = 0; n < debug->nr_stop_pcs; ++n)
+		if (debug->stop_pcs[n] >= pc)
 			break;
-		case CMD_GET_EXEC_STATUS:
-			debug->debug_regs[REG_RDATA] =
-				(sim_state == SIM_STATE_RUNNING) |
-				((!!debug->breakpoint_hit) << 1);
+	if (n < debug->nr_stop_pcs && debug->stop_pcs[n] == pc)
+		return;
+
+	if (debug->nr_stop_pcs == debug->max_stop_pcs) {
+		debug->max_stop_pcs = debug->max_stop_pcs * 2 ? : 64;
+		debug->stop_pcs = realloc(debug->stop_pcs, debug->max_stop_pcs *
+					  sizeof(*debug->stop_pcs));
+		assert(debug->stop_pcs);
+	}
+
+	memmove(&debug->stop_pcs[n + 1], &debug->stop_pcs[n],
+		(debug->nr_stop_pcs - n) * sizeof(*debug->stop_pcs));
+	debug->stop_pcs[n] = pc;
+	debug->nr_stop_pcs++;
+}
+
+static int compare_pc(const void *a, const void *b)
+{
+	uint32_t pa = *(const uint32_t *)a, pb = *(const uint32_t *)b;
+
+	return pa < pb ? -1 : pa > pb;
+}
+
+static void sim_step(struct debug_data *debug)
+{
+	if (reverse_enabled())
+		reverse_tick();
+	sim_cycle(debug);
+}
+
+/* Execute nr_cycles instructions, stopping early on a breakpoint. */
+static void run_n(struct debug_data *debug, uint32_t nr_cycles)
+{
+	while (nr_cycles--) {
+		sim_step(debug);
+		if (debug->breakpoint_hit)
 			break;
-		case CMD_SIM_TERM:
-			exit(EXIT_SUCCESS);
-		default:
-			resp.status = -EINVAL;
-		}
 	}
+}
+
+/*
+ * Step until the PC is one of the stop PCs or a breakpoint is hit, returning
+ * -ETIMEDOUT if that doesn't happen within max_cycles (0 for no limit).  At
+ * least one cycle is always executed so that we can run on from a stop PC.
+ */
+static int run_to_stop_pc(struct debug_data *debug,
+			  unsigned long max_cycles, uint32_t *nr_cycles)
+{
+	uint32_t pc;
+
+	for (*nr_cycles = 0; !max_cycles || *nr_cycles < max_cycles;) {
+		sim_step(debug);
+		++*nr_cycles;
+
+		cpu_read_reg(debug->cpus[0], PC, &pc);
+		if (debug->breakpoint_hit ||
+		    bsearch(&pc, debug->stop_pcs, debug->nr_stop_pcs,
+			    sizeof(*debug->stop_pcs), compare_pc))
+			return 0;
+	}
+
+	return -ETIMEDOUT;
+}
+
+/*
+ * Execute a debug command.  This is shared by the debug protocol server and
+ * the gdb server.
+ */
+static int sim_command(struct debug_data *debug, int32_t cmd, uint32_t addr,
+		       uint32_t wdata, uint32_t *rdata)
+{
+	struct cpu *cpu = debug->cpus[0];
+	int tlb_miss = 0;
+	int status = 0;
+
+	reverse_note_write(cmd, addr, wdata);
+
+	switch (cmd) {
+	case CMD_STOP:
+		sim_state = SIM_STATE_STOPPED;
+		debug_uart_flush();
+		replay_sync();
+		cpu_read_reg(cpu, PC, rdata);
+		break;
+	case CMD_RUN:
+		sim_state = SIM_STATE_RUNNING;
+		break;
+	case CMD_STEP:
+		sim_state = SIM_STATE_STOPPED;
+		sim_cycle(debug);
+		cpu_read_reg(cpu, PC, rdata);
+		break;
+	case CMD_RUN_N:
+		sim_state = SIM_STATE_STOPPED;
+		run_n(debug, addr);
+		debug_uart_flush();
+		cpu_read_reg(cpu, PC, rdata);
+		break;
+	case CMD_READ_REG:
+		status = cpu_read_reg(cpu, addr, rdata);
+		break;
+	case CMD_WRITE_REG:
+		status = cpu_write_reg(cpu, addr, wdata);
+		break;
+	case CMD_RMEM32:
+		status = cpu_read_mem(cpu, addr, rdata, 32, &tlb_miss);
+		if (tlb_miss && !status)
+			status = -1;
+		break;
+	case CMD_WMEM32:
+		status = cpu_write_mem(cpu, addr, wdata, 32);
+		break;
+	case CMD_RMEM16:
+		status = cpu_read_mem(cpu, addr, rdata, 16, &tlb_miss);
+		if (tlb_miss && !status)
+			status = -1;
+		break;
+	case CMD_WMEM16:
+		status = cpu_write_mem(cpu, addr, wdata, 16);
+		break;
+	case CMD_RMEM8:
+		status = cpu_read_mem(cpu, addr, rdata, 8, &tlb_miss);
+		if (tlb_miss && !status)
+			status = -1;
+		break;
+	case CMD_WMEM8:
+		status = cpu_write_mem(cpu, addr, wdata, 8);
+		break;
+	case CMD_RESET:
+		sim_reset(debug);
+		reverse_reset();
+		break;
+	case CMD_CACHE_SYNC:
+		cpu_cache_sync(cpu);
+		break;
+	case CMD_CPUID:
+		*rdata = cpu_cpuid(cpu, addr);
+		break;
+	case CMD_GET_EXEC_STATUS:
+		*rdata = (sim_state == SIM_STATE_RUNNING) |
+			((!!debug->breakpoint_hit) << 1);
+		break;
+	case CMD_REVERSE_STEP:
+		sim_state = SIM_STATE_STOPPED;
+		debug->breakpoint_hit = false;
+		status = reverse_step();
+		cpu_read_reg(cpu, PC, rdata);
+		break;
+	case CMD_REVERSE_CONTINUE:
+		sim_state = SIM_STATE_STOPPED;
+		debug->breakpoint_hit = false;
+		status = reverse_continue();
+		cpu_read_reg(cpu, PC, rdata);
+		break;
+	case CMD_SIM_TERM:
+		exit(EXIT_SUCCESS);
+	case CMD_SIM_PROBE:
+		*rdata = ~wdata;
+		break;
+	case CMD_CLEAR_STOP_PCS:
+		debug->nr_stop_pcs = 0;
+		break;
+	case CMD_ADD_STOP_PC:
+		add_stop_pc(debug, addr);
+		break;
+	case CMD_RUN_TO_STOP_PC:
+		sim_state = SIM_STATE_STOPPED;
+		status = run_to_stop_pc(debug, addr, rdata);
+		debug_uart_flush();
+		break;
+	default:
+		status = -EINVAL;
+	}
+
+	return status;
+}
+
+static int gdb_command(void *priv, enum dbg_cmd cmd, uint32_t addr,
+		       uint32_t wdata, uint32_t *rdata)
+{
+	return sim_command(priv, cmd, addr, wdata, rdata);
+}
+
+/* The memories of the board, for the gdb memory map. */
+static size_t sim_mem_regions(struct gdb_mem_region *regions, size_t max)
+{
+	const struct soc *soc = soc_get();
+	size_t nr_regions = 0;
+	unsigned int m;
+
+	for (m = 0; m < soc->nr_peripherals && nr_regions < max; ++m) {
+		const struct soc_peripheral *p = &soc->peripherals[m];
+
+		if (!strcmp(p->name, "bootrom"))
+			regions[nr_regions].type = GDB_MEM_ROM;
+		else if (!strcmp(p->name, "ram") || !strcmp(p->name, "sdram"))
+			regions[nr_regions].type = GDB_MEM_RAM;
+		else
+			continue;
+		regions[nr_regions].start = p->address;
+		regions[nr_regions].length = p->size;
+		nr_regions++;
+	}
+
+	return nr_regions;
+}
+
+static void handle_req(struct debug_data *debug, struct dbg_request *req)
+{
+	struct dbg_response resp = { .status = req->addr > 3 ? -EINVAL : 0 };
+
+	if (!req->read_not_write)
+		debug->debug_regs[req->addr & 0x3] = req->value;
+
+	if (req->addr == REG_CMD && !req->read_not_write)
+		resp.status = sim_command(debug, debug->debug_regs[REG_CMD],
+					  debug->debug_regs[REG_ADDRESS],
+					  debug->debug_regs[REG_WDATA],
+					  &debug->debug_regs[REG_RDATA]);
 
 	if (req->read_not_write)
 		resp.data = debug->debug_regs[req->addr & 0x3];
 
-	send_response(debug->jtag, &resp);
+	if (debug->jtag)
+		send_response(debug->jtag, &resp);
+}
+
+static void poll_debugger(struct debug_data *debug)
+{
+	struct dbg_request req;
+
+	/*
+	 * The server thread sets pending when the socket becomes readable,
+	 * check it with a plain load first so the idle path stays cheap.
+	 */
+	if (!debug->jtag->more_data &&
+	    __atomic_load_n(&debug->jtag->pending, __ATOMIC_RELAXED) &&
+	    __sync_val_compare_and_swap(&debug->jtag->pending, 1, 0) == 1)
+		debug->jtag->more_data = 1;
+
+	if (debug->jtag->more_data && !get_request(debug->jtag, &req)) {
+		replay_record_request(&req);
+		handle_req(debug, &req);
+	}
+}
+
+/*
+ * When replaying, the debugger requests come from the log at the cycles that
+ * they were originally received on.
+ */
+static void replay_debugger(struct debug_data *debug)
+{
+	struct dbg_request req;
+	int rc;
+
+	while (!(rc = replay_next_request(&req)))
+		handle_req(debug, &req);
+
+	if (rc == -ENOENT) {
+		printf("replay complete at cycle %llu\n",
+		       *cpu_cycle_counter(debug->cpus[0]));
+		exit(EXIT_SUCCESS);
+	}
+
+	if (sim_state == SIM_STATE_STOPPED)
+		die("replay stalled: stopped at cycle %llu with no request\n",
+		    *cpu_cycle_counter(debug->cpus[0]));
+}
+
+/*
+ * Headless runs have no debugger: the CPU runs from the ELF entry point, or
+ * from reset with --headless, until it executes an exit instruction (bkp, or
+ * swi with --exit-on swi) or runs for max_cycles.  The exit status is the low
+ * byte of r0 on the core that stopped.
+ */
+static int run_headless(struct debug_data *debug, unsigned long quantum,
+			unsigned long long max_cycles)
+{
+	struct timespec start, end;
+	unsigned long long cycles = 0;
+	bool stopped = false;
+	uint32_t r0 = 0;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!stopped && (!max_cycles || cycles < max_cycles)) {
+		if (debug->smp) {
+			cycles += smp_run(debug->smp, max_cycles ?
+					  max_cycles - cycles : quantum,
+					  &stopped);
+		} else {
+			cpu_cycle(debug->cpus[0], &stopped);
+			++cycles;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	debug_uart_flush();
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	cpu_read_reg(debug->cpus[debug->smp ? smp_stopped_core(debug->smp) : 0],
+		     R0, &r0);
+
+	if (stopped)
+		fprintf(stderr, "exit code %u", r0 & 0xff);
+	else
+		fprintf(stderr, "max cycles reached");
+	fprintf(stderr, " after %llu cycles in %.3fs (%.2f MIPS)\n", cycles,
+		secs, secs > 0 ? cycles * debug->nr_cores / secs / 1e6 : 0.0);
+
+	return stopped ? (int)(r0 & 0xff) : EXIT_MAX_CYCLES;
 }
 
 int main(int argc, char *argv[])
 {
-	struct cpu *cpu;
-	struct debug_data debug;
+	struct debug_data debug = {};
 	int i, cpu_flags = CPU_NOTRACE;
 	const char *bootrom_image = ROM_FILE;
 	const char *sdcard_image = NULL;
+	const char *sdram_image = NULL;
+	const char *sdcard_overlay = NULL;
+	bool sdcard_writable = false;
+	const char *replay_log = NULL;
+	const char *gdb_port = NULL;
+	const char *run_elf = NULL;
+	const char *soc_file = NULL;
+	bool headless = false;
+	unsigned long long max_cycles = 0;
+	enum replay_mode replay = REPLAY_OFF;
+	unsigned long quantum = DEFAULT_QUANTUM;
+	unsigned long long checkpoint_interval = 0;
 
-	debug.jtag = start_server();
+	debug.nr_cores = 1;
 
 	for (i = 0; i < argc; ++i) {
 		if (!strcmp(argv[i], "--debug") ||
@@ -172,27 +445,161 @@ int main(int argc, char *argv[])
 			sdcard_image = argv[i + 1];
 			++i;
 		}
+		if (!strcmp(argv[i], "--sdcard-overlay") && i + 1 < argc) {
+			sdcard_overlay = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--sdcard-writable"))
+			sdcard_writable = true;
+		if (!strcmp(argv[i], "--spi-mode") && i + 1 < argc) {
+			if (!strcmp(argv[i + 1], "polled"))
+				spimaster_set_mode(SPIMASTER_POLLED);
+			else if (!strcmp(argv[i + 1], "timed"))
+				spimaster_set_mode(SPIMASTER_TIMED);
+			else if (!strcmp(argv[i + 1], "instant"))
+				spimaster_set_mode(SPIMASTER_INSTANT);
+			else
+				die("--spi-mode must be polled, timed or instant\n");
+			++i;
+		}
+		if (!strcmp(argv[i], "--sdram") && i + 1 < argc) {
+			sdram_image = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--soc") && i + 1 < argc) {
+			soc_file = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--cores") && i + 1 < argc) {
+			debug.nr_cores = strtoul(argv[i + 1], NULL, 0);
+			if (debug.nr_cores < 1 || debug.nr_cores > MAX_CORES)
+				die("--cores must be between 1 and %u\n",
+				    MAX_CORES);
+			++i;
+		}
+		if (!strcmp(argv[i], "--quantum") && i + 1 < argc) {
+			quantum = strtoul(argv[i + 1], NULL, 0);
+			++i;
+		}
+		if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+			replay = REPLAY_RECORD;
+			replay_log = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			replay = REPLAY_PLAY;
+			replay_log = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--gdb") && i + 1 < argc) {
+			gdb_port = argv[i + 1];
+			++i;
+		}
+		if (!strcmp(argv[i], "--run") && i + 1 < argc) {
+			run_elf = argv[i + 1];
+			headless = true;
+			++i;
+		}
+		if (!strcmp(argv[i], "--headless"))
+			headless = true;
+		if (!strcmp(argv[i], "--max-cycles") && i + 1 < argc) {
+			max_cycles = strtoull(argv[i + 1], NULL, 0);
+			++i;
+		}
+		if (!strcmp(argv[i], "--exit-on") && i + 1 < argc) {
+			if (!strcmp(argv[i + 1], "swi"))
+				cpu_flags |= CPU_STOP_ON_SWI;
+			else if (strcmp(argv[i + 1], "bkp"))
+				die("--exit-on must be swi or bkp\n");
+			++i;
+		}
+		if (!strcmp(argv[i], "--reverse"))
+			checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+		if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc) {
+			checkpoint_interval = strtoull(argv[i + 1], NULL, 0);
+			++i;
+		}
+	}
+
+	if (checkpoint_interval && (debug.nr_cores > 1 || replay != REPLAY_OFF))
+		die("reverse execution needs a single core without record/replay\n");
+
+	if (replay != REPLAY_OFF && debug.nr_cores > 1)
+		die("record/replay is not supported with multiple cores\n");
+
+	if (replay != REPLAY_OFF && gdb_port)
+		die("record/replay is not supported with the gdb server\n");
+
+	if (headless && (replay != REPLAY_OFF || gdb_port || checkpoint_interval))
+		die("--run and --headless can't be used with record/replay, gdb or reverse execution\n");
+
+	sdcard_configure(sdcard_overlay, sdcard_writable);
+	soc_configure(soc_file);
+
+	if (headless) {
+		new_cpus(debug.cpus, debug.nr_cores, NULL, cpu_flags,
+			 bootrom_image, sdcard_image, sdram_image);
+		if (debug.nr_cores > 1)
+			debug.smp = smp_init(debug.cpus, debug.nr_cores,
+					     quantum);
+		if (run_elf && load_elf(debug.cpus, debug.nr_cores, run_elf))
+			die("failed to load %s\n", run_elf);
+
+		return run_headless(&debug, quantum, max_cycles);
 	}
 
-	cpu = new_cpu(NULL, cpu_flags, bootrom_image, sdcard_image);
+	/* Set before creating the devices so that they skip host I/O. */
+	replay_mode = replay;
+	if (replay != REPLAY_PLAY)
+		debug.jtag = start_server();
+
+	new_cpus(debug.cpus, debug.nr_cores, NULL, cpu_flags, bootrom_image,
+		 sdcard_image, sdram_image);
+	if (debug.nr_cores > 1)
+		debug.smp = smp_init(debug.cpus, debug.nr_cores, quantum);
+	replay_init(replay, replay_log, cpu_cycle_counter(debug.cpus[0]));
+	if (checkpoint_interval)
+		reverse_init(debug.cpus[0], checkpoint_interval);
+	if (gdb_port) {
+		static struct gdb_mem_region regions[SOC_MAX_PERIPHERALS];
+		static struct gdb_target gdb_target = {
+			.command = gdb_command,
+			.regions = regions,
+		};
+
+		gdb_target.nr_regions = sim_mem_regions(regions,
+							ARRAY_SIZE(regions));
+		gdb_target.priv = &debug;
+		gdb_target.reversible = checkpoint_interval != 0;
+		debug.gdb = gdb_server_new(gdb_port, &gdb_target);
+	}
 
 	notify_runner();
 
 	for (;;) {
-		struct dbg_request req;
-
-		if (!debug.jtag->more_data &&
-		    __sync_val_compare_and_swap(&debug.jtag->pending, 1, 0) == 0)
-			debug.jtag->more_data = 1;
+		if (reverse_enabled())
+			reverse_tick();
 
-		if (!get_request(debug.jtag, &req))
-			handle_req(&debug, &req, cpu);
+		if (replay_playing())
+			replay_debugger(&debug);
+		else
+			poll_debugger(&debug);
+		if (debug.gdb)
+			gdb_server_poll(debug.gdb);
 
 		if (sim_state == SIM_STATE_RUNNING) {
 			debug.breakpoint_hit = false;
-			cpu_cycle(cpu, &debug.breakpoint_hit);
-			if (debug.breakpoint_hit)
+			if (debug.smp)
+				smp_run(debug.smp, quantum,
+					&debug.breakpoint_hit);
+			else
+				cpu_cycle(debug.cpus[0],
+					  &debug.breakpoint_hit);
+			if (debug.breakpoint_hit) {
 				sim_state = SIM_STATE_STOPPED;
+				debug_uart_flush();
+				replay_sync();
+			}
 		}
 	}
 
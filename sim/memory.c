@@ -1,19 +1,24 @@
 #define DEBUG
 
 #include <assert.h>
+#include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "checkpoint.h"
 #include "internal.h"
 #include "io.h"
 
-static int ram_write(unsigned int offs, uint32_t val, size_t nr_bits,
-		     void *priv)
+int ram_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv)
 {
+	checkpoint_ram_write(priv + offs);
+
 	switch (nr_bits) {
 	case 8:
 		*(uint8_t *)(priv + offs) = val & 0xff;
@@ -31,8 +36,7 @@ static int ram_write(unsigned int offs, uint32_t val, size_t nr_bits,
 	return 0;
 }
 
-static int ram_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-		    void *priv)
+int ram_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv)
 {
 	switch (nr_bits) {
 	case 8:
@@ -52,47 +56,91 @@ static int ram_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 }
 
 static const struct io_ops ram_io_ops = {
+	.type = IO_RAM,
 	.write = ram_write,
 	.read = ram_read,
 };
 
-static int rom_write(unsigned int offs, uint32_t val, size_t nr_bits,
-		     void *priv)
+int rom_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv)
 {
 	return -EFAULT;
 }
 
 static const struct io_ops rom_io_ops = {
+	.type = IO_ROM,
 	.write = rom_write,
 	.read = ram_read,
 };
 
+/*
+ * Image backed RAM is mapped privately from the file so that startup doesn't
+ * depend on the image size and only the pages touched are read.  The rest of
+ * the region stays anonymous so that accesses past the end of the file read
+ * zeroes.  The file mapping is rounded up to the host page size, which may be
+ * larger than the simulator's, so ram_init() allocates whole host pages.
+ */
+static int map_ram_image(void *ram, size_t len, physaddr_t base,
+			 const char *path)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	size_t map_len;
+	void *m;
+	int fd = open(path, O_RDONLY), rc = 0;
+
+	if (fd < 0)
+		return -errno;
+	if (fstat(fd, &st)) {
+		rc = -errno;
+		goto out;
+	}
+
+	map_len = (size_t)st.st_size < len ? (size_t)st.st_size : len;
+	map_len = (map_len + page_size - 1) & ~(page_size - 1);
+	if (map_len) {
+		m = mmap(ram, map_len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if (m == MAP_FAILED) {
+			rc = -errno;
+			goto out;
+		}
+	}
+	debug("mapped %zu bytes into RAM @%08x from %s\n",
+	      (size_t)st.st_size < len ? (size_t)st.st_size : len, base, path);
+out:
+	close(fd);
+
+	return rc;
+}
+
 int ram_init(struct mem_map *mem, physaddr_t base, size_t len,
 	     const char *init_contents)
 {
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t alloc_len = (len + page_size - 1) & ~(page_size - 1);
 	struct region *r;
 	void *ram;
+	int rc;
 
 	assert(mem != NULL);
 
-	ram = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	ram = mmap(NULL, alloc_len, PROT_READ | PROT_WRITE,
 		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 	assert(ram != MAP_FAILED);
+	if (init_contents) {
+		rc = map_ram_image(ram, len, base, init_contents);
+		if (rc) {
+			warnx("failed to map %s: %s", init_contents,
+			      strerror(-rc));
+			munmap(ram, alloc_len);
+			return rc;
+		}
+	}
+
 	r = mem_map_region_add(mem, base, len, &ram_io_ops, ram,
 			       MEM_MAPF_CACHEABLE);
 	assert(r != NULL);
-
-	if (init_contents) {
-		ssize_t br;
-		int fd = open(init_contents, O_RDONLY);
-		assert(fd >= 0);
-
-		br = read(fd, ram, len);
-		assert(br >= 0);
-		debug("read %zd bytes into RAM @%08x from %s\n", br, base,
-		      init_contents);
-		close(fd);
-	}
+	checkpoint_register_ram(ram, len);
 
 	return 0;
 }
@@ -115,14 +163,14 @@ int rom_init(struct mem_map *mem, physaddr_t base, size_t len,
 	return 0;
 }
 
-static int sdram_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
-			    void *priv)
+int sdram_ctrl_write(unsigned int offs, uint32_t val, size_t nr_bits,
+		     void *priv)
 {
 	return 0;
 }
 
-static int sdram_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-			   void *priv)
+int sdram_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
+		    void *priv)
 {
 	*val = 1;
 
@@ -130,6 +178,7 @@ static int sdram_ctrl_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 }
 
 static const struct io_ops sdram_ctrl_ops = {
+	.type = IO_SDRAM_CTRL,
 	.read = sdram_ctrl_read,
 	.write = sdram_ctrl_write,
 };
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "checkpoint.h"
 #include "internal.h"
 #include "periodic.h"
 
@@ -17,6 +18,7 @@ struct event *event_new(struct event_list *event_list, uint32_t reload_val,
 	event->callback = callback;
 	event->cookie = cookie;
 	list_add_tail(&event->head, &event_list->events);
+	checkpoint_register(event, sizeof(*event));
 
 	return event;
 }
@@ -35,6 +37,31 @@ void event_list_tick(struct event_list *event_list)
 	}
 }
 
+/*
+ * Advance all events by a number of cycles in one go, firing callbacks for
+ * each expiry.  Used when the devices are synchronized with the cores at
+ * quantum boundaries rather than every cycle.
+ */
+void event_list_advance(struct event_list *event_list, unsigned long cycles)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, &event_list->events) {
+		struct event *event = container_of(pos, struct event, head);
+		unsigned long remaining = cycles;
+
+		while (event->enabled && event->current &&
+		       remaining >= event->current) {
+			remaining -= event->current;
+			event->current = event->reload_val;
+			event->callback(event);
+		}
+
+		if (event->enabled)
+			event->current -= remaining;
+	}
+}
+
 void event_delete(struct event *event)
 {
 	list_del(&event->head);
@@ -16,6 +16,7 @@ static inline void event_list_init(struct event_list *event_list)
 }
 
 void event_list_tick(struct event_list *event_list);
+void event_list_advance(struct event_list *event_list, unsigned long cycles);
 
 struct event {
 	struct list_head head;
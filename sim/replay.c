@@ -0,0 +1,260 @@
+/*
+ * Deterministic record/replay.
+ *
+ * The simulation is deterministic apart from its external inputs: data from
+ * the UART pts, requests from the debugger and data from the SD card image.
+ * In record mode every input is appended to a log, tagged with the cycle
+ * count that it was consumed at.  In replay mode the inputs are taken from
+ * the log instead of the host so the run is reproduced exactly without the
+ * debugger, the pts or the SD card image.  Any difference between the inputs
+ * that the simulation asks for and the log is a divergence and is fatal.
+ *
+ * The log is a sequence of records, each a struct replay_record followed by
+ * len bytes of payload.  SD card data is consumed a byte at a time so
+ * consecutive bytes are coalesced into a single record.  Records are
+ * buffered and only flushed to the file when the simulation stops or exits.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+#include "replay.h"
+
+#define REPLAY_MAGIC		0x52524c4f /* "OLRR" */
+#define REPLAY_MAX_PAYLOAD	4096
+
+struct replay_record {
+	uint64_t cycle;
+	uint32_t type;
+	uint32_t len;
+};
+
+enum replay_mode replay_mode = REPLAY_OFF;
+
+static struct {
+	FILE *fp;
+	const unsigned long long *cycle_count;
+	/* The next record and its payload, either being built or consumed. */
+	struct replay_record rec;
+	uint8_t payload[REPLAY_MAX_PAYLOAD];
+	uint32_t payload_pos;
+	bool have_record;
+	bool eof;
+} replay;
+
+static const char *event_names[] = {
+	[REPLAY_EV_END]		= "end",
+	[REPLAY_EV_UART_DATA]	= "uart data",
+	[REPLAY_EV_SDCARD]	= "sdcard data",
+	[REPLAY_EV_DBG_REQUEST]	= "debug request",
+};
+
+static void replay_flush(void)
+{
+	if (!replay.have_record)
+		return;
+
+	if (fwrite(&replay.rec, sizeof(replay.rec), 1, replay.fp) != 1 ||
+	    fwrite(replay.payload, 1, replay.rec.len, replay.fp) !=
+	    replay.rec.len)
+		die("failed to write replay log\n");
+	replay.have_record = false;
+}
+
+static void replay_emit(enum replay_event ev, const void *data, size_t len)
+{
+	assert(len <= REPLAY_MAX_PAYLOAD);
+
+	replay_flush();
+	replay.rec = (struct replay_record) {
+		.cycle = *replay.cycle_count,
+		.type = ev,
+		.len = len,
+	};
+	memcpy(replay.payload, data, len);
+	replay.have_record = true;
+	replay_flush();
+}
+
+static void replay_load(void)
+{
+	replay.have_record = false;
+	replay.payload_pos = 0;
+
+	if (replay.eof)
+		return;
+
+	if (fread(&replay.rec, sizeof(replay.rec), 1, replay.fp) != 1) {
+		replay.eof = true;
+		return;
+	}
+
+	if (replay.rec.len > REPLAY_MAX_PAYLOAD ||
+	    fread(replay.payload, 1, replay.rec.len, replay.fp) !=
+	    replay.rec.len)
+		die("truncated replay log\n");
+
+	replay.have_record = true;
+}
+
+static void replay_diverged(enum replay_event ev)
+{
+	if (!replay.have_record)
+		die("replay log exhausted: %s at cycle %llu\n",
+		    event_names[ev], *replay.cycle_count);
+
+	die("replay diverged at cycle %llu: wanted %s, log has %s at cycle %llu\n",
+	    *replay.cycle_count, event_names[ev],
+	    event_names[replay.rec.type],
+	    (unsigned long long)replay.rec.cycle);
+}
+
+/*
+ * Copy out the payload of the next record in the log, which must be of the
+ * expected type and consumed on the same cycle as it was recorded.
+ */
+static void replay_consume(enum replay_event ev, void *data, size_t len)
+{
+	if (!replay.have_record || replay.rec.type != ev ||
+	    replay.rec.cycle != *replay.cycle_count || replay.rec.len != len)
+		replay_diverged(ev);
+
+	memcpy(data, replay.payload, len);
+	replay_load();
+}
+
+/*
+ * Whether the next record in the log is an ev input consumed on this cycle,
+ * for inputs that only exist some of the time.
+ */
+bool replay_pending(enum replay_event ev)
+{
+	return replay.have_record && replay.rec.type == ev &&
+		replay.rec.cycle == *replay.cycle_count;
+}
+
+uint32_t replay_input(enum replay_event ev, uint32_t val)
+{
+	switch (replay_mode) {
+	case REPLAY_RECORD:
+		replay_emit(ev, &val, sizeof(val));
+		return val;
+	case REPLAY_PLAY:
+		replay_consume(ev, &val, sizeof(val));
+		return val;
+	default:
+		return val;
+	}
+}
+
+uint8_t replay_sdcard_byte(uint8_t val)
+{
+	switch (replay_mode) {
+	case REPLAY_RECORD:
+		if (!replay.have_record ||
+		    replay.rec.type != REPLAY_EV_SDCARD ||
+		    replay.rec.len == REPLAY_MAX_PAYLOAD) {
+			replay_flush();
+			replay.rec = (struct replay_record) {
+				.cycle = *replay.cycle_count,
+				.type = REPLAY_EV_SDCARD,
+			};
+			replay.have_record = true;
+		}
+		replay.payload[replay.rec.len++] = val;
+		return val;
+	case REPLAY_PLAY:
+		if (!replay.have_record ||
+		    replay.rec.type != REPLAY_EV_SDCARD ||
+		    (replay.payload_pos == 0 &&
+		     replay.rec.cycle != *replay.cycle_count))
+			replay_diverged(REPLAY_EV_SDCARD);
+		val = replay.payload[replay.payload_pos++];
+		if (replay.payload_pos == replay.rec.len)
+			replay_load();
+		return val;
+	default:
+		return val;
+	}
+}
+
+void replay_record_request(const struct dbg_request *req)
+{
+	if (replay_mode == REPLAY_RECORD)
+		replay_emit(REPLAY_EV_DBG_REQUEST, req, sizeof(*req));
+}
+
+/*
+ * Fetch the next debugger request if it was received on this cycle.
+ * Returns -EAGAIN if the next request is for a later cycle and -ENOENT
+ * once the recording has ended.
+ */
+int replay_next_request(struct dbg_request *req)
+{
+	if (!replay.have_record ||
+	    (replay.rec.type == REPLAY_EV_END &&
+	     replay.rec.cycle <= *replay.cycle_count))
+		return -ENOENT;
+
+	if (replay.rec.type != REPLAY_EV_DBG_REQUEST ||
+	    replay.rec.cycle != *replay.cycle_count)
+		return -EAGAIN;
+
+	replay_consume(REPLAY_EV_DBG_REQUEST, req, sizeof(*req));
+
+	return 0;
+}
+
+/* Write out everything recorded so far, for when the simulation stops. */
+void replay_sync(void)
+{
+	if (replay_mode != REPLAY_RECORD)
+		return;
+
+	replay_flush();
+	if (fflush(replay.fp))
+		die("failed to write replay log\n");
+}
+
+static void replay_finish(void)
+{
+	uint32_t magic = REPLAY_MAGIC;
+
+	replay_emit(REPLAY_EV_END, &magic, sizeof(magic));
+	fclose(replay.fp);
+}
+
+void replay_init(enum replay_mode mode, const char *path,
+		 const unsigned long long *cycle_count)
+{
+	uint32_t magic = REPLAY_MAGIC;
+
+	replay_mode = mode;
+	replay.cycle_count = cycle_count;
+
+	switch (mode) {
+	case REPLAY_RECORD:
+		replay.fp = fopen(path, "w");
+		if (!replay.fp)
+			die("failed to create replay log %s\n", path);
+		if (fwrite(&magic, sizeof(magic), 1, replay.fp) != 1)
+			die("failed to write replay log\n");
+		atexit(replay_finish);
+		break;
+	case REPLAY_PLAY:
+		replay.fp = fopen(path, "r");
+		if (!replay.fp)
+			die("failed to open replay log %s\n", path);
+		if (fread(&magic, sizeof(magic), 1, replay.fp) != 1 ||
+		    magic != REPLAY_MAGIC)
+			die("%s is not a replay log\n", path);
+		replay_load();
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../debugger/protocol.h"
+
+enum replay_mode {
+	REPLAY_OFF,
+	REPLAY_RECORD,
+	REPLAY_PLAY,
+};
+
+enum replay_event {
+	REPLAY_EV_END,
+	REPLAY_EV_UART_DATA,
+	REPLAY_EV_SDCARD,
+	REPLAY_EV_DBG_REQUEST,
+};
+
+extern enum replay_mode replay_mode;
+
+static inline bool replay_playing(void)
+{
+	return replay_mode == REPLAY_PLAY;
+}
+
+void replay_init(enum replay_mode mode, const char *path,
+		 const unsigned long long *cycle_count);
+bool replay_pending(enum replay_event ev);
+uint32_t replay_input(enum replay_event ev, uint32_t val);
+uint8_t replay_sdcard_byte(uint8_t val);
+void replay_record_request(const struct dbg_request *req);
+int replay_next_request(struct dbg_request *req);
+void replay_sync(void);
+
+#endif /* __REPLAY_H__ */
@@ -0,0 +1,403 @@
+/*
+ * Reverse execution.
+ *
+ * Checkpoints are taken periodically while the CPU runs forwards and every
+ * write that the debugger makes to the CPU state is logged with the cycle
+ * that it was made on.  Going backwards restores the nearest checkpoint
+ * before the target cycle and re-executes forwards to it, replaying the
+ * debugger writes at the same points as the original run.
+ *
+ * The simulator tracks breakpoints from the debugger's writes of bkp
+ * instructions so that reverse_continue() can find the last time that a
+ * breakpoint was reached, including breakpoints that were inserted after
+ * that point in time.  Once the target has been reached the breakpoints in
+ * memory are made to match the debugger's current breakpoints, and any
+ * history after the target is discarded.
+ *
+ * Host input (the UART) is not logged, so programs that read from the UART
+ * during the re-executed region may not follow the same path.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "checkpoint.h"
+#include "cpu.h"
+#include "internal.h"
+#include "oldland-types.h"
+#include "reverse.h"
+
+#include "../debugger/protocol.h"
+
+#define MAX_CHECKPOINTS		1024
+
+static const uint32_t bkp_insn = (3 << 30 | OPCODE_BKP << 26);
+
+struct debug_write {
+	unsigned long long cycle;
+	int cmd;
+	uint32_t addr;
+	uint32_t wdata;
+};
+
+struct breakpoint {
+	uint32_t addr;
+	uint32_t orig_instr;
+	bool active;
+};
+
+struct scan {
+	unsigned long long hit, prev_hit;
+	bool have_hit, have_prev_hit;
+	/* The CPU hasn't left the PC of the last hit yet. */
+	bool in_hit;
+	uint32_t last_pc;
+	bool have_last_pc;
+};
+
+static struct {
+	struct cpu *cpu;
+	const unsigned long long *cycle_count;
+	unsigned long long interval;
+	bool enabled;
+
+	struct debug_write *writes;
+	size_t nr_writes, max_writes;
+
+	struct breakpoint *bkpts;
+	size_t nr_bkpts, max_bkpts;
+} reverse;
+
+bool reverse_enabled(void)
+{
+	return reverse.enabled;
+}
+
+void reverse_init(struct cpu *cpu, unsigned long long interval)
+{
+	reverse.cpu = cpu;
+	reverse.cycle_count = cpu_cycle_counter(cpu);
+	reverse.interval = interval ? interval : 1;
+	reverse.enabled = true;
+
+	checkpoint_enable();
+}
+
+static uint32_t cpu_pc(void)
+{
+	uint32_t pc;
+
+	cpu_read_reg(reverse.cpu, PC, &pc);
+
+	return pc;
+}
+
+void reverse_tick(void)
+{
+	struct checkpoint *latest = checkpoint_latest();
+
+	if (latest &&
+	    *reverse.cycle_count < checkpoint_cycle(latest) + reverse.interval)
+		return;
+
+	checkpoint_take(*reverse.cycle_count);
+	if (checkpoint_count() > MAX_CHECKPOINTS)
+		checkpoint_discard_oldest();
+}
+
+static struct breakpoint *find_bkpt(uint32_t addr)
+{
+	size_t n;
+
+	for (n = 0; n < reverse.nr_bkpts; ++n)
+		if (reverse.bkpts[n].addr == addr)
+			return &reverse.bkpts[n];
+
+	return NULL;
+}
+
+static void track_bkpt(uint32_t addr, uint32_t wdata)
+{
+	struct breakpoint *bkpt = find_bkpt(addr);
+	uint32_t old;
+	int tlb_miss;
+
+	if (wdata != bkp_insn) {
+		if (bkpt)
+			bkpt->active = false;
+		return;
+	}
+
+	if (cpu_read_mem(reverse.cpu, addr, &old, 32, &tlb_miss) ||
+	    tlb_miss || old == bkp_insn)
+		return;
+
+	if (!bkpt) {
+		if (reverse.nr_bkpts == reverse.max_bkpts) {
+			reverse.max_bkpts = reverse.max_bkpts * 2 ? : 16;
+			reverse.bkpts = realloc(reverse.bkpts,
+						reverse.max_bkpts *
+						sizeof(*reverse.bkpts));
+			assert(reverse.bkpts);
+		}
+		bkpt = &reverse.bkpts[reverse.nr_bkpts++];
+		bkpt->addr = addr;
+	}
+
+	bkpt->orig_instr = old;
+	bkpt->active = true;
+}
+
+/*
+ * Called before the debugger runs a command, writes to the CPU state are
+ * logged to be replayed when re-executing.
+ */
+void reverse_note_write(int cmd, uint32_t addr, uint32_t wdata)
+{
+	if (!reverse.enabled)
+		return;
+
+	switch (cmd) {
+	case CMD_WRITE_REG:
+	case CMD_WMEM32:
+	case CMD_WMEM16:
+	case CMD_WMEM8:
+	case CMD_CACHE_SYNC:
+		break;
+	default:
+		return;
+	}
+
+	if (cmd == CMD_WMEM32)
+		track_bkpt(addr, wdata);
+
+	if (reverse.nr_writes == reverse.max_writes) {
+		reverse.max_writes = reverse.max_writes * 2 ? : 1024;
+		reverse.writes = realloc(reverse.writes, reverse.max_writes *
+					 sizeof(*reverse.writes));
+		assert(reverse.writes);
+	}
+
+	reverse.writes[reverse.nr_writes++] = (struct debug_write) {
+		.cycle = *reverse.cycle_count,
+		.cmd = cmd,
+		.addr = addr,
+		.wdata = wdata,
+	};
+}
+
+/*
+ * The cycle counter restarts on reset so there's no history to go back to.
+ */
+void reverse_reset(void)
+{
+	if (!reverse.enabled)
+		return;
+
+	checkpoint_discard_all();
+	reverse.nr_writes = 0;
+}
+
+static void apply_write(const struct debug_write *w)
+{
+	switch (w->cmd) {
+	case CMD_WRITE_REG:
+		cpu_write_reg(reverse.cpu, w->addr, w->wdata);
+		break;
+	case CMD_WMEM32:
+		cpu_write_mem(reverse.cpu, w->addr, w->wdata, 32);
+		break;
+	case CMD_WMEM16:
+		cpu_write_mem(reverse.cpu, w->addr, w->wdata, 16);
+		break;
+	case CMD_WMEM8:
+		cpu_write_mem(reverse.cpu, w->addr, w->wdata, 8);
+		break;
+	case CMD_CACHE_SYNC:
+		cpu_cache_sync(reverse.cpu);
+		break;
+	}
+}
+
+static size_t first_write_at(unsigned long long cycle)
+{
+	size_t lo = 0, hi = reverse.nr_writes;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (reverse.writes[mid].cycle < cycle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void scan_visit(struct scan *scan, unsigned long long cycle,
+		       uint32_t pc)
+{
+	struct breakpoint *bkpt;
+
+	if (scan->have_last_pc && pc == scan->last_pc)
+		return;
+
+	scan->in_hit = false;
+	scan->last_pc = pc;
+	scan->have_last_pc = true;
+
+	bkpt = find_bkpt(pc);
+	if (!bkpt || !bkpt->active)
+		return;
+
+	scan->prev_hit = scan->hit;
+	scan->have_prev_hit = scan->have_hit;
+	scan->hit = cycle;
+	scan->have_hit = true;
+	scan->in_hit = true;
+}
+
+static struct checkpoint *checkpoint_at_or_before(unsigned long long cycle)
+{
+	struct checkpoint *ck = checkpoint_latest();
+
+	while (ck && checkpoint_cycle(ck) > cycle)
+		ck = checkpoint_prev(ck);
+	assert(ck);
+
+	return ck;
+}
+
+/*
+ * Restore a checkpoint and run forwards to target, optionally recording
+ * where breakpoints were reached.
+ */
+static void reexecute_from(struct checkpoint *ck, unsigned long long target,
+			   struct scan *scan)
+{
+	size_t w;
+
+	checkpoint_restore(ck);
+
+	for (w = first_write_at(*reverse.cycle_count);;) {
+		unsigned long long cycle = *reverse.cycle_count;
+		bool breakpoint_hit = false;
+
+		if (cycle >= target)
+			break;
+
+		while (w < reverse.nr_writes && reverse.writes[w].cycle == cycle)
+			apply_write(&reverse.writes[w++]);
+
+		if (scan)
+			scan_visit(scan, cycle, cpu_pc());
+
+		cpu_cycle(reverse.cpu, &breakpoint_hit);
+	}
+}
+
+static void reexecute(unsigned long long target)
+{
+	reexecute_from(checkpoint_at_or_before(target), target, NULL);
+}
+
+/*
+ * Make the breakpoints in memory match the debugger's current view and
+ * discard the future.
+ */
+static void land(void)
+{
+	bool synced = false;
+	size_t n;
+
+	reverse.nr_writes = first_write_at(*reverse.cycle_count);
+
+	for (n = 0; n < reverse.nr_bkpts; ++n) {
+		struct breakpoint *bkpt = &reverse.bkpts[n];
+		uint32_t v, want = bkpt->active ? bkp_insn : bkpt->orig_instr;
+		int tlb_miss;
+
+		if (cpu_read_mem(reverse.cpu, bkpt->addr, &v, 32, &tlb_miss) ||
+		    tlb_miss || v == want || (!bkpt->active && v != bkp_insn))
+			continue;
+
+		reverse_note_write(CMD_WMEM32, bkpt->addr, want);
+		cpu_write_mem(reverse.cpu, bkpt->addr, want, 32);
+		synced = true;
+	}
+
+	if (synced) {
+		reverse_note_write(CMD_CACHE_SYNC, 0, 0);
+		cpu_cache_sync(reverse.cpu);
+	}
+}
+
+static unsigned long long oldest_cycle(void)
+{
+	struct checkpoint *ck = checkpoint_latest();
+
+	while (ck && checkpoint_prev(ck))
+		ck = checkpoint_prev(ck);
+
+	return ck ? checkpoint_cycle(ck) : *reverse.cycle_count;
+}
+
+int reverse_step(void)
+{
+	unsigned long long now = *reverse.cycle_count;
+
+	if (!reverse.enabled)
+		return -EINVAL;
+	if (now <= oldest_cycle())
+		return -ERANGE;
+
+	reexecute(now - 1);
+	land();
+
+	return 0;
+}
+
+/*
+ * Go back to the last time that the CPU reached an active breakpoint, not
+ * counting the breakpoint that it is currently stopped at.  Without an
+ * earlier breakpoint this stops at the start of the history.
+ */
+int reverse_continue(void)
+{
+	unsigned long long now = *reverse.cycle_count;
+	unsigned long long end = now;
+	uint32_t now_pc = cpu_pc();
+
+	if (!reverse.enabled)
+		return -EINVAL;
+	if (now <= oldest_cycle())
+		return -ERANGE;
+
+	while (end > oldest_cycle()) {
+		struct checkpoint *ck = checkpoint_at_or_before(end - 1);
+		unsigned long long start = checkpoint_cycle(ck);
+		struct scan scan = {};
+
+		reexecute_from(ck, end, &scan);
+
+		if (end == now && scan.in_hit && scan.last_pc == now_pc) {
+			scan.hit = scan.prev_hit;
+			scan.have_hit = scan.have_prev_hit;
+		}
+
+		if (scan.have_hit) {
+			reexecute(scan.hit);
+			land();
+			return 0;
+		}
+
+		end = start;
+	}
+
+	reexecute(end);
+	land();
+
+	return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef __REVERSE_H__
+#define __REVERSE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct cpu;
+
+void reverse_init(struct cpu *cpu, unsigned long long interval);
+bool reverse_enabled(void);
+void reverse_tick(void);
+void reverse_note_write(int cmd, uint32_t addr, uint32_t wdata);
+void reverse_reset(void);
+int reverse_step(void);
+int reverse_continue(void);
+
+#endif /* __REVERSE_H__ */
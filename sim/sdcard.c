@@ -1,30 +1,50 @@
 #define _GNU_SOURCE
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "checkpoint.h"
+#include "replay.h"
 #include "sdcard.h"
 
 #include "../devicemodels/spi_sdcard.h"
 
+static const char *sdcard_overlay;
+static unsigned int sdcard_flags;
+
+void sdcard_configure(const char *overlay, bool writable)
+{
+	sdcard_overlay = overlay;
+	sdcard_flags = writable ? SPI_SDCARD_WRITABLE : 0;
+}
+
 static void sdcard_exchange_bytes(struct spislave *slave,
 				  uint8_t master_to_slave,
 				  uint8_t *slave_to_master)
 {
 	struct spi_sdcard *sdcard = slave->privdata;
 
-	*slave_to_master = spi_sdcard_next_byte_to_master(sdcard);
-	spi_sdcard_next_byte_to_slave(sdcard, master_to_slave);
+	/* When replaying the card image isn't needed, the data is logged. */
+	if (!replay_playing()) {
+		*slave_to_master = spi_sdcard_next_byte_to_master(sdcard);
+		spi_sdcard_next_byte_to_slave(sdcard, master_to_slave);
+	}
+	*slave_to_master = replay_sdcard_byte(*slave_to_master);
 }
 
 struct spislave *sdcard_new(const char *sdcard_image)
 {
 	struct spislave *slave;
-	struct spi_sdcard *sdcard;
-
-	sdcard = spi_sdcard_new(sdcard_image);
-	assert(sdcard != NULL);
+	struct spi_sdcard *sdcard = NULL;
+
+	if (!replay_playing()) {
+		sdcard = spi_sdcard_open(sdcard_image, sdcard_overlay,
+					 sdcard_flags);
+		assert(sdcard != NULL);
+		checkpoint_register(sdcard, spi_sdcard_state_size());
+	}
 
 	slave = calloc(1, sizeof(*slave));
 	assert(slave != NULL);
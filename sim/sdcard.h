@@ -1,8 +1,13 @@
 #ifndef __SDCARD_H__
 #define __SDCARD_H__
 
+#include <stdbool.h>
+
 #include "spimaster.h"
 
+/* Must be called before the card is created. */
+void sdcard_configure(const char *overlay, bool writable);
+
 struct spislave *sdcard_new(const char *sdcard_image);
 
 #endif /* __SDCARD_H__ */
@@ -0,0 +1,65 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Search helpers for the tag and TLB arrays.  SSE2 is used on x86-64 and
+ * AVX2 when the simulator is built with it, otherwise a plain loop.
+ */
+#if defined(__AVX2__)
+#define SIMD_U32_LANES		8
+#elif defined(__SSE2__)
+#define SIMD_U32_LANES		4
+#else
+#define SIMD_U32_LANES		1
+#endif
+
+/* Round a number of words up to a whole number of vectors. */
+#define SIMD_U32_PAD(n)	(((n) + SIMD_U32_LANES - 1) & ~(SIMD_U32_LANES - 1))
+
+/*
+ * Returns the index of the first word in v equal to key, or -1.  n must be
+ * padded with SIMD_U32_PAD() and the padding must never equal key.
+ */
+static inline int simd_find_u32(const uint32_t *v, unsigned int n,
+				uint32_t key)
+{
+	unsigned int m;
+
+#if defined(__AVX2__)
+	__m256i k = _mm256_set1_epi32(key);
+
+	for (m = 0; m < n; m += 8) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)&v[m]);
+		int mask = _mm256_movemask_ps(
+			_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, k)));
+
+		if (mask)
+			return m + __builtin_ctz(mask);
+	}
+#elif defined(__SSE2__)
+	__m128i k = _mm_set1_epi32(key);
+
+	for (m = 0; m < n; m += 4) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&v[m]);
+		int mask = _mm_movemask_ps(
+			_mm_castsi128_ps(_mm_cmpeq_epi32(t, k)));
+
+		if (mask)
+			return m + __builtin_ctz(mask);
+	}
+#else
+	for (m = 0; m < n; ++m)
+		if (v[m] == key)
+			return m;
+#endif
+
+	return -1;
+}
+
+#endif /* __SIMD_H__ */
@@ -0,0 +1,148 @@
+/*
+ * Multi-core execution.
+ *
+ * Each core runs on its own host thread in lock-step quanta: the cores are
+ * released together, each runs for up to a quantum of cycles and then waits
+ * at a barrier for the others.  Core 0 runs on the calling thread.  Memory is
+ * shared without synchronization between cores, device accesses are
+ * serialized by the memory map and the device events (timers) are advanced
+ * once all of the cores have finished the quantum, so devices are only
+ * accurate to a quantum.
+ *
+ * If any core hits a breakpoint then all of the cores stop at the end of
+ * their current cycle so that the debugger sees a consistent system.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "internal.h"
+#include "periodic.h"
+#include "smp.h"
+
+struct smp_core {
+	struct smp *smp;
+	struct cpu *cpu;
+	pthread_t thread;
+	unsigned long cycles;
+	bool breakpoint_hit;
+};
+
+struct smp {
+	unsigned int nr_cores;
+	unsigned long quantum;
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+	/* Parameters for the current quantum, written before the start. */
+	unsigned long max_cycles;
+	bool stop;
+	struct smp_core cores[];
+};
+
+static void smp_run_core(struct smp_core *core)
+{
+	struct smp *smp = core->smp;
+
+	core->breakpoint_hit = false;
+	for (core->cycles = 0; core->cycles < smp->max_cycles; ) {
+		if (__atomic_load_n(&smp->stop, __ATOMIC_RELAXED))
+			break;
+
+		cpu_cycle(core->cpu, &core->breakpoint_hit);
+		++core->cycles;
+
+		if (core->breakpoint_hit) {
+			__atomic_store_n(&smp->stop, true, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+static void *smp_core_thread(void *data)
+{
+	struct smp_core *core = data;
+
+	for (;;) {
+		pthread_barrier_wait(&core->smp->start);
+		smp_run_core(core);
+		pthread_barrier_wait(&core->smp->done);
+	}
+
+	return NULL;
+}
+
+struct smp *smp_init(struct cpu **cpus, unsigned int nr_cores,
+		     unsigned long quantum)
+{
+	struct smp *smp;
+	unsigned int n;
+
+	smp = calloc(1, sizeof(*smp) + nr_cores * sizeof(smp->cores[0]));
+	assert(smp);
+
+	smp->nr_cores = nr_cores;
+	smp->quantum = quantum ? quantum : 1;
+
+	if (pthread_barrier_init(&smp->start, NULL, nr_cores) ||
+	    pthread_barrier_init(&smp->done, NULL, nr_cores))
+		die("failed to create SMP barriers\n");
+
+	for (n = 0; n < nr_cores; ++n) {
+		smp->cores[n].smp = smp;
+		smp->cores[n].cpu = cpus[n];
+	}
+
+	for (n = 1; n < nr_cores; ++n)
+		if (pthread_create(&smp->cores[n].thread, NULL,
+				   smp_core_thread, &smp->cores[n]))
+			die("failed to create thread for core %u\n", n);
+
+	return smp;
+}
+
+/*
+ * Run all of the cores for a quantum (or max_cycles if smaller) and then
+ * synchronize the devices.  Returns the number of cycles that the system
+ * advanced by.
+ */
+unsigned long smp_run(struct smp *smp, unsigned long max_cycles,
+		      bool *breakpoint_hit)
+{
+	unsigned long cycles = 0;
+	unsigned int n;
+
+	smp->max_cycles = max_cycles < smp->quantum ? max_cycles : smp->quantum;
+	smp->stop = false;
+
+	pthread_barrier_wait(&smp->start);
+	smp_run_core(&smp->cores[0]);
+	pthread_barrier_wait(&smp->done);
+
+	for (n = 0; n < smp->nr_cores; ++n) {
+		if (smp->cores[n].cycles > cycles)
+			cycles = smp->cores[n].cycles;
+		*breakpoint_hit |= smp->cores[n].breakpoint_hit;
+	}
+
+	event_list_advance(cpu_events(smp->cores[0].cpu), cycles);
+
+	return cycles;
+}
+
+/*
+ * The lowest numbered core that hit a breakpoint in the last smp_run(), or
+ * core 0 if none did.
+ */
+unsigned int smp_stopped_core(const struct smp *smp)
+{
+	unsigned int n;
+
+	for (n = 0; n < smp->nr_cores; ++n)
+		if (smp->cores[n].breakpoint_hit)
+			return n;
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include <stdbool.h>
+
+struct cpu;
+struct smp;
+
+struct smp *smp_init(struct cpu **cpus, unsigned int nr_cores,
+		     unsigned long quantum);
+unsigned long smp_run(struct smp *smp, unsigned long max_cycles,
+		      bool *breakpoint_hit);
+unsigned int smp_stopped_core(const struct smp *smp);
+
+#endif /* __SMP_H__ */
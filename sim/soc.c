@@ -0,0 +1,424 @@
+/*
+ * Board descriptions.
+ *
+ * The simulator defaults to the board that it was built for but can load any
+ * keynsham description at startup, so one binary covers all of the boards in
+ * config/ and memory sizes can be changed without rebuilding.  The parser
+ * handles the flow style that the descriptions are written in: {} maps, []
+ * lists, bare or quoted scalars and # comments, which also covers JSON.
+ * Anything that a description leaves out keeps its built-in value.
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+#include "io.h"
+#include "soc.h"
+#include "spimaster.h"
+
+#define SOC_NR_IRQS		32
+
+static struct soc soc = {
+	.manufacturer		= CPUID_MANUFACTURER,
+	.model			= CPUID_MODEL,
+	.clock_speed		= CPU_CLOCK_SPEED,
+	.icache			= { ICACHE_SIZE, ICACHE_LINE_SIZE,
+				    ICACHE_NUM_WAYS },
+	.dcache			= { DCACHE_SIZE, DCACHE_LINE_SIZE,
+				    DCACHE_NUM_WAYS },
+	.itlb_entries		= ITLB_NUM_ENTRIES,
+	.dtlb_entries		= DTLB_NUM_ENTRIES,
+	.peripherals		= {
+		{ "ram", RAM_ADDRESS, RAM_SIZE },
+		{ "bootrom", BOOTROM_ADDRESS, BOOTROM_SIZE },
+		{ "sdram", SDRAM_ADDRESS, SDRAM_SIZE },
+		{ "sdram_ctrl", SDRAM_CTRL_ADDRESS, SDRAM_CTRL_SIZE },
+		{ "uart", UART_ADDRESS, UART_SIZE, { UART_IRQ }, 1 },
+		{ "irq", IRQ_ADDRESS, IRQ_SIZE },
+		{ "timer", TIMER_ADDRESS, TIMER_SIZE, { TIMER_IRQ,
+		  TIMER_IRQ + 1, TIMER_IRQ + 2, TIMER_IRQ + 3 }, 4 },
+		{ "spimaster", SPIMASTER_ADDRESS, SPIMASTER_SIZE,
+		  { SPIMASTER_IRQ }, 1 },
+	},
+	.nr_peripherals		= 8,
+};
+
+enum node_type {
+	NODE_SCALAR,
+	NODE_MAP,
+	NODE_LIST,
+};
+
+struct node {
+	enum node_type type;
+	unsigned int line;
+	/* Set for the members of a map. */
+	char *key;
+	/* Set for scalars. */
+	char *value;
+	struct node *child;
+	struct node *next;
+};
+
+struct parser {
+	const char *path;
+	const char *p;
+	unsigned int line;
+};
+
+#define soc_error(path, line, fmt, ...) \
+	die("%s:%u: " fmt, (path), (line), ##__VA_ARGS__)
+
+static void skip_space(struct parser *ps)
+{
+	for (;;) {
+		if (*ps->p == '\n')
+			ps->line++;
+		if (isspace((unsigned char)*ps->p))
+			ps->p++;
+		else if (*ps->p == '#')
+			ps->p += strcspn(ps->p, "\n");
+		else
+			break;
+	}
+}
+
+static struct node *node_new(struct parser *ps, enum node_type type)
+{
+	struct node *n = calloc(1, sizeof(*n));
+
+	assert(n);
+	n->type = type;
+	n->line = ps->line;
+
+	return n;
+}
+
+static void node_free(struct node *n)
+{
+	while (n) {
+		struct node *next = n->next;
+
+		node_free(n->child);
+		free(n->key);
+		free(n->value);
+		free(n);
+		n = next;
+	}
+}
+
+static char *parse_string(struct parser *ps)
+{
+	const char *start = ps->p;
+	char quote = *ps->p;
+	char *s, *d;
+
+	if (quote != '"' && quote != '\'') {
+		ps->p += strcspn(ps->p, " \t\r\n,:{}[]#");
+		if (ps->p == start)
+			soc_error(ps->path, ps->line, "unexpected '%c'\n",
+				  *ps->p ? *ps->p : ' ');
+		return strndup(start, ps->p - start);
+	}
+
+	s = d = malloc(strlen(start) + 1);
+	assert(s);
+	for (ps->p++; *ps->p != quote; ps->p++) {
+		if (*ps->p == '\0' || *ps->p == '\n')
+			soc_error(ps->path, ps->line, "unterminated string\n");
+		if (*ps->p == '\\' && quote == '"' && ps->p[1])
+			ps->p++;
+		*d++ = *ps->p;
+	}
+	ps->p++;
+	*d = '\0';
+
+	return s;
+}
+
+static struct node *parse_value(struct parser *ps);
+
+/* Parses the members of a map or list up to the closing bracket. */
+static void parse_members(struct parser *ps, struct node *parent, char close)
+{
+	struct node **tail = &parent->child;
+
+	for (;;) {
+		char *key = NULL;
+
+		skip_space(ps);
+		if (*ps->p == close)
+			break;
+
+		if (parent->type == NODE_MAP) {
+			key = parse_string(ps);
+			skip_space(ps);
+			if (*ps->p != ':')
+				soc_error(ps->path, ps->line,
+					  "expected ':' after %s\n", key);
+			ps->p++;
+		}
+
+		*tail = parse_value(ps);
+		(*tail)->key = key;
+		tail = &(*tail)->next;
+
+		skip_space(ps);
+		if (*ps->p == ',')
+			ps->p++;
+		else if (*ps->p != close)
+			soc_error(ps->path, ps->line, "expected ',' or '%c'\n",
+				  close);
+	}
+	ps->p++;
+}
+
+static struct node *parse_value(struct parser *ps)
+{
+	struct node *n;
+
+	skip_space(ps);
+	if (*ps->p == '{') {
+		n = node_new(ps, NODE_MAP);
+		ps->p++;
+		parse_members(ps, n, '}');
+	} else if (*ps->p == '[') {
+		n = node_new(ps, NODE_LIST);
+		ps->p++;
+		parse_members(ps, n, ']');
+	} else {
+		n = node_new(ps, NODE_SCALAR);
+		n->value = parse_string(ps);
+	}
+
+	return n;
+}
+
+static char *read_file(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	char *buf = NULL;
+	size_t len = 0, br;
+
+	if (!fp)
+		die("failed to open %s (%s)\n", path, strerror(errno));
+
+	do {
+		buf = realloc(buf, len + 4096 + 1);
+		assert(buf);
+		br = fread(buf + len, 1, 4096, fp);
+		len += br;
+	} while (br);
+	buf[len] = '\0';
+
+	if (ferror(fp))
+		die("failed to read %s\n", path);
+	fclose(fp);
+
+	return buf;
+}
+
+static const struct node *node_get(const struct node *map, const char *key)
+{
+	const struct node *n;
+
+	if (!map || map->type != NODE_MAP)
+		return NULL;
+
+	for (n = map->child; n; n = n->next)
+		if (!strcmp(n->key, key))
+			return n;
+
+	return NULL;
+}
+
+static uint32_t node_u32(const char *path, const struct node *n,
+			 const char *what)
+{
+	unsigned long long v;
+	char *end;
+
+	if (n->type != NODE_SCALAR)
+		soc_error(path, n->line, "%s must be a number\n", what);
+
+	errno = 0;
+	v = strtoull(n->value, &end, 0);
+	if (errno || *end || end == n->value || v > UINT32_MAX)
+		soc_error(path, n->line, "%s must be a 32-bit number, not %s\n",
+			  what, n->value);
+
+	return v;
+}
+
+static void get_u32(const char *path, const struct node *map,
+		    const char *key, uint32_t *val)
+{
+	const struct node *n = node_get(map, key);
+
+	if (n)
+		*val = node_u32(path, n, key);
+}
+
+static void load_cache(const char *path, const struct node *n,
+		       struct soc_cache *cache)
+{
+	get_u32(path, n, "size", &cache->size);
+	get_u32(path, n, "line_size", &cache->line_size);
+	get_u32(path, n, "num_ways", &cache->num_ways);
+}
+
+static void load_peripheral(const char *path, const struct node *n,
+			    struct soc_peripheral *p)
+{
+	const struct node *name = node_get(n, "name");
+	const struct node *address = node_get(n, "address");
+	const struct node *size = node_get(n, "size");
+	const struct node *irqs = node_get(n, "interrupts");
+	const struct node *irq;
+
+	if (!name || name->type != NODE_SCALAR || !address || !size)
+		soc_error(path, n->line,
+			  "peripherals need a name, address and size\n");
+	if (strlen(name->value) >= sizeof(p->name))
+		soc_error(path, name->line, "name %s is too long\n",
+			  name->value);
+
+	strcpy(p->name, name->value);
+	p->address = node_u32(path, address, "address");
+	p->size = node_u32(path, size, "size");
+	if (!p->size || (uint64_t)p->address + p->size > (1ULL << 32))
+		soc_error(path, size->line, "%s has an invalid size\n",
+			  p->name);
+	/* The memory map works in pages. */
+	if (p->address % PAGE_SIZE || p->size % PAGE_SIZE)
+		soc_error(path, address->line,
+			  "%s must be page aligned and a multiple of %u bytes\n",
+			  p->name, PAGE_SIZE);
+
+	if (!irqs)
+		return;
+	if (irqs->type != NODE_LIST)
+		soc_error(path, irqs->line, "interrupts must be a list\n");
+	for (irq = irqs->child; irq; irq = irq->next) {
+		if (p->nr_irqs == SOC_MAX_IRQS)
+			soc_error(path, irq->line, "too many interrupts\n");
+		p->irqs[p->nr_irqs] = node_u32(path, irq, "interrupt");
+		if (p->irqs[p->nr_irqs] >= SOC_NR_IRQS)
+			soc_error(path, irq->line,
+				  "interrupts must be less than %u\n",
+				  SOC_NR_IRQS);
+		p->nr_irqs++;
+	}
+}
+
+static void load_peripherals(const char *path, const struct node *list)
+{
+	const struct node *n;
+
+	if (list->type != NODE_LIST)
+		soc_error(path, list->line, "peripherals must be a list\n");
+
+	memset(soc.peripherals, 0, sizeof(soc.peripherals));
+	soc.nr_peripherals = 0;
+	for (n = list->child; n; n = n->next) {
+		unsigned int m;
+
+		if (soc.nr_peripherals == SOC_MAX_PERIPHERALS)
+			soc_error(path, n->line, "too many peripherals\n");
+		load_peripheral(path, n, &soc.peripherals[soc.nr_peripherals]);
+
+		for (m = 0; m < soc.nr_peripherals; ++m) {
+			const struct soc_peripheral *a = &soc.peripherals[m];
+			const struct soc_peripheral *b =
+				&soc.peripherals[soc.nr_peripherals];
+
+			if (!strcmp(a->name, b->name))
+				soc_error(path, n->line, "duplicate %s\n",
+					  b->name);
+			if (a->address < b->address + (uint64_t)b->size &&
+			    b->address < a->address + (uint64_t)a->size)
+				soc_error(path, n->line, "%s overlaps %s\n",
+					  b->name, a->name);
+		}
+		soc.nr_peripherals++;
+	}
+}
+
+static void check_cache(const char *path, const char *name,
+			const struct soc_cache *cache, unsigned int size,
+			unsigned int line_size, unsigned int num_ways)
+{
+	/* The cache arrays are sized at build time. */
+	if (cache->size != size || cache->line_size != line_size ||
+	    cache->num_ways != num_ways)
+		warnx("%s: %s geometry differs from the build, simulating %u bytes, %u byte lines, %u ways",
+		      path, name, size, line_size, num_ways);
+}
+
+void soc_configure(const char *path)
+{
+	struct parser ps = { .path = path, .line = 1 };
+	const struct node *cpu, *n;
+	struct node *root;
+	char *buf;
+
+	if (!path)
+		return;
+
+	ps.p = buf = read_file(path);
+	root = parse_value(&ps);
+	skip_space(&ps);
+	if (*ps.p)
+		soc_error(path, ps.line, "trailing characters\n");
+	if (root->type != NODE_MAP)
+		soc_error(path, root->line, "expected a map\n");
+
+	cpu = node_get(root, "cpu");
+	get_u32(path, cpu, "manufacturer", &soc.manufacturer);
+	get_u32(path, cpu, "model", &soc.model);
+	get_u32(path, cpu, "clock_speed", &soc.clock_speed);
+	load_cache(path, node_get(cpu, "icache"), &soc.icache);
+	load_cache(path, node_get(cpu, "dcache"), &soc.dcache);
+	get_u32(path, node_get(cpu, "itlb"), "num_entries", &soc.itlb_entries);
+	get_u32(path, node_get(cpu, "dtlb"), "num_entries", &soc.dtlb_entries);
+	if (!soc.itlb_entries || soc.itlb_entries > UINT16_MAX ||
+	    !soc.dtlb_entries || soc.dtlb_entries > UINT16_MAX)
+		die("%s: TLBs must have between 1 and %u entries\n", path,
+		    UINT16_MAX);
+
+	check_cache(path, "icache", &soc.icache, ICACHE_SIZE,
+		    ICACHE_LINE_SIZE, ICACHE_NUM_WAYS);
+	check_cache(path, "dcache", &soc.dcache, DCACHE_SIZE,
+		    DCACHE_LINE_SIZE, DCACHE_NUM_WAYS);
+
+	n = node_get(root, "peripherals");
+	if (n)
+		load_peripherals(path, n);
+	if (!soc_find(&soc, "bootrom"))
+		die("%s: there is no bootrom to reset to\n", path);
+
+	node_free(root);
+	free(buf);
+}
+
+const struct soc *soc_get(void)
+{
+	return &soc;
+}
+
+const struct soc_peripheral *soc_find(const struct soc *soc, const char *name)
+{
+	unsigned int m;
+
+	for (m = 0; m < soc->nr_peripherals; ++m)
+		if (!strcmp(soc->peripherals[m].name, name))
+			return &soc->peripherals[m];
+
+	return NULL;
+}
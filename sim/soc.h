@@ -0,0 +1,45 @@
+#ifndef __SOC_H__
+#define __SOC_H__
+
+#include <stdint.h>
+
+#define SOC_MAX_PERIPHERALS	16
+#define SOC_MAX_IRQS		8
+#define SOC_NAME_LEN		32
+
+struct soc_cache {
+	uint32_t size;
+	uint32_t line_size;
+	uint32_t num_ways;
+};
+
+struct soc_peripheral {
+	char name[SOC_NAME_LEN];
+	uint32_t address;
+	uint32_t size;
+	uint32_t irqs[SOC_MAX_IRQS];
+	unsigned int nr_irqs;
+};
+
+/* The CPU parameters and peripherals of a board, as described in config/. */
+struct soc {
+	uint32_t manufacturer;
+	uint32_t model;
+	uint32_t clock_speed;
+	struct soc_cache icache;
+	struct soc_cache dcache;
+	uint32_t itlb_entries;
+	uint32_t dtlb_entries;
+	struct soc_peripheral peripherals[SOC_MAX_PERIPHERALS];
+	unsigned int nr_peripherals;
+};
+
+/*
+ * Load a keynsham board description, or keep the board the simulator was
+ * built for if path is NULL.  Must be called before the CPUs are created.
+ */
+void soc_configure(const char *path);
+const struct soc *soc_get(void);
+const struct soc_peripheral *soc_find(const struct soc *soc, const char *name);
+
+#endif /* __SOC_H__ */
@@ -1,54 +1,86 @@
+/*
+ * SPI master with an 8KB transfer buffer.  The CPU either fills the buffer
+ * and polls XFER_BUSY, or sets XFER_DMA_TX/XFER_DMA_RX to have the bytes
+ * copied from and to memory.  DMA transfers complete after the time the bytes
+ * would take on the bus at the current divider rather than on register
+ * reads, and raise the completion interrupt if XFER_IRQ_ENABLE is set.
+ *
+ * How CPU driven transfers progress depends on the transfer mode: polled
+ * transfers move a byte per register read, timed transfers complete after
+ * the bus time like DMA, and instant transfers complete when they start.
+ */
 #include <assert.h>
+#include <err.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "checkpoint.h"
 #include "internal.h"
 #include "io.h"
+#include "irq_ctrl.h"
+#include "periodic.h"
 #include "spimaster.h"
 
-#define SPIMASTER_NUM_REGS ((SPI_XFER_CONTROL_REG_OFFS + 4) / 4)
+#define SPIMASTER_NUM_REGS ((SPI_EOI_REG_OFFS + 4) / 4)
+#define SPI_XFER_BUF_OFFS 8192
+
+static enum spimaster_mode spimaster_mode = SPIMASTER_POLLED;
+
+void spimaster_set_mode(enum spimaster_mode mode)
+{
+	spimaster_mode = mode;
+}
 
 struct spimaster {
+	struct mem_map *mem;
+	struct event *event;
+	struct irq_ctrl *irq_ctrl;
+	unsigned int irq;
 	struct spislave **slaves;
 	unsigned int nr_slaves;
 	uint32_t regs[SPIMASTER_NUM_REGS];
 
+	enum spimaster_mode mode;
 	bool loopback_enabled;
+	/* The transfer completes from the event rather than register reads. */
+	bool deferred;
 	uint16_t xfer_length;
 	uint16_t bytes_xfered;
 
 	uint8_t __attribute__((aligned(4))) xfer_buf[8192];
 };
 
-static void spimaster_start_xfer(struct spimaster *master)
+static uint32_t *xfer_ctrl(struct spimaster *master)
 {
-	master->loopback_enabled = master->regs[SPI_CONTROL_REG_OFFS / 4] &
-                SPI_LOOPBACK_ENABLE_MASK;
-	master->xfer_length = master->regs[SPI_XFER_CONTROL_REG_OFFS / 4] & 0xffff;
-	master->bytes_xfered = 0;
+	return &master->regs[SPI_XFER_CONTROL_REG_OFFS / 4];
 }
 
-static int spimaster_write(unsigned int offs, uint32_t val, size_t nr_bits,
-			   void *priv)
+/* Copy between memory and the transfer buffer, returns false on a fault. */
+static bool spimaster_dma(struct spimaster *master, physaddr_t addr,
+			  bool to_buf)
 {
-	struct spimaster *master = priv;
-	unsigned int regnum = offs >> 2;
+	unsigned int m;
 
-	if (regnum < SPIMASTER_NUM_REGS) {
-		if (nr_bits != 32)
-			return -EFAULT;
-		master->regs[regnum] = val;
+	for (m = 0; m < master->xfer_length; ++m) {
+		uint32_t v = master->xfer_buf[m];
+		int rc = to_buf ? mem_map_read(master->mem, addr + m, 8, &v) :
+			mem_map_write(master->mem, addr + m, 8, v);
 
-		if (regnum == SPI_XFER_CONTROL_REG_OFFS / 4)
-			spimaster_start_xfer(master);
-	} else if (offs >= 8192) {
-		memcpy(master->xfer_buf + offs - 8192, &val, nr_bits / 8);
+		if (rc)
+			return false;
+		master->xfer_buf[m] = v;
 	}
 
-	return 0;
+	return true;
+}
+
+static void spimaster_complete(struct spimaster *master)
+{
+	if (*xfer_ctrl(master) & XFER_IRQ_ENABLE_MASK)
+		irq_ctrl_raise_irq(master->irq_ctrl, master->irq);
 }
 
 static uint8_t slave_xfer(struct spimaster *master, struct spislave *slave)
@@ -76,9 +108,6 @@ static void xfer_slaves(struct spimaster *master)
 	master->xfer_buf[master->bytes_xfered] = v;
 }
 
-/*
- * Transfer a byte every time the master is read to exercise polling.
- */
 static void spimaster_xfer_byte(struct spimaster *master)
 {
 	if (master->bytes_xfered >= master->xfer_length)
@@ -90,21 +119,122 @@ static void spimaster_xfer_byte(struct spimaster *master)
 	master->bytes_xfered++;
 }
 
+static void spimaster_finish(struct spimaster *master)
+{
+	while (master->bytes_xfered < master->xfer_length)
+		spimaster_xfer_byte(master);
+
+	if ((*xfer_ctrl(master) & XFER_DMA_RX_MASK) &&
+	    !spimaster_dma(master, master->regs[SPI_DMA_RX_ADDR_REG_OFFS / 4],
+			   false))
+		*xfer_ctrl(master) |= XFER_DMA_ERROR_MASK;
+
+	master->deferred = false;
+	spimaster_complete(master);
+}
+
+/*
+ * Each byte takes 8 SPI clocks and each SPI clock is 2 * (divider + 1) CPU
+ * cycles.
+ */
+static uint32_t spimaster_xfer_cycles(struct spimaster *master)
+{
+	uint32_t divider = master->regs[SPI_CONTROL_REG_OFFS / 4] &
+		SPI_DIVIDER_MASK;
+
+	return master->xfer_length * 16 * (divider + 1) + 1;
+}
+
+static void spimaster_start_xfer(struct spimaster *master)
+{
+	uint32_t ctrl = *xfer_ctrl(master);
+
+	master->loopback_enabled = master->regs[SPI_CONTROL_REG_OFFS / 4] &
+                SPI_LOOPBACK_ENABLE_MASK;
+	master->xfer_length = ctrl & XFER_LENGTH_MASK;
+	master->bytes_xfered = 0;
+
+	*xfer_ctrl(master) &= ~XFER_DMA_ERROR_MASK;
+	master->deferred = master->mode != SPIMASTER_POLLED ||
+		(ctrl & (XFER_DMA_TX_MASK | XFER_DMA_RX_MASK));
+	if (!master->deferred)
+		return;
+
+	if ((ctrl & XFER_DMA_TX_MASK) &&
+	    !spimaster_dma(master, master->regs[SPI_DMA_TX_ADDR_REG_OFFS / 4],
+			   true)) {
+		*xfer_ctrl(master) |= XFER_DMA_ERROR_MASK;
+		master->bytes_xfered = master->xfer_length;
+		master->deferred = false;
+		spimaster_complete(master);
+		return;
+	}
+
+	if (master->mode == SPIMASTER_INSTANT) {
+		spimaster_finish(master);
+		return;
+	}
+
+	event_mod(master->event, spimaster_xfer_cycles(master));
+	event_enable(master->event);
+}
+
+int spimaster_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv)
+{
+	struct spimaster *master = priv;
+	unsigned int regnum = offs >> 2;
+
+	if (regnum < SPIMASTER_NUM_REGS) {
+		if (nr_bits != 32)
+			return -EFAULT;
+		master->regs[regnum] = val;
+
+		if (regnum == SPI_EOI_REG_OFFS / 4)
+			irq_ctrl_clear_irq(master->irq_ctrl, master->irq);
+		if (regnum == SPI_XFER_CONTROL_REG_OFFS / 4 &&
+		    (val & XFER_GO_MASK))
+			spimaster_start_xfer(master);
+	} else if (offs >= SPI_XFER_BUF_OFFS &&
+		   offs < SPI_XFER_BUF_OFFS + sizeof(master->xfer_buf)) {
+		memcpy(master->xfer_buf + offs - SPI_XFER_BUF_OFFS, &val,
+		       nr_bits / 8);
+	}
+
+	return 0;
+}
+
 static void spimaster_compute_busy(struct spimaster *master)
 {
 	master->regs[SPI_XFER_CONTROL_REG_OFFS / 4] &= ~XFER_BUSY_MASK;
-	if (master->bytes_xfered != master->xfer_length)
+	if (master->deferred ||
+	    master->bytes_xfered != master->xfer_length)
 		master->regs[SPI_XFER_CONTROL_REG_OFFS / 4] |= XFER_BUSY_MASK;
 }
 
+/*
+ * Transfer a byte every time the master is read to exercise polling.  DMA and
+ * timed transfers are left to the event.
+ */
 static void spimaster_update_regs(struct spimaster *master)
 {
-	spimaster_xfer_byte(master);
+	if (!master->deferred &&
+	    master->bytes_xfered < master->xfer_length) {
+		spimaster_xfer_byte(master);
+		if (master->bytes_xfered == master->xfer_length)
+			spimaster_complete(master);
+	}
 	spimaster_compute_busy(master);
 }
 
-static int spimaster_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-			  void *priv)
+static void spimaster_event(struct event *event)
+{
+	struct spimaster *master = event->cookie;
+
+	event_disable(event);
+	spimaster_finish(master);
+}
+
+int spimaster_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv)
 {
 	struct spimaster *master = priv;
 	unsigned int regnum = offs >> 2;
@@ -116,33 +246,59 @@ static int spimaster_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 			return -EFAULT;
 
 		*val = master->regs[regnum];
-	} else if (offs >= 8192) {
-		memcpy(val, master->xfer_buf + offs - 8192, nr_bits / 8);
+	} else if (offs >= SPI_XFER_BUF_OFFS &&
+		   offs < SPI_XFER_BUF_OFFS + sizeof(master->xfer_buf)) {
+		memcpy(val, master->xfer_buf + offs - SPI_XFER_BUF_OFFS,
+		       nr_bits / 8);
 	}
 
 	return 0;
 }
 
 static const struct io_ops spimaster_ops = {
+	.type = IO_SPIMASTER,
 	.write = spimaster_write,
 	.read = spimaster_read,
 };
 
 struct spimaster *spimaster_init(struct mem_map *mem, physaddr_t base,
+				 size_t len, struct event_list *events,
+				 struct irq_ctrl *irq_ctrl, unsigned int irq,
 				 struct spislave **slaves, size_t nr_slaves)
 {
 	struct region *r;
 	struct spimaster *master;
 
+	if (len < SPI_XFER_BUF_OFFS + sizeof(master->xfer_buf)) {
+		warnx("spimaster needs at least %#zx bytes",
+		      SPI_XFER_BUF_OFFS + sizeof(master->xfer_buf));
+		return NULL;
+	}
+
 	master = calloc(1, sizeof(*master));
 	assert(master);
+	checkpoint_register(master, sizeof(*master));
 
+	master->mem = mem;
+	master->mode = spimaster_mode;
+	master->irq_ctrl = irq_ctrl;
+	master->irq = irq;
+	master->event = event_new(events, 1, spimaster_event, master);
+	assert(master->event != NULL);
 	master->slaves = slaves;
 	master->nr_slaves = nr_slaves;
 	assert(nr_slaves <= sizeof(unsigned int) * 8);
 
-	r = mem_map_region_add(mem, base, 16384, &spimaster_ops, master, 0);
+	r = mem_map_region_add(mem, base, len, &spimaster_ops, master, 0);
 	assert(r);
 
 	return master;
 }
+
+void spimaster_reset(struct spimaster *master)
+{
+	event_disable(master->event);
+	master->deferred = false;
+	master->xfer_length = master->bytes_xfered = 0;
+	memset(master->regs, 0, sizeof(master->regs));
+}
@@ -13,8 +13,25 @@ struct spislave {
 };
 
 struct spimaster;
+struct irq_ctrl;
+
+/*
+ * How transfers that aren't DMA progress: a byte per register read, after the
+ * time the bytes take on the bus, or as soon as the transfer starts.
+ */
+enum spimaster_mode {
+	SPIMASTER_POLLED,
+	SPIMASTER_TIMED,
+	SPIMASTER_INSTANT,
+};
+
+/* Must be called before the master is created. */
+void spimaster_set_mode(enum spimaster_mode mode);
 
 struct spimaster *spimaster_init(struct mem_map *mem, physaddr_t base,
+				 size_t len, struct event_list *events,
+				 struct irq_ctrl *irq_ctrl, unsigned int irq,
 				 struct spislave **slaves, size_t nr_slaves);
+void spimaster_reset(struct spimaster *master);
 
 #endif /* __SPIMASTER_H__ */
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "checkpoint.h"
 #include "internal.h"
 #include "periodic.h"
 #include "irq_ctrl.h"
@@ -52,8 +53,7 @@ static void timer_callback(struct event *event)
 		irq_ctrl_raise_irq(t->irq_ctrl, t->irq);
 }
 
-static int timer_write(unsigned int offs, uint32_t val, size_t nr_bits,
-		       void *priv)
+int timer_write(unsigned int offs, uint32_t val, size_t nr_bits, void *priv)
 {
 	struct timer_base *base = priv;
 	struct timer *timer;
@@ -87,8 +87,7 @@ static int timer_write(unsigned int offs, uint32_t val, size_t nr_bits,
 	return 0;
 }
 
-static int timer_read(unsigned int offs, uint32_t *val, size_t nr_bits,
-		      void *priv)
+int timer_read(unsigned int offs, uint32_t *val, size_t nr_bits, void *priv)
 {
 	struct timer_base *base = priv;
 	struct timer *timer;
@@ -122,12 +121,13 @@ static int timer_read(unsigned int offs, uint32_t *val, size_t nr_bits,
 }
 
 static const struct io_ops timer_ops = {
+	.type = IO_TIMER,
 	.write = timer_write,
 	.read = timer_read,
 };
 
 struct timer_base *timers_init(struct mem_map *mem, physaddr_t base,
-			       struct event_list *events,
+			       size_t len, struct event_list *events,
 			       const struct timer_init_data *init_data)
 {
 	struct region *r;
@@ -135,6 +135,7 @@ struct timer_base *timers_init(struct mem_map *mem, physaddr_t base,
 	int i;
 
 	assert(t != NULL);
+	checkpoint_register(t, sizeof(*t));
 
 	for (i = 0; i < NR_TIMERS; ++i) {
 		t->timers[i].timer_num = i;
@@ -145,7 +146,7 @@ struct timer_base *timers_init(struct mem_map *mem, physaddr_t base,
 		assert(t->timers[i].event != NULL);
 	}
 
-	r = mem_map_region_add(mem, base, 4096, &timer_ops, t, 0);
+	r = mem_map_region_add(mem, base, len, &timer_ops, t, 0);
 	assert(r != NULL);
 
 	return t;
@@ -4,77 +4,118 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "checkpoint.h"
+#include "simd.h"
 #include "tlb.h"
 
 #define PAGE_OFFSET		(4096 - 1)
 #define PAGE_MASK		~(4096 - 1)
 
+/*
+ * Lookups compare against keys[], the page of each entry with bit 0 set when
+ * the entry is valid, so that they are a vector compare over a dense array.
+ * hints[] is a direct mapped table from the page to the entry that last
+ * mapped it, checked against keys[] first so that most lookups don't scan at
+ * all.  Hints are never invalidated, a stale hint just fails the check.
+ */
+#define TLB_KEY_VALID		(1 << 0)
+
 struct tlb_entry {
 	uint32_t virt;
 	uint32_t phys;
-	int valid;
 };
 
 struct tlb {
 	uint32_t next_virt;
 	int victim_sel;
 	unsigned int num_entries;
-	struct tlb_entry entries[];
+	unsigned int num_keys;
+	unsigned int hint_mask;
+	uint32_t *keys;
+	struct tlb_entry *entries;
+	uint16_t *hints;
 };
 
+static inline uint32_t tlb_key(uint32_t virt)
+{
+	return (virt & PAGE_MASK) | TLB_KEY_VALID;
+}
+
+static inline unsigned int tlb_hint(const struct tlb *tlb, uint32_t virt)
+{
+	return (virt >> 12) & tlb->hint_mask;
+}
+
 struct tlb *tlb_new(unsigned int num_entries)
 {
 	struct tlb *t;
-	size_t alloc_size = sizeof(*t) + (num_entries * sizeof(struct tlb_entry));
-
+	unsigned int num_keys = SIMD_U32_PAD(num_entries);
+	unsigned int num_hints = 1;
+	size_t alloc_size;
+
+	assert(num_entries > 0 && num_entries <= UINT16_MAX);
+	while (num_hints < num_entries * 2)
+		num_hints <<= 1;
+
+	/* One allocation so that checkpoints cover all of it. */
+	alloc_size = sizeof(*t) + num_keys * sizeof(*t->keys) +
+		num_entries * sizeof(*t->entries) +
+		num_hints * sizeof(*t->hints);
 	t = malloc(alloc_size);
 	assert(t != NULL);
 	memset(t, 0, alloc_size);
 	t->num_entries = num_entries;
+	t->num_keys = num_keys;
+	t->hint_mask = num_hints - 1;
+	t->keys = (uint32_t *)(t + 1);
+	t->entries = (struct tlb_entry *)(t->keys + num_keys);
+	t->hints = (uint16_t *)(t->entries + num_entries);
+	checkpoint_register(t, alloc_size);
 
 	return t;
 }
 
 void tlb_inval(struct tlb *tlb)
 {
-	unsigned m;
-
-	for (m = 0; m < tlb->num_entries; ++m)
-		tlb->entries[m].valid = 0;
+	memset(tlb->keys, 0, tlb->num_keys * sizeof(*tlb->keys));
 }
 
-static struct tlb_entry *tlb_find_mapping(struct tlb *tlb, uint32_t virt)
+static int tlb_find_mapping(struct tlb *tlb, uint32_t virt)
 {
-	unsigned m;
+	uint32_t key = tlb_key(virt);
+	unsigned int hint = tlb_hint(tlb, virt);
+	int m;
 
-	for (m = 0; m < tlb->num_entries; ++m) {
-		struct tlb_entry *entry = &tlb->entries[m];
+	if (tlb->keys[tlb->hints[hint]] == key)
+		return tlb->hints[hint];
 
-		if (!entry->valid)
-			continue;
+	m = simd_find_u32(tlb->keys, tlb->num_keys, key);
+	if (m >= 0)
+		tlb->hints[hint] = m;
 
-		if ((entry->virt & PAGE_MASK) == (virt & PAGE_MASK))
-			return entry;
-	}
-
-	return NULL;
+	return m;
 }
 
-void tlb_set_phys(struct tlb *tlb, uint32_t phys)
+void tlb_install(struct tlb *tlb, uint32_t virt, uint32_t phys)
 {
-	struct tlb_entry *entry;
-	
-	entry = tlb_find_mapping(tlb, tlb->next_virt);
-	if (!entry)
-		entry = &tlb->entries[tlb->victim_sel];
+	int m = tlb_find_mapping(tlb, virt);
 
-	entry->virt = tlb->next_virt;
-	entry->phys = phys & PAGE_MASK;
-	entry->valid = 1;
+	if (m < 0)
+		m = tlb->victim_sel;
+
+	tlb->entries[m].virt = virt;
+	tlb->entries[m].phys = phys & PAGE_MASK;
+	tlb->keys[m] = tlb_key(virt);
+	tlb->hints[tlb_hint(tlb, virt)] = m;
 
 	tlb->victim_sel = (tlb->victim_sel + 1) % tlb->num_entries;
 }
 
+void tlb_set_phys(struct tlb *tlb, uint32_t phys)
+{
+	tlb_install(tlb, tlb->next_virt, phys);
+}
+
 void tlb_set_virt(struct tlb *tlb, uint32_t virt)
 {
 	tlb->next_virt = virt;
@@ -82,11 +123,13 @@ void tlb_set_virt(struct tlb *tlb, uint32_t virt)
 
 int tlb_translate(struct tlb *tlb, struct translation *translation)
 {
-	struct tlb_entry *entry = tlb_find_mapping(tlb, translation->virt);
+	int m = tlb_find_mapping(tlb, translation->virt);
+	struct tlb_entry *entry;
 	uint32_t perms;
 
-	if (!entry)
+	if (m < 0)
 		return -1;
+	entry = &tlb->entries[m];
 
 	/*
 	 * Permissions are [3:2] for user, [1:0] for supervisor.
@@ -20,6 +20,8 @@ struct tlb *tlb_new(unsigned int num_entries);
 void tlb_inval(struct tlb *tlb);
 void tlb_set_phys(struct tlb *tlb, uint32_t phys);
 void tlb_set_virt(struct tlb *tlb, uint32_t virt);
+/* Install a mapping without disturbing the latched virtual address. */
+void tlb_install(struct tlb *tlb, uint32_t virt, uint32_t phys);
 int tlb_translate(struct tlb *tlb, struct translation *translation);
 
 #endif /* __TLB_H__ */
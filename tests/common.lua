@@ -8,7 +8,36 @@ end
 
 cycle_count = 0
 
+-- The simulator runs to the testpoints itself, other targets are stepped.
+function run_to_stop_pc(max_cycle_count)
+	while not max_cycle_count or cycle_count < max_cycle_count do
+		local steps, stopped, err = target.run_to_testpoint(
+			max_cycle_count and max_cycle_count - cycle_count or 0)
+		if not steps then return nil, false end
+		if err then
+			print(err)
+			return nil, true
+		end
+
+		cycle_count = cycle_count + steps
+		if not stopped then break end
+
+		local tp = get_testpoint(target.read_reg(16))
+		if tp then
+			return tp, true
+		end
+	end
+
+	print("Maximum cycle count exceeded")
+	return nil, true
+end
+
 function step_to_tp(max_cycle_count)
+	tp, handled = run_to_stop_pc(max_cycle_count)
+	if handled then
+		return tp
+	end
+
 	while true do
 		target.step()
 		cycle_count = cycle_count + 1
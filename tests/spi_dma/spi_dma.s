@@ -0,0 +1,103 @@
+.include "common.s"
+
+.globl _start
+_start:
+	movhi	$r0, %hi(ex_table)
+	orlo	$r0, $r0, %lo(ex_table)
+	scr	0, $r0
+
+	movhi	$sp, %hi(stack_top)
+	orlo	$sp, $sp, %lo(stack_top)
+
+	movhi	$r1, 0x8000
+	orlo	$r1, $r1, 0x4000
+
+	/* Enable the SPI master IRQ. */
+	movhi	$r5, 0x8000
+	orlo	$r5, $r5, 0x2000
+	movhi	$r6, 0x0000
+	orlo	$r6, $r6, 0x10
+	str32	$r6, [$r5, 0x4]
+
+	/* Enable interrupts. */
+	gcr	$r0, 1
+	bst	$r0, $r0, 4
+	scr	1, $r0
+
+	movhi	$r2, 0x0
+	orlo	$r2, $r2, 0x0208
+	str32	$r2, [$r1, 0x0] /* loopback enabled, x8 divider. */
+
+	movhi	$r2, 0x0
+	orlo	$r2, $r2, 0x00
+	str32	$r2, [$r1, 0x4] /* no chip select enabled. */
+
+	movhi	$r2, %hi(tx_data)
+	orlo	$r2, $r2, %lo(tx_data)
+	str32	$r2, [$r1, 0xc] /* DMA transmit address. */
+
+	movhi	$r2, %hi(rx_data)
+	orlo	$r2, $r2, %lo(rx_data)
+	str32	$r2, [$r1, 0x10] /* DMA receive address. */
+
+	movhi	$r2, 0x001d /* go, DMA tx + rx, irq enable. */
+	orlo	$r2, $r2, 0x0006 /* 6 byte transfer. */
+	str32	$r2, [$r1, 0x8] /* xfer control register. */
+
+	/* Read the SPI master while waiting so that the CPU and DMA contend. */
+1:
+	ldr32	$r7, [$r1, 0x8]
+	ldr32	$r3, irq_processed
+	cmp	$r3, 0
+	beq	1b
+
+	/* Loopback inverts the data, the last two bytes are untouched. */
+	movhi	$r5, %hi(rx_data)
+	orlo	$r5, $r5, %lo(rx_data)
+	ldr32	$r2, [$r5, 0x0]
+	movhi	$r3, 0xf7fb
+	orlo	$r3, $r3, 0xfdfe
+	cmp	$r2, $r3
+	bne	bad_vector
+
+	ldr32	$r2, [$r5, 0x4]
+	movhi	$r3, 0xffff
+	orlo	$r3, $r3, 0xdfef
+	cmp	$r2, $r3
+	bne	bad_vector
+
+	SUCCESS
+
+irq_processed:
+	.long	0
+
+irq_vector:
+	add	$r4, $r4, 1
+	str32	$r4, irq_processed
+	str32	$r4, [$r1, 0x14] /* EOI. */
+	rfe
+
+bad_vector:
+	FAILURE
+
+	.balign	4
+tx_data:
+	.byte	0x01, 0x02, 0x04, 0x08, 0x10, 0x20
+
+	.balign	4
+rx_data:
+	.long	0xffffffff, 0xffffffff
+
+	.balign	64
+ex_table:
+	b	bad_vector	/* RESET */
+	b	bad_vector	/* ILLEGAL_INSTR */
+	b	bad_vector	/* SWI */
+	b	irq_vector	/* IRQ */
+	b	bad_vector	/* IFETCH_ABORT */
+	b	bad_vector	/* DATA_ABORT */
+
+.rept	32
+	.long		0
+.endr
+stack_top:
@@ -0,0 +1,7 @@
+require "common"
+
+return run_test({
+	elf = "spi_dma_error",
+	max_cycle_count = 4096,
+	modes = {"step", "run"}
+})
@@ -0,0 +1,81 @@
+.include "common.s"
+
+.globl _start
+_start:
+	movhi	$r0, %hi(ex_table)
+	orlo	$r0, $r0, %lo(ex_table)
+	scr	0, $r0
+
+	movhi	$sp, %hi(stack_top)
+	orlo	$sp, $sp, %lo(stack_top)
+
+	movhi	$r1, 0x8000
+	orlo	$r1, $r1, 0x4000
+
+	/* Enable the SPI master IRQ. */
+	movhi	$r5, 0x8000
+	orlo	$r5, $r5, 0x2000
+	movhi	$r6, 0x0000
+	orlo	$r6, $r6, 0x10
+	str32	$r6, [$r5, 0x4]
+
+	/* Enable interrupts. */
+	gcr	$r0, 1
+	bst	$r0, $r0, 4
+	scr	1, $r0
+
+	movhi	$r2, 0x0
+	orlo	$r2, $r2, 0x0208
+	str32	$r2, [$r1, 0x0] /* loopback enabled, x8 divider. */
+
+	movhi	$r2, 0x9000 /* Unmapped address. */
+	str32	$r2, [$r1, 0xc] /* DMA transmit address. */
+
+	movhi	$r2, 0x0015 /* go, DMA tx, irq enable. */
+	orlo	$r2, $r2, 0x0004 /* 4 byte transfer. */
+	str32	$r2, [$r1, 0x8] /* xfer control register. */
+
+1:
+	ldr32	$r3, irq_processed
+	cmp	$r3, 0
+	beq	1b
+
+	/* The transfer should have ended with the DMA error bit set. */
+	ldr32	$r2, [$r1, 0x8]
+	movhi	$r3, 0x0020
+	and	$r3, $r2, $r3
+	cmp	$r3, 0
+	beq	bad_vector
+
+	movhi	$r3, 0x0002 /* busy. */
+	and	$r3, $r2, $r3
+	cmp	$r3, 0
+	bne	bad_vector
+
+	SUCCESS
+
+irq_processed:
+	.long	0
+
+irq_vector:
+	add	$r4, $r4, 1
+	str32	$r4, irq_processed
+	str32	$r4, [$r1, 0x14] /* EOI. */
+	rfe
+
+bad_vector:
+	FAILURE
+
+	.balign	64
+ex_table:
+	b	bad_vector	/* RESET */
+	b	bad_vector	/* ILLEGAL_INSTR */
+	b	bad_vector	/* SWI */
+	b	irq_vector	/* IRQ */
+	b	bad_vector	/* IFETCH_ABORT */
+	b	bad_vector	/* DATA_ABORT */
+
+.rept	32
+	.long		0
+.endr
+stack_top:
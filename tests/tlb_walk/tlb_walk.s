@@ -0,0 +1,93 @@
+.include "common.s"
+
+.equ	DTLB_STORE_VIRT, 4
+.equ	DTLB_STORE_PHYS, 5
+
+.equ	S_RW, 0x3
+.equ	PDE_VALID, 0x1
+.equ	PTE_VALID, 0x10
+.equ	PTBR_WALK_ENABLE, 0x1
+
+.equ	L1_TABLE, 0x20010000
+.equ	L2_TABLE_0, 0x20011000
+.equ	L2_TABLE_1, 0x20012000
+
+.macro	load_const reg, val
+	movhi	\reg, %hi(\val)
+	orlo	\reg, \reg, %lo(\val)
+.endm
+
+.globl _start
+_start:
+	/* Install miss handlers. */
+	load_const $r0, dtlb_miss_handler
+	scr	5, $r0
+	load_const $r0, itlb_miss_handler
+	scr	6, $r0
+
+	load_const $r0, 0x0bad1dea
+	load_const $r1, 0x20000000
+	str32	$r0, [$r1, 0]
+
+	/* 0x00000000 is an identity mapping for the code. */
+	load_const $r1, L1_TABLE
+	load_const $r0, (L2_TABLE_0 | PDE_VALID)
+	str32	$r0, [$r1, 0]
+	load_const $r2, L2_TABLE_0
+	load_const $r0, (0x00000000 | PTE_VALID | S_RW)
+	str32	$r0, [$r2, 0]
+
+	/*
+	 * 0x40000000 maps the first SDRAM page, 0x40001000 has no PTE so must
+	 * go to the software handler.
+	 */
+	load_const $r0, (L2_TABLE_1 | PDE_VALID)
+	str32	$r0, [$r1, 0x400]
+	load_const $r2, L2_TABLE_1
+	load_const $r0, (0x20000000 | PTE_VALID | S_RW)
+	str32	$r0, [$r2, 0]
+
+	/* Enable the walker and MMU. */
+	load_const $r0, (L1_TABLE | PTBR_WALK_ENABLE)
+	scr	7, $r0
+	gcr	$r0, 1
+	or	$r0, $r0, 0x80
+	scr	1, $r0
+	nop
+	nop
+	nop
+	nop
+
+	load_const $r10, 0x40000000
+	mov	$r1, 0
+	ldr32	$r1, [$r10, 0]
+	TESTPOINT	TP_USER, 0
+
+	load_const $r10, 0x40001000
+	mov	$r1, 0
+	ldr32	$r1, [$r10, 0]
+	TESTPOINT	TP_USER, 2
+
+	SUCCESS
+
+dtlb_miss_handler:
+	TESTPOINT	TP_USER, 1
+
+	gcr	$r7, 4
+	movhi	$r8, 0xffff
+	orlo	$r8, $r8, 0xf000
+	and	$r7, $r7, $r8
+	or	$r7, $r7, S_RW
+	cache	$r7, DTLB_STORE_VIRT
+	load_const $r7, 0x20000000
+	cache	$r7, DTLB_STORE_PHYS
+
+	/* Restart the faulting instruction. */
+	gcr	$r8, 3
+	sub	$r8, $r8, 4
+	scr	3, $r8
+
+	rfe
+
+itlb_miss_handler:
+	FAILURE
@@ -7,7 +7,7 @@ HERE = os.path.dirname(__file__)
 
 with open(os.path.join(HERE, '..', '..', 'config', 'instructions.yaml'),
           'r') as itab:
-    data = yaml.load(itab.read())
+    data = yaml.safe_load(itab.read())
     instructions = data['instructions']
     operands = data['operands']
     alu_opcodes = data['alu_opcodes']
@@ -10,6 +10,7 @@ module debug_controller(input wire		clk,
 `systemc_imp_header
 void dbg_sim_term(IData val);
 void start_trace();
+void stop_trace();
 void dbg_put(IData val);
 void dbg_get(CData *req, CData *rnw, CData *addr, IData *val);
 `verilog
@@ -63,6 +64,14 @@ begin
 end
 endtask
 
+task do_stop_trace;
+begin
+`ifdef verilator
+	$c("{stop_trace();}");
+`endif
+end
+endtask
+
 always @(*) begin
 	case (state)
 	STATE_IDLE: begin
@@ -140,6 +149,8 @@ always @(*) begin
 			$finish;
 		end else if (dbg_addr == 2'b00 && dbg_val == 32'hfffffffe) begin
 			do_start_trace();
+		end else if (dbg_addr == 2'b00 && dbg_val == 32'hffffff8f) begin
+			do_stop_trace();
 		end
 	end
 end
@@ -8,6 +8,7 @@ module simuart(input wire		clk,
 	       output reg		bus_error,
 	       output reg		bus_ack,
 	       output reg [31:0]	bus_data,
+	       output wire		irq,
 	       input wire		rx,
 	       output wire		tx);
 
@@ -59,11 +60,40 @@ parameter	bus_size = 32'h0;
 reg [8:0]	uart_buf/*verilator public*/ = 9'b0;
 wire uart_rdy	= uart_buf[8];
 
-wire [31:0] status_reg = (uart_rdy ? 32'b10 : 32'b0) | 32'b1;
+wire		access_data_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_DATA_REG_OFFS;
+wire		access_status_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_STATUS_REG_OFFS;
+wire		access_control_reg = {28'b0, bus_addr[1:0], 2'b0} == `UART_CONTROL_REG_OFFS;
+
+/*
+ * Writes go straight to the host so the transmit FIFO is always empty,
+ * received characters are queued in the receive FIFO like keynsham_uart.
+ */
+wire [7:0]	rx_fifo_data;
+wire		rx_fifo_empty;
+wire		rx_fifo_full;
+wire		rx_fifo_push = uart_rdy && !rx_fifo_full;
+wire		rx_fifo_pop = bus_access && bus_cs && !bus_wr_en && access_data_reg;
+
+reg [31:0]	control_reg = 32'b0;
+
+wire [31:0] status_reg = `TX_EMPTY_MASK |
+			 (!rx_fifo_empty ? `RX_READY_MASK : 32'b0);
+
+assign		irq = (control_reg[`RX_IRQ_ENABLE_OFFSET] && !rx_fifo_empty) ||
+		      control_reg[`TX_IRQ_ENABLE_OFFSET];
 
 cs_gen		#(.address(bus_address), .size(bus_size))
 		d_cs_gen(.bus_addr(bus_addr), .cs(bus_cs));
 
+sync_fifo	#(.data_bits(8), .nr_entries(16))
+		rx_fifo(.clk(clk),
+			.push(rx_fifo_push),
+			.wr_data(uart_buf[7:0]),
+			.pop(rx_fifo_pop),
+			.rd_data(rx_fifo_data),
+			.empty(rx_fifo_empty),
+			.full(rx_fifo_full));
+
 initial begin
 	bus_error = 1'b0;
 	bus_ack = 1'b0;
@@ -75,18 +105,23 @@ always @(posedge clk) begin
 
 	if (~uart_rdy)
 		read_data();
+	else if (rx_fifo_push)
+		uart_buf[8] <= 1'b0;
 
 	if (bus_access && bus_cs && bus_wr_en) begin
-		if (bus_addr[1:0] == 2'b00) begin
+		if (access_data_reg)
 			write_data();
-		end
+		else if (access_control_reg)
+			control_reg <= bus_wr_val & (`RX_IRQ_ENABLE_MASK |
+						     `TX_IRQ_ENABLE_MASK);
 	end else if (bus_access && bus_cs) begin
-		if (bus_addr[1:0] == 2'b00) begin
-			bus_data <= {24'b0, uart_buf[7:0]};
-			uart_buf[8] <= 1'b0;
-		end else if (bus_addr[1:0] == 2'b01) begin
+		if (access_data_reg) begin
+			bus_data <= rx_fifo_empty ? 32'b0 : {24'b0, rx_fifo_data};
+		end else if (access_status_reg) begin
 			/* Status register read. */
 			bus_data <= status_reg;
+		end else if (access_control_reg) begin
+			bus_data <= control_reg;
 		end
 	end
 
@@ -0,0 +1,135 @@
+/*
+ * Unit test for the oldland_tlb page table walker.  The page tables live in
+ * a small memory model that acks one cycle after the walker requests a word,
+ * in the same way as the cache's memory port.
+ */
+module tlb_walk_tb();
+
+localparam	L1_TABLE = 32'h00001000;
+localparam	L2_TABLE = 32'h00002000;
+
+reg		clk = 1'b0;
+reg		rst = 1'b0;
+reg		translate = 1'b0;
+reg [31:12]	virt = 20'b0;
+reg [31:0]	ptbr = L1_TABLE | 32'h1;
+reg [31:0]	walk_data = 32'b0;
+reg		walk_ack = 1'b0;
+
+wire [31:12]	phys;
+wire [1:0]	access;
+wire		valid;
+wire		miss;
+wire		complete;
+wire		walk_access;
+wire [29:0]	walk_addr;
+
+integer		walk_reads = 0;
+integer		cycles;
+
+always #10 clk = ~clk;
+
+oldland_tlb	#(.nr_entries(8))
+		tlb(.clk(clk),
+		    .rst(rst),
+		    .enabled(1'b1),
+		    .starting_miss(1'b0),
+		    .user_mode(1'b0),
+		    .inval(1'b0),
+		    .load_data(32'b0),
+		    .load_virt(1'b0),
+		    .load_phys(1'b0),
+		    .translate(translate),
+		    .virt(virt),
+		    .phys(phys),
+		    .access(access),
+		    .valid(valid),
+		    .miss(miss),
+		    .complete(complete),
+		    .ptbr(ptbr),
+		    .walk_data(walk_data),
+		    .walk_access(walk_access),
+		    .walk_addr(walk_addr),
+		    .walk_ack(walk_ack),
+		    .walk_error(1'b0));
+
+/*
+ * 0x40000000 maps to 0x20000000 read/write, 0x40001000 shares the PDE but
+ * has no PTE.
+ */
+function [31:0] page_table_read;
+	input [31:0] addr;
+	begin
+		case (addr)
+		L1_TABLE + 32'h400: page_table_read = L2_TABLE | 32'h1;
+		L2_TABLE + 32'h0: page_table_read = 32'h20000013;
+		default: page_table_read = 32'h0;
+		endcase
+	end
+endfunction
+
+always @(posedge clk) begin
+	walk_ack <= walk_access && !walk_ack;
+	if (walk_access && !walk_ack) begin
+		walk_data <= page_table_read({walk_addr, 2'b00});
+		walk_reads = walk_reads + 1;
+	end
+end
+
+task lookup;
+	input [31:12] va;
+	begin
+		@(negedge clk);
+		virt = va;
+		translate = 1'b1;
+		@(negedge clk);
+		translate = 1'b0;
+		cycles = 0;
+		while (!complete && cycles < 16) begin
+			@(negedge clk);
+			cycles = cycles + 1;
+		end
+		if (!complete) begin
+			$display("FAIL: lookup of %05x did not complete", va);
+			$finish;
+		end
+	end
+endtask
+
+task fail;
+	input [8 * 64 - 1:0] msg;
+	begin
+		$display("FAIL: %0s (phys %05x valid %b miss %b reads %0d)",
+			 msg, phys, valid, miss, walk_reads);
+		$finish;
+	end
+endtask
+
+initial begin
+	rst = 1'b1;
+	@(negedge clk);
+	rst = 1'b0;
+
+	lookup(20'h40000);
+	if (!valid || miss || phys != 20'h20000 || access != 2'b11 ||
+	    walk_reads != 2)
+		fail("walked mapping");
+
+	lookup(20'h40000);
+	if (!valid || miss || phys != 20'h20000 || walk_reads != 2)
+		fail("walked entry was not loaded into the TLB");
+
+	lookup(20'h40001);
+	if (!miss || walk_reads != 4)
+		fail("missing PTE did not raise a miss");
+
+	ptbr = L1_TABLE;
+	lookup(20'h40002);
+	if (!miss || walk_reads != 4)
+		fail("walk with the walker disabled");
+
+	$display("PASS");
+	$finish;
+end
+
+endmodule
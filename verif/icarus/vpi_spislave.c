@@ -17,7 +17,7 @@
 
 static struct spi_sdcard *sdcard;
 
-const char *get_sdcard_path(void)
+static const char *get_plusarg(const char *prefix)
 {
 	int i;
 	s_vpi_vlog_info info;
@@ -25,20 +25,29 @@ const char *get_sdcard_path(void)
 	vpi_get_vlog_info(&info);
 
 	for (i = 0; i < info.argc; ++i)
-		if (strstr(info.argv[i], "+sdcard=") == info.argv[i])
-			return info.argv[i] + strlen("+sdcard=");
+		if (strstr(info.argv[i], prefix) == info.argv[i])
+			return info.argv[i] + strlen(prefix);
 
 	return NULL;
 }
 
+const char *get_sdcard_path(void)
+{
+	return get_plusarg("+sdcard=");
+}
+
 static void sdcard_init(void)
 {
 	const char *path = get_sdcard_path();
+	unsigned int flags = 0;
 
 	if (!path)
 		return;
 
-	sdcard = spi_sdcard_new(path);
+	if (get_plusarg("+sdcard_writable"))
+		flags |= SPI_SDCARD_WRITABLE;
+
+	sdcard = spi_sdcard_open(path, get_plusarg("+sdcard_overlay="), flags);
 	assert(sdcard != NULL);
 }
 
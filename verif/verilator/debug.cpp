@@ -1,5 +1,9 @@
+#include <string>
 #include <verilated.h>
 #include "../../devicemodels/jtag.h"
+#ifdef VERILATOR_LOCKSTEP
+#include "lockstep.h"
+#endif /* VERILATOR_LOCKSTEP */
 
 static struct jtag_debug_data *jtag_debug_data;
 
@@ -22,9 +26,21 @@ void dbg_get(CData *req, CData *rnw, CData *addr, IData *val)
 {
 	struct dbg_request dbg_req = {};
 
-	if (!jtag_debug_data->more_data)
-		if(__sync_val_compare_and_swap(&jtag_debug_data->pending, 1, 0) == 0)
-			jtag_debug_data->more_data = 1;
+	if (!jtag_debug_data) {
+		*req = *rnw = *addr = 0;
+		*val = 0;
+		return;
+	}
+
+	/*
+	 * This runs on every idle controller cycle so only read from the
+	 * socket once the server thread has seen input, and then until it is
+	 * drained.
+	 */
+	if (!jtag_debug_data->more_data &&
+	    __atomic_load_n(&jtag_debug_data->pending, __ATOMIC_RELAXED) &&
+	    __sync_val_compare_and_swap(&jtag_debug_data->pending, 1, 0) == 1)
+		jtag_debug_data->more_data = 1;
 
 	if (jtag_debug_data->more_data) {
 		*req = get_request(jtag_debug_data, &dbg_req) == 0;
@@ -38,13 +54,28 @@ void dbg_get(CData *req, CData *rnw, CData *addr, IData *val)
 	if (*req && !*rnw) {
 		struct dbg_response resp = {};
 
+#ifdef VERILATOR_LOCKSTEP
+		lockstep_debug_write(*addr, *val);
+#endif /* VERILATOR_LOCKSTEP */
+
 		resp.status = 0;
 		send_response(jtag_debug_data, &resp);
 	}
 }
 
+bool sim_is_headless()
+{
+	std::string match = Verilated::commandArgsPlusMatch("headless");
+
+	return match != "";
+}
+
 void init_debug()
 {
+	/* Headless runs have no debugger, the core runs from reset. */
+	if (sim_is_headless())
+		return;
+
 	jtag_debug_data = start_server();
 	assert(jtag_debug_data != NULL);
 	notify_runner();
@@ -2,5 +2,6 @@
 #define __DEBUG_H__
 
 void init_debug();
+bool sim_is_headless();
 
 #endif /* __DEBUG_H__ */
@@ -0,0 +1,311 @@
+/*
+ * Lockstep co-simulation against the C model.
+ *
+ * With +lockstep the C model runs in the same process as a golden reference.
+ * Every cycle the RTL reports the register write leaving writeback and the
+ * store entering the memory stage, and the model executes instructions until
+ * it has produced the same effects.  The first difference stops the
+ * simulation with a dump of both.
+ *
+ * The device models aren't cycle accurate so registers loaded from devices
+ * take the RTL's value, and programs that take interrupts will diverge.
+ * Debugger writes to registers and memory are mirrored into the model.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <verilated.h>
+
+extern "C" {
+#include "../../sim/cpu.h"
+}
+#include "../../debugger/protocol.h"
+
+#include "lockstep.h"
+
+/* Instructions the model may run without an effect before giving up. */
+#define LOCKSTEP_MAX_STEPS	100000
+
+enum lockstep_effect {
+	EFFECT_REG,
+	EFFECT_STORE,
+};
+
+struct rtl_effect {
+	enum lockstep_effect type;
+	unsigned int rd;
+	uint32_t val;
+	uint32_t addr;
+	unsigned int bits;
+};
+
+static struct {
+	struct cpu *cpu;
+	bool enabled;
+	unsigned long long cycle;
+	unsigned long long nr_compared;
+	/* The RTL's fetch PC, the stopped PC while halted. */
+	uint32_t rtl_pc;
+	uint32_t debug_regs[4];
+} lockstep;
+
+static const char *reg_names[] = {
+	"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10",
+	"r11", "r12", "fp", "sp", "lr",
+};
+
+void stop_trace();
+
+static void print_effect(const char *who, const struct rtl_effect *e)
+{
+	if (e->type == EFFECT_REG)
+		fprintf(stderr, "  %-6s %s <- %08x\n", who, reg_names[e->rd],
+			e->val);
+	else
+		fprintf(stderr, "  %-6s store%u [%08x] <- %08x\n", who, e->bits,
+			e->addr, e->val);
+}
+
+static void diverged(const char *why, const struct rtl_effect *rtl,
+		     const struct rtl_effect *model)
+{
+	const struct cpu_retire *r = cpu_last_retire(lockstep.cpu);
+	unsigned int m;
+
+	fprintf(stderr, "lockstep: %s at cycle %llu after %llu effects\n",
+		why, lockstep.cycle, lockstep.nr_compared);
+	if (rtl)
+		print_effect("rtl", rtl);
+	if (model)
+		print_effect("model", model);
+	fprintf(stderr, "  rtl fetch pc %08x, model pc %08x instr %08x\n",
+		lockstep.rtl_pc, r->pc, r->instr);
+
+	for (m = 0; m <= LR; ++m) {
+		uint32_t v;
+
+		cpu_read_reg(lockstep.cpu, m, &v);
+		fprintf(stderr, "  %-3s %08x%s", reg_names[m], v,
+			m % 4 == 3 ? "\n" : "");
+	}
+
+	/* Write out a flight recorder trace if there is one. */
+	stop_trace();
+	exit(EXIT_FAILURE);
+}
+
+static uint32_t width_mask(unsigned int bits)
+{
+	return bits == 32 ? ~0U : (1U << bits) - 1;
+}
+
+/* Run the model until an instruction writes a register or stores. */
+static const struct cpu_retire *model_next_effect()
+{
+	unsigned int m;
+
+	for (m = 0; m < LOCKSTEP_MAX_STEPS; ++m) {
+		const struct cpu_retire *r;
+		bool bkpt = false;
+
+		cpu_cycle(lockstep.cpu, &bkpt);
+		if (bkpt)
+			diverged("model stopped at a breakpoint", NULL, NULL);
+
+		r = cpu_last_retire(lockstep.cpu);
+		if (r->reg_written || r->stored)
+			return r;
+	}
+
+	diverged("model made no progress", NULL, NULL);
+
+	return NULL;
+}
+
+static void compare(const struct rtl_effect *rtl, const struct cpu_retire *r)
+{
+	struct rtl_effect model = {};
+
+	if (r->stored) {
+		model.type = EFFECT_STORE;
+		model.addr = r->store_addr;
+		model.bits = r->store_bits;
+		model.val = r->store_val & width_mask(r->store_bits);
+	} else {
+		model.type = EFFECT_REG;
+		model.rd = r->rd;
+		model.val = r->rd_val;
+	}
+
+	if (model.type != rtl->type ||
+	    (model.type == EFFECT_REG && model.rd != rtl->rd) ||
+	    (model.type == EFFECT_STORE &&
+	     (model.addr != rtl->addr || model.bits != rtl->bits)))
+		diverged("different effect", rtl, &model);
+
+	if (model.type == EFFECT_REG && r->io_load) {
+		/* Device registers only need to match in the RTL. */
+		cpu_write_reg(lockstep.cpu, r->rd, rtl->val);
+	} else if (model.val != rtl->val) {
+		diverged("different value", rtl, &model);
+	}
+
+	++lockstep.nr_compared;
+}
+
+/*
+ * A register write and a store from a younger instruction can complete in
+ * the same cycle, so match the model's effects against either.
+ */
+static void check_effects(struct rtl_effect *effects, unsigned int nr)
+{
+	while (nr) {
+		const struct cpu_retire *r = model_next_effect();
+		enum lockstep_effect type = r->stored ? EFFECT_STORE :
+			EFFECT_REG;
+		unsigned int m = effects[0].type == type || nr == 1 ? 0 : 1;
+
+		compare(&effects[m], r);
+		effects[m] = effects[--nr];
+	}
+}
+
+/* Called from the RTL on every rising clock edge. */
+void lockstep_cycle(CData reg_wr, CData rd, IData rd_val, CData store,
+		    IData addr, IData mdr, CData width, IData fetch_pc)
+{
+	struct rtl_effect effects[2];
+	unsigned int nr = 0;
+
+	if (!lockstep.enabled)
+		return;
+
+	++lockstep.cycle;
+	lockstep.rtl_pc = fetch_pc;
+
+	if (reg_wr) {
+		effects[nr].type = EFFECT_REG;
+		effects[nr].rd = rd;
+		effects[nr].val = rd_val;
+		++nr;
+	}
+	if (store) {
+		unsigned int bits = width == 2 ? 32 : width == 1 ? 16 : 8;
+
+		effects[nr].type = EFFECT_STORE;
+		effects[nr].addr = addr;
+		effects[nr].bits = bits;
+		effects[nr].val = mdr & width_mask(bits);
+		++nr;
+	}
+
+	check_effects(effects, nr);
+}
+
+/*
+ * The RTL may have run instructions with no visible effect, such as
+ * compares and branches, before it stopped.  Run the model up to the same
+ * PC before changing its state.
+ */
+static void catch_up()
+{
+	uint32_t pc;
+	unsigned int m;
+
+	for (m = 0; m < LOCKSTEP_MAX_STEPS; ++m) {
+		const struct cpu_retire *r;
+		bool bkpt = false;
+
+		cpu_read_reg(lockstep.cpu, PC, &pc);
+		if (pc == lockstep.rtl_pc)
+			return;
+
+		cpu_cycle(lockstep.cpu, &bkpt);
+		r = cpu_last_retire(lockstep.cpu);
+		if (bkpt || r->reg_written || r->stored)
+			break;
+	}
+
+	diverged("model didn't reach the stopped pc", NULL, NULL);
+}
+
+static void mirror_command(uint32_t cmd, uint32_t addr, uint32_t wdata)
+{
+	struct cpu *cpu = lockstep.cpu;
+
+	switch (cmd) {
+	case CMD_WRITE_REG:
+		catch_up();
+		cpu_write_reg(cpu, addr, wdata);
+		break;
+	case CMD_WMEM32:
+		catch_up();
+		cpu_write_mem(cpu, addr, wdata, 32);
+		break;
+	case CMD_WMEM16:
+		catch_up();
+		cpu_write_mem(cpu, addr, wdata, 16);
+		break;
+	case CMD_WMEM8:
+		catch_up();
+		cpu_write_mem(cpu, addr, wdata, 8);
+		break;
+	case CMD_RESET:
+		cpu_reset(cpu);
+		break;
+	case CMD_CACHE_SYNC:
+		catch_up();
+		cpu_cache_sync(cpu);
+		break;
+	default:
+		break;
+	}
+}
+
+void lockstep_debug_write(CData addr, IData val)
+{
+	if (!lockstep.enabled || addr > REG_RDATA)
+		return;
+
+	lockstep.debug_regs[addr] = val;
+	if (addr == REG_CMD)
+		mirror_command(val, lockstep.debug_regs[REG_ADDRESS],
+			       lockstep.debug_regs[REG_WDATA]);
+}
+
+static std::string get_bootrom()
+{
+	std::string match = Verilated::commandArgsPlusMatch("lockstep_bootrom=");
+	std::string rom;
+
+	if (match != "")
+		return match.substr(match.find("=") + 1);
+
+	/* The RTL loads a hex image, the model the binary next to it. */
+	match = Verilated::commandArgsPlusMatch("romfile=");
+	if (match == "")
+		return "";
+	rom = match.substr(match.find("=") + 1);
+	if (rom.size() > 4 && rom.compare(rom.size() - 4, 4, ".hex") == 0)
+		rom.replace(rom.size() - 4, 4, ".bin");
+
+	return rom;
+}
+
+void init_lockstep()
+{
+	std::string bootrom;
+
+	if (std::string(Verilated::commandArgsPlusMatch("lockstep")) == "")
+		return;
+
+	bootrom = get_bootrom();
+	if (bootrom == "") {
+		fprintf(stderr, "lockstep: no bootrom, pass +lockstep_bootrom=FILE\n");
+		exit(EXIT_FAILURE);
+	}
+
+	lockstep.cpu = new_cpu(NULL, CPU_NOTRACE | CPU_NO_HOST_IO,
+			       bootrom.c_str(), NULL);
+	lockstep.enabled = true;
+}
@@ -0,0 +1,10 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+
+#include <verilated.h>
+
+void init_lockstep();
+/* Mirror a debugger write to one of the debug controller registers. */
+void lockstep_debug_write(CData addr, IData val);
+
+#endif /* __LOCKSTEP_H__ */
@@ -15,14 +15,30 @@ static const std::string get_sdcard_path()
 	return sdcard.substr(sdcard.find("=") + 1);
 }
 
+static const std::string get_sdcard_overlay()
+{
+	std::string overlay = Verilated::commandArgsPlusMatch("sdcard_overlay=");
+
+	if (overlay == "")
+		return "";
+
+	return overlay.substr(overlay.find("=") + 1);
+}
+
 void init_spi()
 {
 	std::string path = get_sdcard_path();
+	std::string overlay = get_sdcard_overlay();
+	unsigned int flags = 0;
 
 	if (path == "")
 		return;
 
-	sdcard = spi_sdcard_new(path.c_str());
+	if (std::string(Verilated::commandArgsPlusMatch("sdcard_writable")) != "")
+		flags |= SPI_SDCARD_WRITABLE;
+
+	sdcard = spi_sdcard_open(path.c_str(),
+				 overlay == "" ? NULL : overlay.c_str(), flags);
 	assert(sdcard != NULL);
 }
 
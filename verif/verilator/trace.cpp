@@ -0,0 +1,195 @@
+/*
+ * Waveform capture for the verilator model.
+ *
+ * Tracing starts on the debugger's start_trace command, at +trace_start=CYCLE
+ * or when the fetch PC reaches +trace_pc=ADDR, and stops on the debugger's
+ * stop_trace command or at +trace_stop=CYCLE.  With +trace_flight=N the
+ * trace is a flight recorder: it alternates between two files of N cycles
+ * each and stops at the first breakpoint, so only the cycles leading up to
+ * it are kept.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <verilated.h>
+#include "Vverilator_toplevel.h"
+
+#include "trace.h"
+
+#ifdef VERILATOR_TRACE
+#ifdef VERILATOR_TRACE_FST
+#include <verilated_fst_c.h>
+typedef VerilatedFstC Tracer;
+#define TRACE_EXT "fst"
+#else /* !VERILATOR_TRACE_FST */
+#include <verilated_vcd_c.h>
+typedef VerilatedVcdC Tracer;
+#define TRACE_EXT "vcd"
+#endif /* VERILATOR_TRACE_FST */
+
+#define TRACE_NEVER	(~(vluint64_t)0)
+
+static struct {
+	Tracer *tracer;
+	bool open;
+	bool active;
+	bool done;
+	/* Half cycles for the trace timestamps. */
+	vluint64_t time;
+	vluint64_t cycle;
+	vluint64_t start_cycle;
+	vluint64_t stop_cycle;
+	bool have_start_pc;
+	IData start_pc;
+	vluint64_t flight_cycles;
+	vluint64_t segment_start;
+	unsigned int segment;
+	bool segment_wrapped;
+	bool bkpt_hit;
+} trace;
+
+static bool plusarg_u64(const char *name, vluint64_t *val)
+{
+	std::string match = Verilated::commandArgsPlusMatch(name);
+
+	if (match == "")
+		return false;
+
+	*val = strtoull(match.substr(match.find("=") + 1).c_str(), NULL, 0);
+
+	return true;
+}
+
+static std::string segment_path(unsigned int segment)
+{
+	if (!trace.flight_cycles)
+		return "trace." TRACE_EXT;
+
+	return "trace." + std::to_string(segment) + "." TRACE_EXT;
+}
+
+static void trace_open()
+{
+	trace.tracer->open(segment_path(trace.segment).c_str());
+	trace.open = true;
+	trace.segment_start = trace.cycle;
+}
+
+static void trace_close()
+{
+	if (trace.open)
+		trace.tracer->close();
+	trace.open = false;
+}
+
+static void trace_begin()
+{
+	if (trace.active || trace.done)
+		return;
+
+	if (!trace.open)
+		trace_open();
+	trace.active = true;
+}
+
+static void trace_end()
+{
+	if (!trace.active)
+		return;
+
+	trace.active = false;
+	trace.done = true;
+	trace_close();
+
+	if (!trace.flight_cycles)
+		return;
+
+	if (trace.segment_wrapped)
+		fprintf(stderr, "trace: cycle %llu, last cycles in %s and %s\n",
+			(unsigned long long)trace.cycle,
+			segment_path(!trace.segment).c_str(),
+			segment_path(trace.segment).c_str());
+	else
+		fprintf(stderr, "trace: cycle %llu, last cycles in %s\n",
+			(unsigned long long)trace.cycle,
+			segment_path(trace.segment).c_str());
+}
+
+static void trace_next_segment()
+{
+	trace_close();
+	trace.segment = !trace.segment;
+	trace.segment_wrapped = true;
+	trace_open();
+}
+
+void init_trace(Vverilator_toplevel *top)
+{
+	vluint64_t pc;
+
+	trace.start_cycle = trace.stop_cycle = TRACE_NEVER;
+	plusarg_u64("trace_start=", &trace.start_cycle);
+	plusarg_u64("trace_stop=", &trace.stop_cycle);
+	plusarg_u64("trace_flight=", &trace.flight_cycles);
+	if (plusarg_u64("trace_pc=", &pc)) {
+		trace.have_start_pc = true;
+		trace.start_pc = pc;
+	}
+
+	Verilated::traceEverOn(true);
+	trace.tracer = new Tracer;
+	top->trace(trace.tracer, 99);
+
+	/* The debugger terminates the simulation with exit(). */
+	atexit(trace_close);
+}
+
+void trace_dump()
+{
+	if (trace.active)
+		trace.tracer->dump(trace.time);
+	++trace.time;
+}
+
+/* Called from the RTL on every rising clock edge. */
+void trace_sample(IData pc, CData bkpt_hit)
+{
+	bool new_bkpt = bkpt_hit && !trace.bkpt_hit;
+
+	trace.bkpt_hit = bkpt_hit;
+	++trace.cycle;
+
+	if (!trace.active &&
+	    (trace.cycle >= trace.start_cycle ||
+	     (trace.have_start_pc && pc == trace.start_pc)))
+		trace_begin();
+
+	if (!trace.active)
+		return;
+
+	if (trace.cycle >= trace.stop_cycle ||
+	    (trace.flight_cycles && new_bkpt))
+		trace_end();
+	else if (trace.flight_cycles &&
+		 trace.cycle - trace.segment_start >= trace.flight_cycles)
+		trace_next_segment();
+}
+
+void start_trace()
+{
+	trace_begin();
+}
+
+void stop_trace()
+{
+	trace_end();
+}
+#else /* !VERILATOR_TRACE */
+void start_trace()
+{
+}
+
+void stop_trace()
+{
+}
+#endif /* VERILATOR_TRACE */
@@ -0,0 +1,9 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+class Vverilator_toplevel;
+
+void init_trace(Vverilator_toplevel *top);
+void trace_dump();
+
+#endif /* __TRACE_H__ */
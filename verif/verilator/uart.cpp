@@ -1,10 +1,25 @@
 #include <err.h>
+#include <cstdlib>
 #include <string>
 #include <verilated.h>
 #include <unistd.h>
 #include "../../devicemodels/uart.h"
 
-static int pts;
+#define UART_BUF_SIZE	4096
+
+/*
+ * The RTL polls for input and writes output through the buffers below, the
+ * host side is only touched from uart_service() between batches of cycles.
+ */
+static struct {
+	int pts;
+	int out_fd;
+	char in[UART_BUF_SIZE];
+	size_t in_head;
+	size_t in_len;
+	char out[UART_BUF_SIZE];
+	size_t out_len;
+} uart;
 
 extern "C" int sim_is_interactive(void)
 {
@@ -13,27 +28,53 @@ extern "C" int sim_is_interactive(void)
 	return match != "";
 }
 
+static void uart_flush()
+{
+	size_t pos = 0;
+
+	while (pos < uart.out_len) {
+		ssize_t bw = write(uart.out_fd, uart.out + pos,
+				   uart.out_len - pos);
+
+		if (bw <= 0)
+			break;
+		pos += bw;
+	}
+	uart.out_len = 0;
+}
+
 void init_uart()
 {
-	pts = create_pts();
-	if (pts < 0)
+	uart.pts = create_pts();
+	if (uart.pts < 0)
 		err(1, "failed to create pts");
+	uart.out_fd = sim_is_interactive() ? uart.pts : STDOUT_FILENO;
+	atexit(uart_flush);
 }
 
-void uart_get(SData *val)
+void uart_service()
 {
-	char c;
+	uart_flush();
 
-	if (read(pts, &c, 1) == 1)
-		*val = (1 << 8) | c;
+	if (uart.in_head == uart.in_len) {
+		ssize_t br = read(uart.pts, uart.in, sizeof(uart.in));
+
+		uart.in_head = 0;
+		uart.in_len = br > 0 ? br : 0;
+	}
+}
+
+void uart_get(SData *val)
+{
+	if (uart.in_head < uart.in_len)
+		*val = (1 << 8) | (uint8_t)uart.in[uart.in_head++];
 	else
 		*val = 0;
 }
 
 void uart_put(SData val)
 {
-	char c = val & 0xff;
-
-	ssize_t bw = write(sim_is_interactive() ? pts : STDOUT_FILENO, &c, 1);
-	assert(bw == 1);
+	if (uart.out_len == sizeof(uart.out))
+		uart_flush();
+	uart.out[uart.out_len++] = val & 0xff;
 }
@@ -2,5 +2,6 @@
 #define __UART_H__
 
 void init_uart();
+void uart_service();
 
 #endif /* __UART_H__ */
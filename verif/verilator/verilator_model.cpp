@@ -1,40 +1,52 @@
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <unistd.h>
 
 #include <verilated.h>
 #include "Vverilator_toplevel.h"
-#include <verilated_vcd_c.h>
 
 #include "debug.h"
 #include "uart.h"
 #include "spi.h"
+#include "trace.h"
+#ifdef VERILATOR_LOCKSTEP
+#include "lockstep.h"
+#endif /* VERILATOR_LOCKSTEP */
 
-bool tracing_active = false;
+/*
+ * Host I/O is serviced between batches of this many cycles rather than from
+ * the RTL on every cycle.
+ */
+#define HOST_POLL_CYCLES	10000
 
-void start_trace()
-{
-	tracing_active = true;
-}
+/* Exit status of a headless run that reaches +max_cycles, as timeout(1). */
+#define EXIT_MAX_CYCLES		124
 
 class TopLevel {
 public:
 	TopLevel();
 	~TopLevel();
-	void set_tracer(VerilatedVcdC *tracer);
-	void cycle();
+	void run(unsigned long nr_cycles);
+	bool running() const { return top->running; }
 private:
-	VerilatedVcdC *tracer;
 	Vverilator_toplevel *top;
-	vluint64_t cur_time;
 };
 
 TopLevel::TopLevel()
-	: tracer(NULL), top(new Vverilator_toplevel), cur_time(0)
+	: top(new Vverilator_toplevel)
 {
 	init_uart();
 	init_debug();
 	init_spi();
+#ifdef VERILATOR_TRACE
+	init_trace(top);
+#endif /* VERILATOR_TRACE */
+#ifdef VERILATOR_LOCKSTEP
+	init_lockstep();
+#endif /* VERILATOR_LOCKSTEP */
 
 	top->clk = 0;
 	top->dbg_clk = 0;
@@ -42,46 +54,52 @@ TopLevel::TopLevel()
 
 TopLevel::~TopLevel()
 {
-#ifdef VERILATOR_TRACE
-	if (tracer)
-		tracer->close();
-#endif /* VERILATOR_TRACE */
 	top->final();
 }
 
-void TopLevel::set_tracer(VerilatedVcdC *tracer)
-{
-#ifdef VERILATOR_TRACE
-	Verilated::traceEverOn(true);
-	top->trace(tracer, 99);
-	this->tracer = tracer;
-	tracer->open("trace.vcd");
-#endif /* VERILATOR_TRACE */
-}
-
-void TopLevel::cycle()
+void TopLevel::run(unsigned long nr_cycles)
 {
-	top->eval();
-	top->clk = !top->clk;
-	top->dbg_clk = !top->dbg_clk;
+	for (unsigned long m = 0; m < 2 * nr_cycles; ++m) {
+		top->eval();
+		/* The debug clock always follows the core clock. */
+		top->clk = !top->clk;
+		top->dbg_clk = top->clk;
 #ifdef VERILATOR_TRACE
-	if (tracer && tracing_active)
-		tracer->dump(cur_time++);
+		trace_dump();
 #endif /* VERILATOR_TRACE */
+		if (Verilated::gotFinish())
+			break;
+	}
 }
 
 int main(int argc, char **argv)
 {
 	Verilated::commandArgs(argc, argv);
 	TopLevel top;
+	bool headless = sim_is_headless();
+	unsigned long long cycles = 0, max_cycles = 0;
+	std::string match = Verilated::commandArgsPlusMatch("max_cycles=");
 
-#ifdef VERILATOR_TRACE
-	VerilatedVcdC tracer;
-	top.set_tracer(&tracer);
-#endif /* VERILATOR_TRACE */
+	if (match != "")
+		max_cycles = strtoull(match.c_str() + strlen("+max_cycles="),
+				      NULL, 0);
+
+	/*
+	 * Headless runs end when the core stops on a bkp, which is only
+	 * noticed at the end of a batch.
+	 */
+	while (!Verilated::gotFinish()) {
+		top.run(HOST_POLL_CYCLES);
+		uart_service();
+		cycles += HOST_POLL_CYCLES;
 
-	while (!Verilated::gotFinish())
-		top.cycle();
+		if (headless && !top.running())
+			break;
+		if (max_cycles && cycles >= max_cycles) {
+			std::cerr << "reached max cycles" << std::endl;
+			return EXIT_MAX_CYCLES;
+		}
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -1,7 +1,8 @@
 `include "keynsham_defines.v"
 
 module verilator_toplevel(input wire clk /*verilator public*/,
-			  input wire dbg_clk /*verilator public*/);
+			  input wire dbg_clk /*verilator public*/,
+			  output wire running /*verilator public*/);
 
 `define NUM_SPI_CS	2
 
@@ -31,8 +32,6 @@ wire		mosi;
 wire		sclk;
 wire [`NUM_SPI_CS - 1:0] spi_ncs;
 
-wire		running;
-
 `ifdef GPIO_ADDRESS
 /* verilator lint_off UNUSED */
 wire [63:0]	gpio;
@@ -83,8 +82,43 @@ spislave	#(.csnum(0))
 			    .mosi(miso),
 			    .ncs(spi_ncs[0]));
 
+`ifdef VERILATOR_TRACE
+`systemc_imp_header
+void trace_sample(IData pc, CData bkpt_hit);
+`verilog
+
+/* Cycle, PC and breakpoint triggers for the waveform trace. */
+always @(posedge clk)
+	$c("{trace_sample(", soc.cpu.dbg_pc, ", ", soc.cpu.dbg_bkpt_hit, ");}");
+`endif
+
+`ifdef VERILATOR_LOCKSTEP
+`systemc_imp_header
+void lockstep_cycle(CData reg_wr, CData rd, IData rd_val, CData store,
+		    IData addr, IData mdr, CData width, IData fetch_pc);
+`verilog
+
+/* Register writes and stores by the core for the lockstep reference model. */
+wire		ls_reg_wr = soc.cpu.pipeline.regfile.wr_en &&
+			    !soc.cpu.pipeline.regfile.dbg_en &&
+			    !soc.cpu.pipeline.regfile.rst;
+wire [3:0]	ls_rd = soc.cpu.pipeline.regfile.rd_sel;
+wire [31:0]	ls_rd_val = soc.cpu.pipeline.regfile.wr_val;
+wire		ls_store = soc.cpu.pipeline.mem.store &&
+			   !soc.cpu.pipeline.mem.dbg_en;
+wire [31:0]	ls_addr = soc.cpu.pipeline.mem.addr;
+wire [31:0]	ls_mdr = soc.cpu.pipeline.mem.mdr;
+wire [1:0]	ls_width = soc.cpu.pipeline.mem.width;
+
+always @(posedge clk)
+	$c("{lockstep_cycle(", ls_reg_wr, ", ", ls_rd, ", ", ls_rd_val, ", ",
+	   ls_store, ", ", ls_addr, ", ", ls_mdr, ", ", ls_width, ", ",
+	   soc.cpu.dbg_pc, ");}");
+`endif
+
 initial begin
-	if (!|$test$plusargs("interactive")) begin
+	/* Headless runs only write the program's UART output to stdout. */
+	if (!|$test$plusargs("interactive") && !|$test$plusargs("headless")) begin
 		$display();
 	end
 end